@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <pxr/base/tf/pathUtils.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/usd/sdf/attributeSpec.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/usd/attribute.h>
+#include <pxr/usd/usd/stage.h>
+#include "BatchMode.h"
+#include "Commands.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+
+struct ScriptCommand {
+    std::string name;
+    std::vector<std::string> arguments;
+    std::string value; // Rest of the line for the commands setting a value
+    int line;
+};
+
+struct ScriptCommandSyntax {
+    const char *name;
+    size_t argumentCount;
+    bool hasValue;
+};
+
+const ScriptCommandSyntax scriptCommandSyntaxes[] = {
+    {"new_prim", 1, false}, {"reparent", 2, false}, {"create_overs", 1, false}, {"set", 1, true},
+    {"set_at", 2, true},    {"save", 0, false},     {"export", 1, false},       {"flatten", 1, false},
+};
+
+} // namespace
+
+static bool ReadScript(const std::string &fileName, std::vector<ScriptCommand> &script) {
+    std::ifstream file(fileName);
+    if (!file) {
+        std::cerr << "unable to read the batch script " << fileName << std::endl;
+        return false;
+    }
+    bool success = true;
+    std::string text;
+    for (int line = 1; std::getline(file, text); ++line) {
+        text = TfStringTrim(text);
+        if (text.empty() || text[0] == '#') {
+            continue;
+        }
+        std::istringstream stream(text);
+        ScriptCommand command;
+        command.line = line;
+        stream >> command.name;
+        const auto syntax = std::find_if(std::begin(scriptCommandSyntaxes), std::end(scriptCommandSyntaxes),
+                                         [&](const ScriptCommandSyntax &syntax) { return command.name == syntax.name; });
+        if (syntax == std::end(scriptCommandSyntaxes)) {
+            std::cerr << fileName << ":" << line << ": unknown command " << command.name << std::endl;
+            success = false;
+            continue;
+        }
+        std::string argument;
+        while (command.arguments.size() < syntax->argumentCount && stream >> argument) {
+            command.arguments.push_back(argument);
+        }
+        if (syntax->hasValue) {
+            std::getline(stream, command.value);
+            command.value = TfStringTrim(command.value);
+        } else if (stream >> argument) {
+            command.arguments.push_back(argument);
+        }
+        if (command.arguments.size() != syntax->argumentCount || (syntax->hasValue && command.value.empty())) {
+            std::cerr << fileName << ":" << line << ": wrong number of arguments for " << command.name << std::endl;
+            success = false;
+            continue;
+        }
+        script.push_back(std::move(command));
+    }
+    return success;
+}
+
+// Sdf doesn't expose its text parser, the value is read back from a small usda layer
+static VtValue ParseAttributeValue(const SdfValueTypeName &typeName, const std::string &valueText) {
+    SdfLayerRefPtr layer = SdfLayer::CreateAnonymous(".usda");
+    const std::string text =
+        "#usda 1.0\ndef \"Value\" {\n    custom " + typeName.GetAsToken().GetString() + " value = " + valueText + "\n}\n";
+    if (layer->ImportFromString(text)) {
+        if (SdfAttributeSpecHandle attribute = layer->GetAttributeAtPath(SdfPath("/Value.value"))) {
+            return attribute->GetDefaultValue();
+        }
+    }
+    return VtValue();
+}
+
+static std::string ResolveOutputFileName(const std::string &fileName, const std::string &stageFileName) {
+    return TfStringReplace(fileName, "{name}", TfStringGetBeforeSuffix(TfGetBaseName(stageFileName)));
+}
+
+// Runs one command of the script through the command layer. Returns an error message if it failed
+static std::string RunScriptCommand(const UsdStageRefPtr &stage, const ScriptCommand &command) {
+    SdfLayerRefPtr layer = stage->GetRootLayer();
+    const auto &arguments = command.arguments;
+    if (command.name == "new_prim") {
+        const SdfPath path(arguments[0]);
+        if (!path.IsAbsolutePath() || !path.IsPrimPath()) {
+            return "invalid prim path " + arguments[0];
+        }
+        if (path.GetParentPath().IsAbsoluteRootPath()) {
+            ExecuteAfterDraw<PrimNew>(layer, path.GetName());
+        } else if (SdfPrimSpecHandle parent = layer->GetPrimAtPath(path.GetParentPath())) {
+            ExecuteAfterDraw<PrimNew>(parent, path.GetName());
+        } else {
+            return "no parent prim for " + arguments[0];
+        }
+        ExecuteCommands();
+        return layer->GetPrimAtPath(path) ? "" : "unable to create " + arguments[0];
+    } else if (command.name == "reparent") {
+        const SdfPath source(arguments[0]);
+        const SdfPath destination(arguments[1]);
+        if (!source.IsPrimPath() || !(destination.IsPrimPath() || destination.IsAbsoluteRootPath())) {
+            return "invalid prim path";
+        }
+        ExecuteAfterDraw<PrimReparent>(SdfLayerHandle(layer), source, destination);
+        ExecuteCommands();
+        return layer->GetPrimAtPath(destination.AppendChild(source.GetNameToken())) ? "" : "unable to reparent " + arguments[0];
+    } else if (command.name == "create_overs") {
+        const SdfPath path(arguments[0]);
+        if (!path.IsPrimPath()) {
+            return "invalid prim path " + arguments[0];
+        }
+        ExecuteAfterDraw<LayerCreateOversFromPath>(layer, arguments[0]);
+        ExecuteCommands();
+        return layer->HasSpec(path) ? "" : "unable to create the overs of " + arguments[0];
+    } else if (command.name == "set" || command.name == "set_at") {
+        const bool hasTime = command.name == "set_at";
+        UsdTimeCode timeCode = UsdTimeCode::Default();
+        if (hasTime) {
+            bool isDouble = false;
+            timeCode = UsdTimeCode(TfUnstringify<double>(arguments[0], &isDouble));
+            if (!isDouble) {
+                return "invalid time " + arguments[0];
+            }
+        }
+        const UsdAttribute attribute = stage->GetAttributeAtPath(SdfPath(arguments[hasTime ? 1 : 0]));
+        if (!attribute) {
+            return "no attribute " + arguments[hasTime ? 1 : 0];
+        }
+        const VtValue value = ParseAttributeValue(attribute.GetTypeName(), command.value);
+        if (value.IsEmpty()) {
+            return "invalid value " + command.value + " for type " + attribute.GetTypeName().GetAsToken().GetString();
+        }
+        ExecuteAfterDraw<AttributeSet>(attribute, value, timeCode);
+        ExecuteCommands();
+        // The command doesn't report its errors, the value is read back to check it was written
+        VtValue writtenValue;
+        const bool isWritten = attribute.Get(&writtenValue, timeCode) && writtenValue == value;
+        return isWritten ? "" : "unable to set " + attribute.GetPath().GetString();
+    } else if (command.name == "save") {
+        return layer->Save() ? "" : "unable to save " + layer->GetIdentifier();
+    } else if (command.name == "export") {
+        const std::string fileName = ResolveOutputFileName(arguments[0], layer->GetRealPath());
+        return layer->Export(fileName) ? "" : "unable to export " + fileName;
+    } else if (command.name == "flatten") {
+        const std::string fileName = ResolveOutputFileName(arguments[0], layer->GetRealPath());
+        return stage->Export(fileName) ? "" : "unable to export " + fileName;
+    }
+    return "unknown command " + command.name;
+}
+
+// Runs the script on a stage, on a worker thread. The commands are executed and recorded by the command stack
+// of the thread, which is cleared once the script is finished
+static bool RunScript(const std::string &stageFileName, const std::vector<ScriptCommand> &script, std::string &errors) {
+    UsdStageRefPtr stage = UsdStage::Open(stageFileName);
+    if (!stage) {
+        errors = "unable to open the stage";
+        return false;
+    }
+    bool success = true;
+    for (const auto &command : script) {
+        const std::string error = RunScriptCommand(stage, command);
+        if (!error.empty()) {
+            errors = "line " + std::to_string(command.line) + ": " + error;
+            success = false;
+            break;
+        }
+    }
+    ExecuteAfterDraw<ClearUndoRedoCommand>();
+    ExecuteCommands();
+    return success;
+}
+
+int RunBatchMode(const CommandLineOptions &options) {
+    std::vector<ScriptCommand> script;
+    if (!ReadScript(options.batchScript(), script)) {
+        return EXIT_FAILURE;
+    }
+    const auto &stageFileNames = options.stages();
+    const auto batchStart = std::chrono::steady_clock::now();
+
+    // The stages are dispatched to a pool of threads, each thread running the script on one stage at a time.
+    // The scripts are not run as tasks of the USD thread pool: a task waiting for a composition could be given
+    // another stage to process on the same thread, and both would share the command stack of the thread.
+    std::atomic<size_t> nextStage(0);
+    std::atomic<size_t> failures(0);
+    std::mutex outputMutex;
+    const auto worker = [&]() {
+        for (size_t index = nextStage++; index < stageFileNames.size(); index = nextStage++) {
+            const auto start = std::chrono::steady_clock::now();
+            std::string errors;
+            const bool success = RunScript(stageFileNames[index], script, errors);
+            const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+            if (!success) {
+                failures++;
+            }
+            std::lock_guard<std::mutex> lock(outputMutex);
+            std::cout << (success ? "done   " : "failed ") << stageFileNames[index] << " in " << duration.count() << " ms";
+            if (!errors.empty()) {
+                std::cout << " - " << errors;
+            }
+            std::cout << std::endl;
+        }
+        ReleaseCommandStack();
+    };
+    const size_t jobs =
+        std::min<size_t>(options.jobs() ? options.jobs() : std::max(1u, std::thread::hardware_concurrency()), stageFileNames.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < jobs; ++i) {
+        threads.emplace_back(worker);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - batchStart;
+    std::cout << stageFileNames.size() << " stages processed with " << jobs << " threads in " << duration.count() << " s, "
+              << failures << " failed" << std::endl;
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "CommandLineOptions.h"
+
+///
+/// Headless batch mode, the editing commands of a script are run on all the stages passed on the command line
+/// without creating a window, an imgui context or a hydra renderer.
+///
+/// The script has one command per line, empty lines and lines starting with # are ignored:
+///     new_prim <primPath>                             creates a prim in the root layer
+///     reparent <primPath> <newParentPath>             moves a prim of the root layer under a new parent
+///     create_overs <primPath>                         creates the missing overs of the path in the root layer
+///     set <attributePath> <value>                     sets the default value of an attribute, the value is
+///     set_at <time> <attributePath> <value>           written as in a usda file, for example (1, 2, 3)
+///     save                                            saves the root layer
+///     export <fileName>                               exports the root layer
+///     flatten <fileName>                              exports the flattened stage
+/// {name} in a file name is replaced by the name of the processed stage without its extension.
+///
+/// The stages are processed in parallel, the function returns the process exit code.
+int RunBatchMode(const CommandLineOptions &options);
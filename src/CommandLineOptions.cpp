@@ -1,7 +1,29 @@
 #include "CommandLineOptions.h"
+#include <cstdlib>
+#include <iostream>
 
 CommandLineOptions::CommandLineOptions(int argc, char *const *argv) {
+    bool hasJobs = false;
     for (int i = 1; i < argc; ++i) {
-        _stages.push_back(argv[i]);
+        const std::string argument(argv[i]);
+        if (argument == "--batch" || argument == "--jobs") {
+            if (i + 1 >= argc) {
+                std::cerr << "missing value for " << argument << std::endl;
+                _isValid = false;
+                break;
+            }
+            if (argument == "--batch") {
+                _batchScript = argv[++i];
+            } else {
+                _jobs = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+                hasJobs = true;
+            }
+        } else {
+            _stages.push_back(argument);
+        }
+    }
+    if (hasJobs && !batchMode()) {
+        std::cerr << "--jobs is only valid with --batch" << std::endl;
+        _isValid = false;
     }
 }
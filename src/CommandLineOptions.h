@@ -1,3 +1,4 @@
+#pragma once
 #include <vector>
 #include <string>
 
@@ -5,8 +6,21 @@ class CommandLineOptions {
   public:
     CommandLineOptions(int argc, char *const *argv);
 
-    const std::vector<std::string> &stages() { return _stages; }
+    /// False when the options are inconsistent, the errors are printed when parsing
+    bool isValid() const { return _isValid; }
+
+    const std::vector<std::string> &stages() const { return _stages; }
+
+    /// Batch mode: the script is run on all the stages without opening the editor
+    bool batchMode() const { return !_batchScript.empty(); }
+    const std::string &batchScript() const { return _batchScript; }
+
+    /// Number of files processed in parallel in batch mode, 0 means one per core
+    unsigned int jobs() const { return _jobs; }
 
   private:
     std::vector<std::string> _stages;
+    std::string _batchScript;
+    unsigned int _jobs = 0;
+    bool _isValid = true;
 };
@@ -1,18 +1,297 @@
 #include "Debug.h"
 #include "Gui.h"
+#include "Profiler.h"
+#include "TraceCapture.h"
+#include "pxr/base/trace/aggregateNode.h"
 #include "pxr/base/trace/reporter.h"
 #include "pxr/base/trace/trace.h"
+#include <pxr/base/arch/timing.h>
 #include <pxr/base/plug/plugin.h>
 #include <pxr/base/plug/registry.h>
 #include <pxr/base/tf/debug.h>
-#include <sstream>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <map>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
-static void DrawTraceReporter() {
+// Stable color of a section across the frames
+static ImU32 GetSectionColor(const char *name) {
+    const size_t hash = std::hash<std::string>()(name);
+    return ImColor::HSV(static_cast<float>(hash % 360) / 360.f, 0.45f, 0.6f);
+}
+
+// The sections of a frame are drawn on one row per nesting level, their width is their duration
+static void DrawFlameChart(const std::vector<ProfilerEvent> &frameEvents) {
+    if (frameEvents.empty()) {
+        return;
+    }
+    int64_t frameStart = frameEvents.front().start;
+    int64_t frameEnd = frameEvents.front().end;
+    uint32_t maxDepth = 0;
+    for (const auto &event : frameEvents) {
+        frameStart = std::min(frameStart, event.start);
+        frameEnd = std::max(frameEnd, event.end);
+        maxDepth = std::max(maxDepth, event.depth);
+    }
+    const float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    const ImVec2 origin = ImGui::GetCursorScreenPos();
+    const ImVec2 size(std::max(ImGui::GetContentRegionAvail().x, 1.f), rowHeight * static_cast<float>(maxDepth + 1));
+    ImGui::InvisibleButton("##FlameChart", size);
+    const bool isHovered = ImGui::IsItemHovered();
+    const ImVec2 mousePos = ImGui::GetIO().MousePos;
+    const float scale = size.x / static_cast<float>(std::max<int64_t>(frameEnd - frameStart, 1));
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    for (const auto &event : frameEvents) {
+        const ImVec2 min(origin.x + static_cast<float>(event.start - frameStart) * scale,
+                         origin.y + static_cast<float>(event.depth) * rowHeight);
+        const ImVec2 max(std::max(min.x + 1.f, origin.x + static_cast<float>(event.end - frameStart) * scale),
+                         min.y + rowHeight - 1.f);
+        drawList->AddRectFilled(min, max, GetSectionColor(event.name));
+        drawList->PushClipRect(min, max, true);
+        drawList->AddText(ImVec2(min.x + 2.f, min.y), IM_COL32_WHITE, event.name);
+        drawList->PopClipRect();
+        if (isHovered && mousePos.x >= min.x && mousePos.x < max.x && mousePos.y >= min.y && mousePos.y < max.y) {
+            ImGui::SetTooltip("%s: %.3f ms", event.name, static_cast<double>(event.end - event.start) / 1e6);
+        }
+    }
+}
+
+// Number of frames kept in the timings tab
+static constexpr size_t MaxDisplayedFrames = 300;
+
+static void DrawTimings() {
+    ImGui::Text("ImGui: %.3f ms/frame  (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+
+    Profiler &profiler = Profiler::GetInstance();
+    bool isEnabled = profiler.IsEnabled();
+    if (ImGui::Checkbox("Record timings", &isEnabled)) {
+        profiler.SetEnabled(isEnabled);
+    }
+    ImGui::SameLine();
+    static bool isPaused = false;
+    ImGui::Checkbox("Pause", &isPaused);
+    ImGui::SameLine();
+    static std::string traceFileName = "usdtweak_trace.json";
+    static std::string exportStatus;
+    if (ImGui::Button("Export chrome trace")) {
+        exportStatus = profiler.WriteChromeTrace(traceFileName) ? "Exported to " + traceFileName
+                                                                : "Unable to write " + traceFileName;
+    }
+    ImGui::SameLine();
+    ImGui::PushItemWidth(-FLT_MIN);
+    ImGui::InputText("##TraceFileName", &traceFileName);
+    ImGui::PopItemWidth();
+    if (!exportStatus.empty()) {
+        ImGui::Text("%s", exportStatus.c_str());
+    }
+
+    // Events of the ui thread, grouped by frame. The new events are read at each frame and the frames are aggregated
+    // once, when they are finished. The current frame is not finished and its events wait in pendingEvents
+    struct FrameTimings {
+        uint64_t frame = 0;
+        double duration = 0.0; // Milliseconds
+        std::vector<ProfilerEvent> events;
+        std::map<std::string, double> sections;
+    };
+    static std::deque<FrameTimings> frames;
+    static std::vector<ProfilerEvent> pendingEvents;
+    static uint64_t nextEventIndex = 0;
+    bool framesChanged = false;
+    if (!isPaused) {
+        const uint64_t currentFrame = profiler.GetCurrentFrame();
+        const uint32_t threadId = Profiler::GetThreadId();
+        for (const auto &event : profiler.GetEvents(nextEventIndex)) {
+            if (event.threadId == threadId) {
+                pendingEvents.push_back(event);
+            }
+        }
+        // The events finish in frame order on a thread
+        size_t finished = 0;
+        for (; finished < pendingEvents.size() && pendingEvents[finished].frame < currentFrame; ++finished) {
+            const ProfilerEvent &event = pendingEvents[finished];
+            if (frames.empty() || frames.back().frame != event.frame) {
+                frames.emplace_back();
+                frames.back().frame = event.frame;
+            }
+            FrameTimings &frameTimings = frames.back();
+            const double duration = static_cast<double>(event.end - event.start) / 1e6;
+            if (event.depth == 0) {
+                frameTimings.duration += duration;
+            }
+            frameTimings.sections[event.name] += duration;
+            frameTimings.events.push_back(event);
+            framesChanged = true;
+        }
+        pendingEvents.erase(pendingEvents.begin(), pendingEvents.begin() + finished);
+        while (frames.size() > MaxDisplayedFrames) {
+            frames.pop_front();
+        }
+    }
+    if (frames.empty()) {
+        return;
+    }
+
+    // Rolling chart of the frame durations, the selected frame is shown in the flame chart
+    std::vector<float> frameDurations;
+    frameDurations.reserve(frames.size());
+    for (const auto &frameTimings : frames) {
+        frameDurations.push_back(static_cast<float>(frameTimings.duration));
+    }
+    static int selectedFrame = -1; // The last frame when negative
+    const int frameCount = static_cast<int>(frameDurations.size());
+    const int frameIndex = selectedFrame < 0 || selectedFrame >= frameCount ? frameCount - 1 : selectedFrame;
+    ImGui::PlotHistogram("##FrameDurations", frameDurations.data(), frameCount, 0, "Frame durations (ms)", 0.f, FLT_MAX,
+                         ImVec2(-FLT_MIN, 60));
+    if (ImGui::IsItemClicked()) {
+        const float position = (ImGui::GetIO().MousePos.x - ImGui::GetItemRectMin().x) / ImGui::GetItemRectSize().x;
+        selectedFrame = std::min(frameCount - 1, std::max(0, static_cast<int>(position * static_cast<float>(frameCount))));
+    }
+    const FrameTimings &frame = frames[frameIndex];
+    ImGui::Text("Frame %llu: %.3f ms", static_cast<unsigned long long>(frame.frame), frameDurations[frameIndex]);
+    ImGui::SameLine();
+    if (ImGui::SmallButton("Follow last frame")) {
+        selectedFrame = -1;
+    }
+    DrawFlameChart(frame.events);
+
+    // Time spent in each section in the selected frame and on average, updated when the frames or the selection change
+    struct SectionTimings {
+        double frame = 0.0;
+        double total = 0.0;
+        double max = 0.0;
+    };
+    static std::map<std::string, SectionTimings> sections;
+    static uint64_t sectionsFrame = 0;
+    if (framesChanged || sectionsFrame != frame.frame) {
+        sections.clear();
+        for (const auto &frameTimings : frames) {
+            for (const auto &section : frameTimings.sections) {
+                auto &timings = sections[section.first];
+                timings.total += section.second;
+                timings.max = std::max(timings.max, section.second);
+            }
+        }
+        for (const auto &section : frame.sections) {
+            sections[section.first].frame = section.second;
+        }
+        sectionsFrame = frame.frame;
+    }
+    if (ImGui::BeginTable("##Sections", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Section");
+        ImGui::TableSetupColumn("Frame (ms)");
+        ImGui::TableSetupColumn("Average (ms)");
+        ImGui::TableSetupColumn("Max (ms)");
+        ImGui::TableHeadersRow();
+        for (const auto &section : sections) {
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%s", section.first.c_str());
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%.3f", section.second.frame);
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%.3f", section.second.total / static_cast<double>(frameCount));
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.3f", section.second.max);
+        }
+        ImGui::EndTable();
+    }
+}
+
+// Columns of the aggregated trace tree
+enum TraceTreeColumn { TraceTreeName, TraceTreeInclusive, TraceTreeExclusive, TraceTreeCount };
+
+static double TicksToMilliseconds(uint64_t ticks) { return ArchTicksToSeconds(ticks) * 1000.0; }
+
+static void SortTraceNodes(TraceAggregateNodePtrVector &nodes, const ImGuiTableColumnSortSpecs *sortSpecs) {
+    if (!sortSpecs) {
+        return;
+    }
+    const bool ascending = sortSpecs->SortDirection == ImGuiSortDirection_Ascending;
+    const auto compare = [&](const TraceAggregateNodePtr &a, const TraceAggregateNodePtr &b) {
+        switch (sortSpecs->ColumnIndex) {
+        case TraceTreeName:
+            return ascending ? a->GetKey().GetString() < b->GetKey().GetString()
+                             : a->GetKey().GetString() > b->GetKey().GetString();
+        case TraceTreeInclusive:
+            return ascending ? a->GetInclusiveTime() < b->GetInclusiveTime() : a->GetInclusiveTime() > b->GetInclusiveTime();
+        case TraceTreeExclusive:
+            return ascending ? a->GetExclusiveTime() < b->GetExclusiveTime() : a->GetExclusiveTime() > b->GetExclusiveTime();
+        default:
+            return ascending ? a->GetCount() < b->GetCount() : a->GetCount() > b->GetCount();
+        }
+    };
+    std::stable_sort(nodes.begin(), nodes.end(), compare);
+}
 
-    static std::string reportStr;
+static void DrawTraceNode(const TraceAggregateNodePtr &node, const ImGuiTableColumnSortSpecs *sortSpecs) {
+    TraceAggregateNodePtrVector children = node->GetChildren();
+    SortTraceNodes(children, sortSpecs);
+    ImGui::TableNextRow();
+    ImGui::TableSetColumnIndex(TraceTreeName);
+    const ImGuiTreeNodeFlags flags = children.empty() ? ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen
+                                                     : ImGuiTreeNodeFlags_None;
+    const bool isOpen = ImGui::TreeNodeEx(node->GetKey().GetText(), flags);
+    ImGui::TableSetColumnIndex(TraceTreeInclusive);
+    ImGui::Text("%.3f", TicksToMilliseconds(node->GetInclusiveTime()));
+    ImGui::TableSetColumnIndex(TraceTreeExclusive);
+    ImGui::Text("%.3f", TicksToMilliseconds(node->GetExclusiveTime()));
+    ImGui::TableSetColumnIndex(TraceTreeCount);
+    ImGui::Text("%d", node->GetCount());
+    if (isOpen && !children.empty()) {
+        for (const auto &child : children) {
+            DrawTraceNode(child, sortSpecs);
+        }
+        ImGui::TreePop();
+    }
+}
 
+static void DrawTraceCapture() {
+    TraceCapture &capture = TraceCapture::GetInstance();
+    static bool startFailed = false;
+    if (capture.IsCapturing()) {
+        if (ImGui::Button("Stop capture")) {
+            capture.Stop();
+        }
+        ImGui::SameLine();
+        ImGui::Text("Capturing to %s", capture.fileName.c_str());
+    } else {
+        if (ImGui::Button("Start capture")) {
+            startFailed = !capture.Start();
+        }
+        ImGui::SameLine();
+        ImGui::PushItemWidth(-FLT_MIN);
+        ImGui::InputText("##CaptureFileName", &capture.fileName);
+        ImGui::PopItemWidth();
+        ImGui::PushItemWidth(100);
+        ImGui::InputInt("Max duration (s)", &capture.maxDuration);
+        ImGui::SameLine();
+        ImGui::InputInt("Max size (MB)", &capture.maxFileSize);
+        ImGui::PopItemWidth();
+        capture.maxDuration = std::max(1, capture.maxDuration);
+        capture.maxFileSize = std::max(1, capture.maxFileSize);
+    }
+    if (startFailed) {
+        ImGui::Text("Unable to open %s", capture.fileName.c_str());
+    } else if (capture.GetEventCount()) {
+        ImGui::Text("%zu events, %.1f MB in %.1f s", capture.GetEventCount(),
+                    static_cast<double>(capture.GetFileSize()) / (1024.0 * 1024.0), capture.GetDuration());
+    }
+    ImGui::TextDisabled("Ctrl+Shift+T starts and stops the capture");
+}
+
+static void DrawTraceReporter() {
+    DrawTraceCapture();
+    ImGui::Separator();
+
+    // The capture thread clears the reporter, its collections would otherwise be kept in memory until the tree is updated
+    const bool isCapturing = TraceCapture::GetInstance().IsCapturing();
+    if (isCapturing) {
+        ImGui::TextDisabled("The tree is not updated while capturing");
+    }
+    ImGui::BeginDisabled(isCapturing);
     if (ImGui::Button("Start Tracing")) {
         TraceCollector::GetInstance().SetEnabled(true);
     }
@@ -21,24 +300,42 @@ static void DrawTraceReporter() {
         TraceCollector::GetInstance().SetEnabled(false);
     }
     ImGui::SameLine();
+    // The tree is only aggregated when requested, building it while tracing would show in the timings
+    static TraceAggregateNodePtr aggregateTree;
     if (ImGui::Button("Reset counters")) {
         TraceReporter::GetGlobalReporter()->ClearTree();
+        aggregateTree = TraceAggregateNodePtr();
     }
     ImGui::SameLine();
-
     if (ImGui::Button("Update tree")) {
         TraceReporter::GetGlobalReporter()->UpdateTraceTrees();
+        aggregateTree = TraceReporter::GetGlobalReporter()->GetAggregateTreeRoot();
+    }
+    ImGui::EndDisabled();
+    if (!aggregateTree) {
+        return;
     }
-    if (TraceCollector::IsEnabled()) {
-        std::ostringstream report;
-        TraceReporter::GetGlobalReporter()->Report(report);
-        reportStr = report.str();
+    constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_Sortable | ImGuiTableFlags_Resizable | ImGuiTableFlags_RowBg |
+                                           ImGuiTableFlags_ScrollY | ImGuiTableFlags_BordersV;
+    if (ImGui::BeginTable("##TraceTree", 4, tableFlags, ImVec2(-FLT_MIN, -10))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Scope", ImGuiTableColumnFlags_WidthStretch | ImGuiTableColumnFlags_NoHide);
+        ImGui::TableSetupColumn("Inclusive (ms)", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultSort |
+                                                      ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableSetupColumn("Exclusive (ms)", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending);
+        ImGui::TableHeadersRow();
+        const ImGuiTableSortSpecs *sortSpecs = ImGui::TableGetSortSpecs();
+        const ImGuiTableColumnSortSpecs *columnSortSpecs =
+            sortSpecs && sortSpecs->SpecsCount ? &sortSpecs->Specs[0] : nullptr;
+        // The root node has no timing, its children are the threads
+        TraceAggregateNodePtrVector threads = aggregateTree->GetChildren();
+        SortTraceNodes(threads, columnSortSpecs);
+        for (const auto &thread : threads) {
+            DrawTraceNode(thread, columnSortSpecs);
+        }
+        ImGui::EndTable();
     }
-    ImGuiIO &io = ImGui::GetIO();
-    ImGui::PushFont(io.Fonts->Fonts[1]);
-    const ImVec2 size(-FLT_MIN, -10);
-    ImGui::InputTextMultiline("##TraceReport", &reportStr, size);
-    ImGui::PopFont();
 }
 
 static void DrawDebugCodes() {
@@ -82,7 +379,7 @@ void DrawDebugUI() {
     ImGui::SameLine();
     if (current_item == 0) {
         ImGui::BeginChild("##Timing");
-        ImGui::Text("ImGui: %.3f ms/frame  (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        DrawTimings();
         ImGui::EndChild();
     } else if (current_item == 1) {
         ImGui::BeginChild("##DebugCodes");
@@ -35,6 +35,7 @@
 #include "ConnectionEditor.h"
 #include "Playblast.h"
 
+#include "Profiler.h"
 #include "Stamp.h"
 
 // There is a bug in the Undo/Redo when reloading certain layers, here is the post
@@ -123,6 +124,19 @@ struct AboutModalDialog : public ModalDialog {
     Editor &editor;
 };
 
+// An undo or redo couldn't read its values back from the journal on disk
+struct UndoErrorModalDialog : public ModalDialog {
+    UndoErrorModalDialog(const std::string &message) : message(message) {}
+    void Draw() override {
+        ImGui::Text("%s", message.c_str());
+        if (ImGui::Button("  Close  ")) {
+            CloseModal();
+        }
+    }
+    const char *DialogId() const override { return "Undo error"; }
+    std::string message;
+};
+
 struct CloseEditorModalDialog : public ModalDialog {
     CloseEditorModalDialog(Editor &editor, std::string confirmReasons) : editor(editor), confirmReasons(confirmReasons) {}
 
@@ -326,16 +340,30 @@ void Editor::WindowSizeCallback(GLFWwindow *window, int width, int height) {
         Editor *editor = static_cast<Editor *>(userPointer);
         editor->_settings._mainWindowWidth = width;
         editor->_settings._mainWindowHeight = height;
+        editor->RequestRedraw();
+    }
+}
+
+void Editor::WindowRefreshCallback(GLFWwindow *window) {
+    void *userPointer = glfwGetWindowUserPointer(window);
+    if (userPointer) {
+        Editor *editor = static_cast<Editor *>(userPointer);
+        editor->RequestRedraw();
     }
 }
 
 Editor::Editor() : _viewport(UsdStageRefPtr(), _selection), _layerHistoryPointer(0) {
     ExecuteAfterDraw<EditorSetDataPointer>(this); // This is specialized to execute here, not after the draw
     LoadSettings();
+    _viewport.SetStageMutex(_primSearchIndex.GetStageMutex());
     SetFileBrowserDirectory(_settings._lastFileBrowserDirectory);
+    _layersDidChangeKey = TfNotice::Register(TfCreateWeakPtr(this), &Editor::OnLayersDidChange);
+    _stageContentsChangedKey = TfNotice::Register(TfCreateWeakPtr(this), &Editor::OnStageContentsChanged);
 }
 
 Editor::~Editor(){
+    TfNotice::Revoke(_layersDidChangeKey);
+    TfNotice::Revoke(_stageContentsChangedKey);
     _settings._lastFileBrowserDirectory = GetFileBrowserDirectory();
     SaveSettings();
 }
@@ -346,6 +374,7 @@ void Editor::InstallCallbacks(GLFWwindow *window) {
     glfwSetDropCallback(window, Editor::DropCallback);
     glfwSetWindowCloseCallback(window, Editor::WindowCloseCallback);
     glfwSetWindowSizeCallback(window, Editor::WindowSizeCallback);
+    glfwSetWindowRefreshCallback(window, Editor::WindowRefreshCallback);
 }
 
 void Editor::RemoveCallbacks(GLFWwindow *window) { glfwSetWindowUserPointer(window, nullptr); }
@@ -365,6 +394,7 @@ void Editor::SetCurrentStage(UsdStageRefPtr stage) {
         }
         // TODO multiple viewport management
         _viewport.SetCurrentStage(stage);
+        _primSearchIndex.SetStage(stage);
     }
 }
 
@@ -421,15 +451,57 @@ void Editor::FindOrOpenLayer(const std::string &path) {
     SetCurrentLayer(newLayer, true);
 }
 
-//
+// The stage is opened in a background thread, it will be added to the stage cache by UpdateStageLoaders when its
+// composition is finished
 void Editor::OpenStage(const std::string &path, bool openLoaded) {
-    auto newStage = UsdStage::Open(path, openLoaded ? UsdStage::LoadAll : UsdStage::LoadNone); // TODO: as an option
-    if (newStage) {
-        GetStageCache().Insert(newStage);
-        SetCurrentStage(newStage);
-        _settings._showContentBrowser = true;
-        _settings._showViewport = true;
-        _settings.UpdateRecentFiles(path);
+    for (const auto &loader : _stageLoaders) {
+        if (loader->GetPath() == path && !loader->IsCancelled()) {
+            return; // Already opening
+        }
+    }
+    _stageLoaders.emplace_back(new StageLoader(path, openLoaded, &_primSearchIndex.GetStageMutex()));
+}
+
+void Editor::CancelOpenStage(const std::string &path) {
+    for (const auto &loader : _stageLoaders) {
+        if (loader->GetPath() == path) {
+            loader->Cancel();
+        }
+    }
+}
+
+void Editor::UpdateStageLoaders() {
+    for (auto it = _stageLoaders.begin(); it != _stageLoaders.end();) {
+        StageLoader &loader = **it;
+        if (!loader.IsFinished()) {
+            ++it;
+            continue;
+        }
+        auto newStage = loader.GetStage();
+        if (newStage) {
+            GetStageCache().Insert(newStage);
+            SetCurrentStage(newStage);
+            _settings._showContentBrowser = true;
+            _settings._showViewport = true;
+            _settings.UpdateRecentFiles(loader.GetPath());
+        } else if (!loader.IsCancelled()) {
+            std::cerr << "unable to open stage " << loader.GetPath() << std::endl;
+        }
+        it = _stageLoaders.erase(it);
+    }
+}
+
+void Editor::DrawStageLoadersStatus() {
+    for (const auto &loader : _stageLoaders) {
+        ImGui::PushID(loader.get());
+        ImGui::Separator();
+        ImGui::Text(ICON_FA_FOLDER_OPEN " %s", loader->GetPath().c_str());
+        ImGui::ProgressBar(loader->GetProgress(), ImVec2(100, 0));
+        ImGui::Text("%s", loader->IsCancelled() ? "Cancelling" : loader->GetProgressText().c_str());
+        if (!loader->IsCancelled() && ImGui::SmallButton("Cancel")) {
+            loader->Cancel();
+        }
+        ImGui::PopID();
     }
 }
 
@@ -461,12 +533,38 @@ Viewport & Editor::GetViewport() {
 }
 
 void Editor::HydraRender() {
+    PROFILE_SCOPE("Hydra render");
 #if !( __APPLE__ && PXR_VERSION < 2208)
     _viewport.Update();
     _viewport.Render();
 #endif
 }
 
+// ImGui needs a few frames to settle after an event, for example to open a popup
+static constexpr int RedrawFrameCount = 3;
+
+void Editor::RequestRedraw() {
+    // Wakes up the main loop if it is waiting for events, the notices can request many redraws in a frame
+    if (_redrawFrames.exchange(RedrawFrameCount) == 0) {
+        glfwPostEmptyEvent();
+    }
+}
+
+bool Editor::IsRedrawNeeded() const {
+    return _redrawFrames > 0 || _viewport.IsPlaying() || !_viewport.IsConverged() || !_stageLoaders.empty() ||
+           IsModalDialogOpened();
+}
+
+void Editor::OnFrameDrawn() {
+    int frames = _redrawFrames;
+    while (frames > 0 && !_redrawFrames.compare_exchange_weak(frames, frames - 1)) {
+    }
+}
+
+void Editor::OnLayersDidChange(const SdfNotice::LayersDidChange &notice) { RequestRedraw(); }
+
+void Editor::OnStageContentsChanged(const UsdNotice::StageContentsChanged &notice) { RequestRedraw(); }
+
 void Editor::ShowDialogSaveLayerAs(SdfLayerHandle layerToSaveAs) { DrawModalDialog<SaveLayerAsDialog>(*this, layerToSaveAs); }
 
 
@@ -571,6 +669,11 @@ void Editor::DrawMainMenuBar() {
             ImGui::MenuItem(ViewportWindowTitle, nullptr, &_settings._showViewport);
             ImGui::MenuItem(StatusBarWindowTitle, nullptr, &_settings._showStatusBar);
             ImGui::MenuItem(LauncherBarWindowTitle, nullptr, &_settings._showLauncherBar);
+            ImGui::Separator();
+            ImGui::MenuItem("Redraw only on changes", nullptr, &_settings._idleRedraw);
+            if (ImGui::InputInt("Max frame rate", &_settings._maxFrameRate)) {
+                _settings._maxFrameRate = std::max(_settings._maxFrameRate, 0);
+            }
             ImGui::EndMenu();
         }
         if (ImGui::BeginMenu("Help")) {
@@ -585,9 +688,23 @@ void Editor::DrawMainMenuBar() {
 }
 
 void Editor::Draw() {
+    // The widgets can edit the stage, the search index must not read it in the background
+    const auto stageLock = _primSearchIndex.LockStage();
+    _primSearchIndex.Update();
+
+    // Stages opened in the background since the last frame
+    UpdateStageLoaders();
+
+    const std::string undoError = TakeUndoError();
+    if (!undoError.empty()) {
+        DrawModalDialog<UndoErrorModalDialog>(undoError);
+    }
 
     // Main Menu bar
-    DrawMainMenuBar();
+    {
+        PROFILE_SCOPE("Main menu bar");
+        DrawMainMenuBar();
+    }
 
     // Dock
     BeginBackgoundDock();
@@ -595,25 +712,27 @@ void Editor::Draw() {
     const ImGuiWindowFlags layerWindowFlag = (rootLayer && rootLayer->IsDirty()) ? ImGuiWindowFlags_UnsavedDocument : ImGuiWindowFlags_None;
 
     if (_settings._showViewport) {
-        TRACE_SCOPE(ViewportWindowTitle);
+        PROFILE_SCOPE(ViewportWindowTitle);
         ImGui::Begin(ViewportWindowTitle, &_settings._showViewport);
         GetViewport().Draw();
         ImGui::End();
     }
 
     if (_settings._showDebugWindow) {
-        TRACE_SCOPE(DebugWindowTitle);
+        PROFILE_SCOPE(DebugWindowTitle);
         ImGui::Begin(DebugWindowTitle, &_settings._showDebugWindow);
         DrawDebugUI();
         ImGui::End();
     }
     if (_settings._showStatusBar) {
+        PROFILE_SCOPE(StatusBarWindowTitle);
         ImGuiWindowFlags statusFlags = ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_MenuBar;
         if (ImGui::BeginViewportSideBar("##StatusBar", NULL, ImGuiDir_Down, ImGui::GetFrameHeight(), statusFlags)) {
             if (ImGui::BeginMenuBar()) { // Drawing only the framerate
                 ImGui::Text("\xee\x81\x99"
                             " %.3f ms/frame  (%.1f FPS)",
                             1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+                DrawStageLoadersStatus();
                 ImGui::EndMenuBar();
             }
         }
@@ -621,6 +740,7 @@ void Editor::Draw() {
     }
 
     if (_settings._showLauncherBar) {
+        PROFILE_SCOPE(LauncherBarWindowTitle);
         ImGuiWindowFlags windowFlags = ImGuiWindowFlags_None;
         ImGui::Begin(LauncherBarWindowTitle, &_settings._showLauncherBar, windowFlags);
         DrawLauncherBar(this);
@@ -628,7 +748,7 @@ void Editor::Draw() {
     }
     
     if (_settings._showPropertyEditor) {
-        TRACE_SCOPE(UsdPrimPropertiesWindowTitle);
+        PROFILE_SCOPE(UsdPrimPropertiesWindowTitle);
         ImGuiWindowFlags windowFlags = ImGuiWindowFlags_None;
         // WIP windowFlags |= ImGuiWindowFlags_MenuBar;
         ImGui::Begin(UsdPrimPropertiesWindowTitle, &_settings._showPropertyEditor, windowFlags);
@@ -641,14 +761,14 @@ void Editor::Draw() {
 
     if (_settings._showOutliner) {
         const ImGuiWindowFlags windowFlagsWithMenu = ImGuiWindowFlags_None | ImGuiWindowFlags_MenuBar;
-        TRACE_SCOPE(UsdStageHierarchyWindowTitle);
+        PROFILE_SCOPE(UsdStageHierarchyWindowTitle);
         ImGui::Begin(UsdStageHierarchyWindowTitle, &_settings._showOutliner, windowFlagsWithMenu);
         DrawStageOutliner(GetCurrentStage(), _selection);
         ImGui::End();
     }
 
     if (_settings._showTimeline) {
-        TRACE_SCOPE(TimelineWindowTitle);
+        PROFILE_SCOPE(TimelineWindowTitle);
         ImGui::Begin(TimelineWindowTitle, &_settings._showTimeline);
         UsdTimeCode tc = GetViewport().GetCurrentTimeCode();
         DrawTimeline(GetCurrentStage(), tc);
@@ -657,7 +777,7 @@ void Editor::Draw() {
     }
 
     if (_settings._showLayerHierarchyEditor) {
-        TRACE_SCOPE(SdfLayerHierarchyWindowTitle);
+        PROFILE_SCOPE(SdfLayerHierarchyWindowTitle);
         const std::string title(SdfLayerHierarchyWindowTitle + (rootLayer ? " - " + rootLayer->GetDisplayName() : "") +
                                 "###Layer hierarchy");
         ImGui::Begin(title.c_str(), &_settings._showLayerHierarchyEditor, layerWindowFlag);
@@ -666,7 +786,7 @@ void Editor::Draw() {
     }
 
     if (_settings._showLayerStackEditor) {
-        TRACE_SCOPE(SdfLayerStackWindowTitle);
+        PROFILE_SCOPE(SdfLayerStackWindowTitle);
         const std::string title(SdfLayerStackWindowTitle "###Layer stack");
         ImGui::Begin(title.c_str(), &_settings._showLayerStackEditor, layerWindowFlag);
         //DrawLayerSublayerStack(rootLayer);
@@ -675,7 +795,7 @@ void Editor::Draw() {
     }
 
     if (_settings._showContentBrowser) {
-        TRACE_SCOPE(ContentBrowserWindowTitle);
+        PROFILE_SCOPE(ContentBrowserWindowTitle);
         const ImGuiWindowFlags windowFlags = ImGuiWindowFlags_None | ImGuiWindowFlags_MenuBar;
         ImGui::Begin(ContentBrowserWindowTitle, &_settings._showContentBrowser, windowFlags);
         DrawContentBrowser(*this);
@@ -684,7 +804,7 @@ void Editor::Draw() {
     
     if (_settings._showPrimSpecEditor) {
         const ImGuiWindowFlags windowFlagsWithMenu = ImGuiWindowFlags_None | ImGuiWindowFlags_MenuBar;
-        TRACE_SCOPE(SdfPrimPropertiesWindowTitle);
+        PROFILE_SCOPE(SdfPrimPropertiesWindowTitle);
         ImGui::Begin(SdfPrimPropertiesWindowTitle, &_settings._showPrimSpecEditor, windowFlagsWithMenu);
         const SdfPath &primPath = _selection.GetAnchorPrimPath(GetCurrentLayer());
         // Ideally this condition should be moved in a function like DrawLayerProperties()
@@ -721,25 +841,29 @@ void Editor::Draw() {
 #endif
 
     if (_settings._textEditor) {
-        TRACE_SCOPE(SdfLayerAsciiEditorWindowTitle);
+        PROFILE_SCOPE(SdfLayerAsciiEditorWindowTitle);
         ImGui::Begin(SdfLayerAsciiEditorWindowTitle, &_settings._textEditor);
             DrawTextEditor(GetCurrentLayer());
         ImGui::End();
     }
 
     if (_settings._showSdfAttributeEditor) {
-        TRACE_SCOPE(SdfAttributeWindowTitle);
+        PROFILE_SCOPE(SdfAttributeWindowTitle);
         ImGui::Begin(SdfAttributeWindowTitle, &_settings._showSdfAttributeEditor);
         DrawSdfAttributeEditor(GetCurrentLayer(), GetSelection());
         ImGui::End();
     }
 
-    DrawCurrentModal();
+    {
+        PROFILE_SCOPE("Modal dialogs");
+        DrawCurrentModal();
+    }
 
     ///////////////////////
     // Top level shortcuts functions
     AddShortcut<UndoCommand, ImGuiKey_LeftCtrl, ImGuiKey_Z>();
     AddShortcut<RedoCommand, ImGuiKey_LeftCtrl, ImGuiKey_R>();
+    AddShortcut<EditorToggleTraceCapture, ImGuiKey_LeftCtrl, ImGuiKey_LeftShift, ImGuiKey_T>();
     EndBackgroundDock();
 
 }
@@ -778,8 +902,15 @@ void Editor::RunLauncher(const std::string &launcherName) {
 
 void Editor::LoadSettings() {
     _settings = ResourcesLoader::GetEditorSettings();
+    SetUndoMemoryBudget(static_cast<size_t>(_settings._undoMemoryBudget) * 1024 * 1024);
+    _viewport.GetHydraEngines().maxEngines = _settings._maxHydraEngines;
+    _viewport.GetHydraEngines().memoryBudget = _settings._hydraEnginesMemoryBudget;
 }
 
 void Editor::SaveSettings() const {
-    ResourcesLoader::GetEditorSettings() = _settings;
+    EditorSettings &settings = ResourcesLoader::GetEditorSettings();
+    settings = _settings;
+    // The limits can be changed in the viewport
+    settings._maxHydraEngines = _viewport.GetHydraEngines().maxEngines;
+    settings._hydraEnginesMemoryBudget = _viewport.GetHydraEngines().memoryBudget;
 }
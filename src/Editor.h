@@ -1,11 +1,17 @@
 #pragma once
 #include "EditorSettings.h"
+#include "PrimSearchIndex.h"
 #include "Selection.h"
+#include "StageLoader.h"
 #include "Viewport.h"
+#include <pxr/base/tf/weakBase.h>
 #include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/notice.h>
 #include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/usd/notice.h>
 #include <pxr/usd/usdUtils/stageCache.h>
 
+#include <atomic>
 #include <set>
 #include <future>
 
@@ -14,7 +20,7 @@ struct GLFWwindow;
 PXR_NAMESPACE_USING_DIRECTIVE
 
 /// Editor contains the data shared between widgets, like selections, stages, etc etc
-class Editor {
+class Editor : public TfWeakBase {
 
 public:
     Editor();
@@ -50,6 +56,9 @@ public:
 
     UsdStageCache &GetStageCache() { return _stageCache.Get(); }
 
+    /// Index of the prim names of the current stage, for the find commands
+    PrimSearchIndex &GetPrimSearchIndex() { return _primSearchIndex; }
+
     /// Returns the selected primspec
     /// There should be one selected primspec per layer ideally, so it's very likely this function will move
     Selection &GetSelection() { return _selection; }
@@ -63,11 +72,25 @@ public:
     void FindOrOpenLayer(const std::string &path);
     void CreateStage(const std::string &path);
     void OpenStage(const std::string &path, bool openLoaded = true);
+    void CancelOpenStage(const std::string &path);
     void SaveLayerAs(SdfLayerRefPtr layer, const std::string &path);
 
     /// Render the hydra viewport
     void HydraRender();
 
+    /// Redraw scheduling. In idle redraw mode the main loop waits for events and only draws the frames needed
+    bool IsIdleRedrawEnabled() const { return _settings._idleRedraw; }
+    int GetMaxFrameRate() const { return _settings._maxFrameRate; }
+
+    /// Draws the next frames, it can be called from any thread
+    void RequestRedraw();
+
+    /// True if the next frame must be drawn: redraw requested, playback, progressive rendering, background loading, etc
+    bool IsRedrawNeeded() const;
+
+    /// Called by the main loop after a frame is drawn
+    void OnFrameDrawn();
+
     ///
     /// Drawing functions for the main editor
     ///
@@ -111,6 +134,12 @@ public:
 
 
   private:
+    /// Moves the stages loaded in the background to the stage cache
+    void UpdateStageLoaders();
+
+    /// Draw the progress of the stages loading in the background
+    void DrawStageLoadersStatus();
+
     /// Interface with the settings
     void LoadSettings();
     void SaveSettings() const;
@@ -124,6 +153,13 @@ public:
     /// glfw resize callback
     static void WindowSizeCallback(GLFWwindow *window, int width, int height);
 
+    /// glfw callback when the window content must be redrawn
+    static void WindowRefreshCallback(GLFWwindow *window);
+
+    /// The layers and stages edited outside of the ui must be redrawn
+    void OnLayersDidChange(const SdfNotice::LayersDidChange &notice);
+    void OnStageContentsChanged(const UsdNotice::StageContentsChanged &notice);
+
     /// Using a stage cache to store the stages, seems to work well
     UsdUtilsStageCache _stageCache;
 
@@ -140,6 +176,7 @@ public:
     EditorSettings _settings;
 
     UsdStageRefPtr _currentStage;
+    PrimSearchIndex _primSearchIndex;
     Viewport _viewport;
 
     /// Selection for stages and layers
@@ -148,7 +185,15 @@ public:
     /// Selected attribute, for showing in the spreadsheet or metadata
     SdfPath _selectedAttribute;
     
+    /// Stages being opened in the background
+    std::vector<std::unique_ptr<StageLoader>> _stageLoaders;
+
     /// Storing the tasks created by launchers.
     std::vector<std::future<int>> _launcherTasks;
 
+    /// Number of frames still to draw in idle redraw mode
+    std::atomic<int> _redrawFrames{0};
+    TfNotice::Key _layersDidChangeKey;
+    TfNotice::Key _stageContentsChangedKey;
+
 };
@@ -77,6 +77,24 @@ void EditorSettings::ParseLine(const char *line) {
         if (value > 0) {
             _mainWindowHeight = value;
         }
+    } else if (sscanf(line, "IdleRedraw=%i", &value) == 1) {
+        _idleRedraw = static_cast<bool>(value);
+    } else if (sscanf(line, "MaxFrameRate=%i", &value) == 1) {
+        if (value >= 0) {
+            _maxFrameRate = value;
+        }
+    } else if (sscanf(line, "UndoMemoryBudget=%i", &value) == 1) {
+        if (value >= 0) {
+            _undoMemoryBudget = value;
+        }
+    } else if (sscanf(line, "MaxHydraEngines=%i", &value) == 1) {
+        if (value >= 0) {
+            _maxHydraEngines = value;
+        }
+    } else if (sscanf(line, "HydraEnginesMemoryBudget=%i", &value) == 1) {
+        if (value >= 0) {
+            _hydraEnginesMemoryBudget = value;
+        }
     } else if (strlen(line) > 9 && std::equal(line, line + 9, "Launcher=")) {
         std::string launcher(line + 9);
         auto semiColonPos = std::find(launcher.begin(), launcher.end(), ';');
@@ -117,6 +135,11 @@ void EditorSettings::Dump(ImGuiTextBuffer *buf) {
     if (_mainWindowHeight > 0) {
         buf->appendf("MainWindowHeight=%d\n", _mainWindowHeight);
     }
+    buf->appendf("IdleRedraw=%d\n", _idleRedraw);
+    buf->appendf("MaxFrameRate=%d\n", _maxFrameRate);
+    buf->appendf("UndoMemoryBudget=%d\n", _undoMemoryBudget);
+    buf->appendf("MaxHydraEngines=%d\n", _maxHydraEngines);
+    buf->appendf("HydraEnginesMemoryBudget=%d\n", _hydraEnginesMemoryBudget);
     for (int i = 0; i < _launcherNames.size(); ++i) {
         buf->appendf("Launcher=%s;%s\n", _launcherNames[i].c_str(), _launcherCommandLines[i].c_str());
     }
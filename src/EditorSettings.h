@@ -28,6 +28,18 @@ struct EditorSettings {
     int _mainWindowWidth;
     int _mainWindowHeight;
 
+    /// The main loop waits for events and only redraws when something changed
+    bool _idleRedraw = true;
+    /// Frame rate limit, 0 means unlimited
+    int _maxFrameRate = 0;
+
+    /// Memory budget of the undo stack in megabytes, 0 means unlimited
+    int _undoMemoryBudget = 2048;
+
+    /// Limits of the hydra engines kept for the stages not displayed in the viewport, 0 means unlimited
+    int _maxHydraEngines = 4;
+    int _hydraEnginesMemoryBudget = 4096; // megabytes
+
     /// Last file browser directory
     std::string _lastFileBrowserDirectory;
 
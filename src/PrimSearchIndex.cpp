@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <unordered_map>
+#include <pxr/usd/usd/modelAPI.h>
+#include <pxr/usd/usd/primRange.h>
+#include "PrimSearchIndex.h"
+#include "WildcardsCompare.h"
+
+// Number of prims read by the background thread each time it takes the stage lock
+static constexpr size_t BuildChunkSize = 4096;
+
+// The find traverses the instance proxies like the stage outliner
+static Usd_PrimFlagsPredicate GetIndexPredicate() { return UsdTraverseInstanceProxies(UsdPrimAllPrimsPredicate); }
+
+struct PrimSearchIndex::Index {
+    struct PrimInfo {
+        TfToken name;
+        TfToken typeName;
+        TfToken kind;
+    };
+
+    static PrimInfo GetPrimInfo(const UsdPrim &prim) {
+        TfToken kind;
+        UsdModelAPI(prim).GetKind(&kind);
+        return {prim.GetName(), prim.GetTypeName(), kind};
+    }
+
+    // Names are indexed by their trigrams to find the candidates of a wildcard pattern without testing all the names
+    static uint32_t GetTrigram(const char *str) {
+        return (static_cast<uint32_t>(static_cast<unsigned char>(str[0])) << 16) |
+               (static_cast<uint32_t>(static_cast<unsigned char>(str[1])) << 8) |
+               static_cast<uint32_t>(static_cast<unsigned char>(str[2]));
+    }
+
+    // Called once per name, when it is seen for the first time
+    void AddName(const TfToken &name) {
+        const std::string &str = name.GetString();
+        for (size_t i = 0; i + 3 <= str.size(); ++i) {
+            auto &names = namesByTrigram[GetTrigram(str.c_str() + i)];
+            // The same trigram can appear multiple times in the name
+            if (names.empty() || names.back() != name) {
+                names.push_back(name);
+            }
+        }
+    }
+
+    // Builds the index from the prims in traversal order
+    void Build(std::vector<std::pair<SdfPath, PrimInfo>> &traversed) {
+        std::sort(traversed.begin(), traversed.end(),
+                  [](const std::pair<SdfPath, PrimInfo> &a, const std::pair<SdfPath, PrimInfo> &b) { return a.first < b.first; });
+        for (auto &entry : traversed) {
+            auto &paths = pathsByName[entry.second.name];
+            if (paths.empty()) {
+                AddName(entry.second.name);
+            }
+            paths.push_back(entry.first); // Already sorted
+            prims.emplace_hint(prims.end(), entry.first, std::move(entry.second));
+        }
+    }
+
+    void Insert(const SdfPath &path, PrimInfo info) {
+        auto found = pathsByName.find(info.name);
+        if (found == pathsByName.end()) {
+            AddName(info.name);
+            found = pathsByName.emplace(info.name, SdfPathVector()).first;
+        }
+        SdfPathVector &paths = found->second;
+        paths.insert(std::upper_bound(paths.begin(), paths.end(), path), path);
+        prims[path] = std::move(info);
+    }
+
+    void RemoveSubtree(const SdfPath &root) {
+        // The descendants of a path follow it in path order
+        auto it = prims.lower_bound(root);
+        while (it != prims.end() && it->first.HasPrefix(root)) {
+            auto &paths = pathsByName[it->second.name];
+            const auto found = std::lower_bound(paths.begin(), paths.end(), it->first);
+            if (found != paths.end() && *found == it->first) {
+                paths.erase(found);
+            }
+            it = prims.erase(it);
+        }
+        // The names without prims are kept, they are skipped by the queries
+    }
+
+    bool PassesFilters(const SdfPath &path, const PrimSearchQuery &query) const {
+        if (query.typeName.IsEmpty() && query.kind.IsEmpty()) {
+            return true;
+        }
+        const auto found = prims.find(path);
+        return found != prims.end() && (query.typeName.IsEmpty() || found->second.typeName == query.typeName) &&
+               (query.kind.IsEmpty() || found->second.kind == query.kind);
+    }
+
+    // Returns the path lists of the names matching the query pattern
+    std::vector<const SdfPathVector *> FindMatchingNames(const PrimSearchQuery &query) const {
+        std::vector<const SdfPathVector *> matching;
+        if (query.pattern.empty()) {
+            return matching;
+        }
+        if (!query.useWildcards) {
+            const auto found = pathsByName.find(TfToken::Find(query.pattern));
+            if (found != pathsByName.end() && !found->second.empty()) {
+                matching.push_back(&found->second);
+            }
+            return matching;
+        }
+        // Candidates are the names containing the least frequent trigram of the pattern literals
+        const std::vector<TfToken> *candidates = nullptr;
+        size_t literalStart = 0;
+        for (size_t i = 0; i <= query.pattern.size(); ++i) {
+            if (i < query.pattern.size() && query.pattern[i] != '*' && query.pattern[i] != '?') {
+                continue;
+            }
+            for (size_t j = literalStart; j + 3 <= i; ++j) {
+                const auto found = namesByTrigram.find(GetTrigram(query.pattern.c_str() + j));
+                if (found == namesByTrigram.end()) {
+                    return matching; // No name contains this part of the pattern
+                }
+                if (!candidates || found->second.size() < candidates->size()) {
+                    candidates = &found->second;
+                }
+            }
+            literalStart = i + 1;
+        }
+        const auto addIfMatching = [&](const TfToken &name, const SdfPathVector &paths) {
+            if (!paths.empty() && FastWildComparePortable(query.pattern.c_str(), name.GetText())) {
+                matching.push_back(&paths);
+            }
+        };
+        if (candidates) {
+            for (const auto &name : *candidates) {
+                const auto found = pathsByName.find(name);
+                if (found != pathsByName.end()) {
+                    addIfMatching(name, found->second);
+                }
+            }
+        } else {
+            // The pattern has no literal long enough, all the names are tested
+            for (const auto &entry : pathsByName) {
+                addIfMatching(entry.first, entry.second);
+            }
+        }
+        return matching;
+    }
+
+    std::map<SdfPath, PrimInfo> prims;
+    std::unordered_map<TfToken, SdfPathVector, TfToken::HashFunctor> pathsByName; // The paths are sorted
+    std::unordered_map<uint32_t, std::vector<TfToken>> namesByTrigram;
+};
+
+PrimSearchIndex::PrimSearchIndex() {}
+
+PrimSearchIndex::~PrimSearchIndex() {
+    TfNotice::Revoke(_objectsChangedKey);
+    StopBuild();
+}
+
+void PrimSearchIndex::SetStage(UsdStageRefPtr stage) {
+    if (_stage == stage) {
+        return;
+    }
+    TfNotice::Revoke(_objectsChangedKey);
+    StopBuild();
+    _stage = stage;
+    _index.reset();
+    _resyncedPaths.clear();
+    _changedInfoPaths.clear();
+    _mustRebuild = false;
+    if (_stage) {
+        _objectsChangedKey = TfNotice::Register(TfCreateWeakPtr(this), &PrimSearchIndex::OnObjectsChanged, UsdStageWeakPtr(_stage));
+        StartBuild();
+    }
+}
+
+void PrimSearchIndex::OnObjectsChanged(const UsdNotice::ObjectsChanged &notice) {
+    bool hasResynced = false;
+    for (const auto &path : notice.GetResyncedPaths()) {
+        const SdfPath primPath = path.GetPrimPath();
+        // The instance proxies of a prototype are spread on the stage, it is simpler to index everything again
+        if (primPath.IsEmpty() || primPath.IsAbsoluteRootPath() || UsdPrim::IsPathInPrototype(primPath)) {
+            _mustRebuild = true;
+        } else {
+            _resyncedPaths.emplace_back(_resyncCount + 1, primPath);
+        }
+        hasResynced = true;
+    }
+    if (hasResynced) {
+        _resyncCount++;
+    }
+    // The kind is metadata, its change is not a resync
+    for (const auto &path : notice.GetChangedInfoOnlyPaths()) {
+        if (path.IsPrimPath()) {
+            _changedInfoPaths.push_back(path);
+        }
+    }
+}
+
+void PrimSearchIndex::StartBuild() {
+    StopBuild();
+    _buildFinished = false;
+    _buildThread = std::thread(&PrimSearchIndex::Build, this, _stage);
+}
+
+void PrimSearchIndex::StopBuild() {
+    if (_buildThread.joinable()) {
+        _cancelled = true;
+        _buildThread.join();
+        _cancelled = false;
+    }
+    _builtIndex.reset();
+}
+
+// Runs on the background thread
+void PrimSearchIndex::Build(UsdStageRefPtr stage) {
+    std::vector<std::pair<SdfPath, Index::PrimInfo>> traversed;
+    UsdPrimRange range;
+    UsdPrimRange::iterator it;
+    size_t resyncCount = 0;
+    bool mustRestart = true;
+    while (true) {
+        // Try locking to give up quickly when cancelled, the ui thread might hold the lock while waiting for this thread
+        std::unique_lock<std::mutex> lock(_stageMutex, std::defer_lock);
+        while (!lock.try_lock()) {
+            if (_cancelled) {
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (_cancelled) {
+            return;
+        }
+        // The iterator is invalid after a resync, start again
+        if (mustRestart || resyncCount != _resyncCount) {
+            resyncCount = _resyncCount;
+            traversed.clear();
+            range = UsdPrimRange::Stage(stage, GetIndexPredicate());
+            it = range.begin();
+            mustRestart = false;
+        }
+        for (size_t i = 0; i < BuildChunkSize && it != range.end(); ++i, ++it) {
+            traversed.emplace_back(it->GetPath(), Index::GetPrimInfo(*it));
+        }
+        if (it == range.end()) {
+            break;
+        }
+        lock.unlock();
+        std::this_thread::yield();
+    }
+    // The index is built without reading the stage
+    std::unique_ptr<Index> index(new Index());
+    index->Build(traversed);
+    _builtIndex = std::move(index);
+    _builtResyncCount = resyncCount;
+    _buildFinished = true;
+}
+
+void PrimSearchIndex::Update() {
+    if (!_stage) {
+        return;
+    }
+    if (_buildFinished) {
+        _buildThread.join();
+        _buildFinished = false;
+        _index = std::move(_builtIndex);
+        // The built index already has the changes made before its traversal started
+        const size_t builtResyncCount = _builtResyncCount;
+        _resyncedPaths.erase(std::remove_if(_resyncedPaths.begin(), _resyncedPaths.end(),
+                                            [&](const std::pair<size_t, SdfPath> &resync) {
+                                                return resync.first <= builtResyncCount;
+                                            }),
+                             _resyncedPaths.end());
+    }
+    if (_mustRebuild) {
+        _mustRebuild = false;
+        _resyncedPaths.clear();
+        _changedInfoPaths.clear();
+        StartBuild(); // The current index is used until the new one is built
+        return;
+    }
+    if (!_index || _buildThread.joinable()) {
+        return; // The changes are applied when the build is finished
+    }
+    if (!_resyncedPaths.empty()) {
+        SdfPathVector paths;
+        for (const auto &resync : _resyncedPaths) {
+            paths.push_back(resync.second);
+        }
+        SdfPath::RemoveDescendentPaths(&paths);
+        for (const auto &path : paths) {
+            _index->RemoveSubtree(path);
+            const UsdPrim prim = _stage->GetPrimAtPath(path);
+            if (prim) {
+                for (const auto &descendant : UsdPrimRange(prim, GetIndexPredicate())) {
+                    _index->Insert(descendant.GetPath(), Index::GetPrimInfo(descendant));
+                }
+            }
+        }
+        _resyncedPaths.clear();
+    }
+    for (const auto &path : _changedInfoPaths) {
+        const auto found = _index->prims.find(path);
+        if (found != _index->prims.end()) {
+            if (const UsdPrim prim = _stage->GetPrimAtPath(path)) {
+                found->second = Index::GetPrimInfo(prim);
+            }
+        }
+    }
+    _changedInfoPaths.clear();
+}
+
+size_t PrimSearchIndex::GetPrimCount() const { return _index ? _index->prims.size() : 0; }
+
+SdfPath PrimSearchIndex::FindNext(const PrimSearchQuery &query, const SdfPath &path) const {
+    if (!_index) {
+        return {};
+    }
+    SdfPath next;
+    SdfPath first;
+    for (const SdfPathVector *paths : _index->FindMatchingNames(query)) {
+        auto it = path.IsEmpty() ? paths->begin() : std::upper_bound(paths->begin(), paths->end(), path);
+        for (; it != paths->end() && (next.IsEmpty() || *it < next); ++it) {
+            if (_index->PassesFilters(*it, query)) {
+                next = *it;
+                break;
+            }
+        }
+        for (it = paths->begin(); it != paths->end() && (first.IsEmpty() || *it < first); ++it) {
+            if (_index->PassesFilters(*it, query)) {
+                first = *it;
+                break;
+            }
+        }
+    }
+    return next.IsEmpty() ? first : next;
+}
+
+SdfPathVector PrimSearchIndex::FindAll(const PrimSearchQuery &query) const {
+    SdfPathVector found;
+    if (!_index) {
+        return found;
+    }
+    for (const SdfPathVector *paths : _index->FindMatchingNames(query)) {
+        for (const auto &path : *paths) {
+            if (_index->PassesFilters(path, query)) {
+                found.push_back(path);
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+}
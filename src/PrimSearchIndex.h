@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/usd/notice.h>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+struct PrimSearchQuery {
+    std::string pattern;       // Name of the prims, or pattern with the * and ? wildcards
+    bool useWildcards = false;
+    TfToken typeName;          // When not empty, only the prims of this type are found
+    TfToken kind;              // When not empty, only the prims of this kind are found
+};
+
+///
+/// Index of the prim names of a stage, the prims are found without traversing the stage.
+/// The index is built on a background thread and kept up to date with the ObjectsChanged notices. The background
+/// thread reads the stage by small chunks and the stage must not be edited without holding the lock returned by
+/// LockStage. The prims are found in path order, so "find next" can continue after the selected prim.
+///
+class PrimSearchIndex : public TfWeakBase {
+  public:
+    PrimSearchIndex();
+    ~PrimSearchIndex();
+
+    PrimSearchIndex(const PrimSearchIndex &) = delete;
+    PrimSearchIndex &operator=(const PrimSearchIndex &) = delete;
+
+    /// Starts indexing the stage in the background
+    void SetStage(UsdStageRefPtr stage);
+
+    /// The background thread doesn't read the stage while the lock is held
+    std::unique_lock<std::mutex> LockStage() { return std::unique_lock<std::mutex>(_stageMutex); }
+
+    /// Shared with the other background readers of the stage
+    std::mutex &GetStageMutex() { return _stageMutex; }
+
+    /// Takes the index built in the background and applies the changes of the stage, called on the ui thread
+    void Update();
+
+    /// The queries return nothing until the first index is built
+    bool IsReady() const { return _index != nullptr; }
+    size_t GetPrimCount() const;
+
+    /// First prim matching the query after path, in path order. It starts again from the beginning when there is no
+    /// match after path
+    SdfPath FindNext(const PrimSearchQuery &query, const SdfPath &path) const;
+
+    /// All the prims matching the query, in path order
+    SdfPathVector FindAll(const PrimSearchQuery &query) const;
+
+  private:
+    struct Index;
+
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice);
+    void StartBuild();
+    void StopBuild();
+    void Build(UsdStageRefPtr stage);
+
+    UsdStageRefPtr _stage;
+    TfNotice::Key _objectsChangedKey;
+    std::unique_ptr<Index> _index;
+
+    // Changes of the stage not applied yet, with the resync count when they happened
+    std::vector<std::pair<size_t, SdfPath>> _resyncedPaths;
+    SdfPathVector _changedInfoPaths;
+    bool _mustRebuild = false;
+
+    // Background build
+    std::mutex _stageMutex;
+    std::thread _buildThread;
+    std::atomic<bool> _cancelled{false};
+    std::atomic<bool> _buildFinished{false};
+    std::atomic<size_t> _resyncCount{0}; // The build restarts when the stage is resynced while it reads it
+    std::unique_ptr<Index> _builtIndex;
+    size_t _builtResyncCount = 0;
+};
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include "Profiler.h"
+
+static int64_t GetSteadyClockTime() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Nesting level of the timers running on the thread
+static thread_local uint32_t timerDepth = 0;
+
+Profiler &Profiler::GetInstance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler() : _slots(new Slot[Capacity]), _origin(GetSteadyClockTime()) {}
+
+int64_t Profiler::GetTime() const { return GetSteadyClockTime() - _origin; }
+
+uint32_t Profiler::GetThreadId() {
+    static std::atomic<uint32_t> threadCount{0};
+    static thread_local const uint32_t threadId = threadCount++;
+    return threadId;
+}
+
+void Profiler::Record(const char *name, int64_t start, int64_t end, uint32_t depth) {
+    const uint64_t index = _writeIndex.fetch_add(1, std::memory_order_relaxed);
+    Slot &slot = _slots[index % Capacity];
+    // The readers skip the slot until the event is entirely written
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = ProfilerEvent{name, start, end, _frame.load(std::memory_order_relaxed), depth, GetThreadId()};
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+std::vector<ProfilerEvent> Profiler::GetEvents() const {
+    uint64_t nextIndex = 0;
+    return GetEvents(nextIndex);
+}
+
+std::vector<ProfilerEvent> Profiler::GetEvents(uint64_t &nextIndex) const {
+    std::vector<ProfilerEvent> events;
+    const uint64_t end = _writeIndex.load(std::memory_order_acquire);
+    const uint64_t begin = std::max(nextIndex, end > Capacity ? end - Capacity : 0);
+    nextIndex = end;
+    events.reserve(end - begin);
+    for (uint64_t index = begin; index < end; ++index) {
+        const Slot &slot = _slots[index % Capacity];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1) {
+            continue; // Not written yet or already overwritten
+        }
+        const ProfilerEvent event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == index + 1) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+static void WriteJsonString(std::ostream &out, const char *str) {
+    out << '"';
+    for (const char *c = str; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            out << '\\';
+        }
+        out << *c;
+    }
+    out << '"';
+}
+
+bool Profiler::WriteChromeTrace(const std::string &fileName) const {
+    std::ofstream out(fileName);
+    if (!out) {
+        return false;
+    }
+    // Complete events, the timestamps are in microseconds with a fixed precision, the default notation keeps only
+    // 6 significant digits
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto &event : GetEvents()) {
+        out << (first ? "" : ",\n") << "{\"name\":";
+        WriteJsonString(out, event.name);
+        out << ",\"cat\":\"usdtweak\",\"ph\":\"X\",\"ts\":" << static_cast<double>(event.start) / 1000.0
+            << ",\"dur\":" << static_cast<double>(event.end - event.start) / 1000.0 << ",\"pid\":1,\"tid\":" << event.threadId
+            << ",\"args\":{\"frame\":" << event.frame << "}}";
+        first = false;
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+ScopedTimer::ScopedTimer(const char *name) : _name(nullptr), _start(0), _depth(0) {
+    Profiler &profiler = Profiler::GetInstance();
+    if (profiler.IsEnabled()) {
+        _name = name;
+        _depth = timerDepth++;
+        _start = profiler.GetTime();
+    }
+}
+
+ScopedTimer::~ScopedTimer() {
+    if (_name) {
+        Profiler &profiler = Profiler::GetInstance();
+        profiler.Record(_name, _start, profiler.GetTime(), _depth);
+        timerDepth--;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <pxr/base/trace/trace.h>
+
+///
+/// Frame profiler. The scoped timers measure the time spent in the main sections of a frame: the widgets, the hydra
+/// render and the execution of the commands. The timings are stored in a fixed size ring buffer without locking, so
+/// the timers can be used on any thread. They are displayed in the debug window and can be exported as a chrome trace.
+///
+
+struct ProfilerEvent {
+    const char *name;  // A string literal, the events don't own their names
+    int64_t start;     // Nanoseconds since the profiler was created
+    int64_t end;
+    uint64_t frame;    // Frame when the event was recorded
+    uint32_t depth;    // Nesting level of the timer in its thread
+    uint32_t threadId; // Small integer identifying the thread, the first one is 0
+};
+
+class Profiler {
+  public:
+    static Profiler &GetInstance();
+
+    /// Number of events kept in the ring buffer, the oldest are overwritten
+    static constexpr size_t Capacity = 1 << 16;
+
+    bool IsEnabled() const { return _enabled.load(std::memory_order_relaxed); }
+    void SetEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+
+    /// Called by the main loop at the beginning of a frame
+    void BeginFrame() { _frame.fetch_add(1, std::memory_order_relaxed); }
+    uint64_t GetCurrentFrame() const { return _frame.load(std::memory_order_relaxed); }
+
+    int64_t GetTime() const;
+    static uint32_t GetThreadId();
+
+    void Record(const char *name, int64_t start, int64_t end, uint32_t depth);
+
+    /// Copy of the events in the buffer, in the order they finished
+    std::vector<ProfilerEvent> GetEvents() const;
+
+    /// Events finished since the previous call, nextIndex is the index of the first event to read and is updated.
+    /// The events overwritten or still being written at the time of the call are skipped
+    std::vector<ProfilerEvent> GetEvents(uint64_t &nextIndex) const;
+
+    /// Writes the events in the chrome trace event format, it can be opened in chrome://tracing or perfetto
+    bool WriteChromeTrace(const std::string &fileName) const;
+
+  private:
+    Profiler();
+
+    // The sequence is the index of the event + 1 once it is written, and 0 while it is being written
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        ProfilerEvent event;
+    };
+    std::unique_ptr<Slot[]> _slots;
+    std::atomic<uint64_t> _writeIndex{0};
+    std::atomic<uint64_t> _frame{0};
+    std::atomic<bool> _enabled{true};
+    const int64_t _origin;
+};
+
+/// Records the time spent between its construction and its destruction
+class ScopedTimer {
+  public:
+    explicit ScopedTimer(const char *name);
+    ~ScopedTimer();
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  private:
+    const char *_name;
+    int64_t _start;
+    uint32_t _depth;
+};
+
+/// Times the scope with the profiler and with the usd trace collector. The name must be a string literal
+#define PROFILE_SCOPE(name)                                                                                            \
+    TRACE_SCOPE(name);                                                                                                 \
+    _PROFILE_SCOPE_INSTANCE(__LINE__, name)
+#define _PROFILE_SCOPE_INSTANCE(line, name) _PROFILE_SCOPE_IMPL(line, name)
+#define _PROFILE_SCOPE_IMPL(line, name) ScopedTimer profileScope_##line(name)
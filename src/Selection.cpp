@@ -1,40 +1,81 @@
 #include "Selection.h"
+#include <algorithm>
 #include <functional>
+#include <unordered_map>
+#include <unordered_set>
 #include <pxr/usd/sdf/attributeSpec.h>
 #include <pxr/usd/sdf/layer.h>
 #include <pxr/usd/usd/stage.h>
 
 #include <iostream>
 
-/// At the moment we use a HdSelection for the stages but this will change as the we want to store additional states
-/// The selection implementation will move outside this header
-#include <pxr/imaging/hd/selection.h>
-
-/// Note the following bit of code might have terrible performances when selecting thousands of paths
-/// This has to be tested at some point
 namespace std {
-template <> struct hash<SdfPathVector> {
-    std::size_t operator()(SdfPathVector const &paths) const noexcept {
-        std::size_t hashValue = 0;
-        for (const auto p : paths) {
-            const auto pathHash = SdfPath::Hash{}(p);
-            hashValue = pathHash ^ (hashValue << 1);
-        }
-        return hashValue;
-    }
-};
-
 template <> struct hash<SdfSpecHandle> {
     std::size_t operator()(SdfSpecHandle const &spec) const noexcept { return hash_value(spec); }
 };
 
 } // namespace std
 
-struct StageSelection : public std::unique_ptr<HdSelection> {
-    // We store a state to know if the selection has changed between frames. Recomputing the hash is not ideal and potentially
-    // a performance killer, so it will likely change in the future
-    SelectionHash selectionHash = 0;
-    bool mustRecomputeHash = true;
+/// Selected paths of a stage, in selection order, the first one being the anchor.
+/// The generation is incremented at each change, including a change of order, so the widgets can know if the
+/// selection has changed without iterating on the paths.
+/// The erased paths are left as empty paths in the vector and removed all at once when the paths are read.
+class StageSelection {
+  public:
+    bool Insert(const SdfPath &path) {
+        if (!_pathIndices.emplace(path, _paths.size()).second) {
+            return false;
+        }
+        _paths.push_back(path);
+        ++_generation;
+        return true;
+    }
+
+    bool Erase(const SdfPath &path) {
+        const auto it = _pathIndices.find(path);
+        if (it == _pathIndices.end()) {
+            return false;
+        }
+        _paths[it->second] = SdfPath();
+        _pathIndices.erase(it);
+        ++_erasedCount;
+        ++_generation;
+        return true;
+    }
+
+    void Clear() {
+        if (!_pathIndices.empty()) {
+            _pathIndices.clear();
+            _paths.clear();
+            _erasedCount = 0;
+            ++_generation;
+        }
+    }
+
+    bool Contains(const SdfPath &path) const { return _pathIndices.find(path) != _pathIndices.end(); }
+    bool IsEmpty() const { return _pathIndices.empty(); }
+    const SdfPathVector &GetPaths() const {
+        if (_erasedCount) {
+            Compact();
+        }
+        return _paths;
+    }
+    size_t GetGeneration() const { return _generation; }
+
+  private:
+    void Compact() const {
+        _paths.erase(std::remove(_paths.begin(), _paths.end(), SdfPath()), _paths.end());
+        for (size_t i = 0; i < _paths.size(); ++i) {
+            _pathIndices[_paths[i]] = i;
+        }
+        _erasedCount = 0;
+    }
+
+    // Compacted when read
+    mutable std::unordered_map<SdfPath, size_t, SdfPath::Hash> _pathIndices;
+    mutable SdfPathVector _paths;
+    mutable size_t _erasedCount = 0;
+    size_t _generation = 0;
 };
 
 struct Selection::SelectionData {
@@ -46,7 +87,6 @@ struct Selection::SelectionData {
     std::unordered_set<SdfSpecHandle> _sdfPropSelectionDomain;
 
     // Selection data for the stages
-    // TODO: keep an anchor, basically the first selected prim, we would need a list to keep the order
     StageSelection _stageSelection;
 };
 
@@ -63,8 +103,7 @@ template <> void Selection::Clear(const SdfLayerRefPtr &layer) {
 template <> void Selection::Clear(const UsdStageRefPtr &stage) {
     if (!_data || !stage)
         return;
-    _data->_stageSelection.reset(new HdSelection());
-    _data->_stageSelection.mustRecomputeHash = true;
+    _data->_stageSelection.Clear();
 }
 
 // Layer add a selection
@@ -82,20 +121,16 @@ template <> void Selection::AddSelected(const SdfLayerRefPtr &layer, const SdfPa
     template <> void Selection::AddSelected(const StageT &stage, const SdfPath &selectedPath) {                                  \
         if (!_data || !stage)                                                                                                    \
             return;                                                                                                              \
-        if (!_data->_stageSelection) {                                                                                           \
-            _data->_stageSelection.reset(new HdSelection());                                                                     \
-        }                                                                                                                        \
-        _data->_stageSelection->AddRprim(HdSelection::HighlightModeSelect, selectedPath);                                        \
-        _data->_stageSelection.mustRecomputeHash = true;                                                                         \
+        _data->_stageSelection.Insert(selectedPath);                                                                             \
     }
 
 ImplementStageAddSelected(UsdStageRefPtr);
 ImplementStageAddSelected(UsdStageWeakPtr);
 
-// Not called at the moment
 template <> void Selection::RemoveSelected(const UsdStageWeakPtr &stage, const SdfPath &path) {
     if (!_data || !stage)
         return;
+    _data->_stageSelection.Erase(path);
 }
 
 #define ImplementLayerSetSelected(LayerT)                                                                                        \
@@ -119,9 +154,8 @@ ImplementLayerSetSelected(SdfLayerHandle);
     template <> void Selection::SetSelected(const StageT &stage, const SdfPath &selectedPath) {                                  \
         if (!_data || !stage)                                                                                                    \
             return;                                                                                                              \
-        _data->_stageSelection.reset(new HdSelection());                                                                         \
-        _data->_stageSelection->AddRprim(HdSelection::HighlightModeSelect, selectedPath);                                        \
-        _data->_stageSelection.mustRecomputeHash = true;                                                                         \
+        _data->_stageSelection.Clear();                                                                                          \
+        _data->_stageSelection.Insert(selectedPath);                                                                             \
     }
 
 ImplementStageSetSelected(UsdStageRefPtr);
@@ -141,7 +175,7 @@ ImplementLayerIsSelectionEmpty(SdfLayerRefPtr);
     template <> bool Selection::IsSelectionEmpty(const StageT &stage) const {                                                    \
         if (!_data || !stage)                                                                                                    \
             return true;                                                                                                         \
-        return !_data->_stageSelection || _data->_stageSelection->IsEmpty();                                                     \
+        return _data->_stageSelection.IsEmpty();                                                                                 \
     }
 
 ImplementStageIsSelectionEmpty(UsdStageRefPtr);
@@ -162,25 +196,17 @@ template <> bool Selection::IsSelected(const SdfAttributeSpecHandle &spec) const
 template <> bool Selection::IsSelected(const UsdStageWeakPtr &stage, const SdfPath &selectedPath) const {
     if (!_data || !stage)
         return false;
-    if (_data->_stageSelection) {
-        if (_data->_stageSelection->GetPrimSelectionState(HdSelection::HighlightModeSelect, selectedPath)) {
-            return true;
-        }
-    }
-    return false;
+    return _data->_stageSelection.Contains(selectedPath);
 }
 
 template <> bool Selection::UpdateSelectionHash(const UsdStageRefPtr &stage, SelectionHash &lastSelectionHash) {
     if (!_data || !stage)
         return false;
 
-    if (_data->_stageSelection && _data->_stageSelection.mustRecomputeHash) {
-        auto paths = _data->_stageSelection->GetAllSelectedPrimPaths();
-        _data->_stageSelection.selectionHash = std::hash<SdfPathVector>{}(paths);
-    }
-
-    if (_data->_stageSelection.selectionHash != lastSelectionHash) {
-        lastSelectionHash = _data->_stageSelection.selectionHash;
+    // The generation is used as the hash, it changes when the paths or their order change
+    const SelectionHash selectionHash = _data->_stageSelection.GetGeneration();
+    if (selectionHash != lastSelectionHash) {
+        lastSelectionHash = selectionHash;
         return true;
     }
     return false;
@@ -222,13 +248,8 @@ ImplementGetAnchorPropertyPath(SdfLayerRefPtr);
 template <> SdfPath Selection::GetAnchorPrimPath(const UsdStageRefPtr &stage) const {
     if (!_data || !stage)
         return {};
-    if (_data->_stageSelection) {
-        const auto &paths = _data->_stageSelection->GetSelectedPrimPaths(HdSelection::HighlightModeSelect);
-        if (!paths.empty()) {
-            return paths[0];
-        }
-    }
-    return {};
+    const auto &paths = _data->_stageSelection.GetPaths();
+    return paths.empty() ? SdfPath() : paths.front();
 }
 
 // This is called only once when there is a drag and drop at the moment
@@ -246,8 +267,5 @@ template <> std::vector<SdfPath> Selection::GetSelectedPaths(const SdfLayerHandl
 template <> std::vector<SdfPath> Selection::GetSelectedPaths(const UsdStageRefPtr &stage) const {
     if (!_data || !stage)
         return {};
-    if (_data->_stageSelection) {
-        return _data->_stageSelection->GetAllSelectedPrimPaths();
-    }
-    return {};
+    return _data->_stageSelection.GetPaths();
 }
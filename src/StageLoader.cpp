@@ -0,0 +1,161 @@
+#include "StageLoader.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <unordered_set>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/layerUtils.h>
+#include <pxr/usd/usd/stageLoadRules.h>
+
+// Number of payloads loaded in one call to LoadAndUnload. Each call recomposes the stage, so a batch
+// shouldn't be too small, but it is also the granularity of the progress report and the cancellation.
+static constexpr size_t PayloadBatchSize = 64;
+
+StageLoader::StageLoader(const std::string &path, bool openLoaded, std::mutex *stageMutex)
+    : _path(path), _openLoaded(openLoaded), _stageMutex(stageMutex), _cancelled(false), _phase("Waiting"), _layersResolved(0), _payloadsLoaded(0),
+      _payloadsToLoad(0) {
+    _task = std::async(std::launch::async, &StageLoader::Load, this);
+}
+
+StageLoader::~StageLoader() {
+    // The future returned by std::async waits for the thread to finish, we don't want to wait for all the payloads
+    Cancel();
+    if (_task.valid()) {
+        _task.wait();
+    }
+}
+
+bool StageLoader::IsFinished() const {
+    return _task.valid() && _task.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+UsdStageRefPtr StageLoader::GetStage() { return _task.valid() ? _task.get() : UsdStageRefPtr(); }
+
+void StageLoader::SetPhase(const char *phase) {
+    std::lock_guard<std::mutex> lock(_phaseMutex);
+    _phase = phase;
+}
+
+std::string StageLoader::GetProgressText() const {
+    std::string progress;
+    {
+        std::lock_guard<std::mutex> lock(_phaseMutex);
+        progress = _phase;
+    }
+    progress += " - " + std::to_string(_layersResolved) + " layers";
+    if (_payloadsToLoad) {
+        progress += ", " + std::to_string(_payloadsLoaded) + "/" + std::to_string(_payloadsToLoad) + " payloads";
+    }
+    return progress;
+}
+
+float StageLoader::GetProgress() const {
+    const size_t payloadsToLoad = _payloadsToLoad;
+    return payloadsToLoad ? static_cast<float>(_payloadsLoaded) / static_cast<float>(payloadsToLoad) : 0.f;
+}
+
+// Opens the root layer and the layers it depends on, the composition finds them already opened. Returns true if one
+// of them was opened before, by a stage of the editor, the layers opened by the loader are only read by this thread.
+// The dependencies are the asset paths authored in the layers, the ones selected by an expression or depending on
+// the resolver context of the stage are found by the composition.
+bool StageLoader::OpenLayers(SdfLayerRefPtrVector &openedLayers) {
+    bool sharesLayers = false;
+    std::unordered_set<std::string> visited = {_path};
+    std::vector<std::string> toOpen = {_path};
+    while (!toOpen.empty() && !_cancelled) {
+        const std::string identifier = toOpen.back();
+        toOpen.pop_back();
+        SdfLayerRefPtr layer = SdfLayer::Find(identifier);
+        if (layer) {
+            sharesLayers = true;
+            continue; // Its dependencies are opened as well
+        }
+        layer = SdfLayer::FindOrOpen(identifier);
+        if (!layer) {
+            continue; // The composition reports the missing layers
+        }
+        openedLayers.push_back(layer);
+        _layersResolved = openedLayers.size();
+        for (const auto &assetPath : layer->GetCompositionAssetDependencies()) {
+            const std::string dependency = SdfComputeAssetPathRelativeToLayer(layer, assetPath);
+            if (!dependency.empty() && visited.insert(dependency).second) {
+                toOpen.push_back(dependency);
+            }
+        }
+    }
+    return sharesLayers;
+}
+
+// Returns a lock which doesn't own the mutex if the loading was cancelled while waiting
+std::unique_lock<std::mutex> StageLoader::LockStage() {
+    std::unique_lock<std::mutex> lock(*_stageMutex, std::defer_lock);
+    // The ui holds the lock while drawing, try locking to give up quickly when cancelled
+    while (!lock.try_lock()) {
+        if (_cancelled) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return lock;
+}
+
+// Runs in the background thread
+UsdStageRefPtr StageLoader::Load() {
+    SetPhase("Opening layers");
+    SdfLayerRefPtrVector openedLayers;
+    const bool sharesLayers = OpenLayers(openedLayers);
+    SdfLayerRefPtr rootLayer = SdfLayer::FindOrOpen(_path);
+    if (!rootLayer || _cancelled) {
+        return {};
+    }
+
+    // The layers opened by the editor might be edited while they are composed
+    std::unique_lock<std::mutex> stageLock;
+    if (sharesLayers && _stageMutex) {
+        SetPhase("Waiting for the editor");
+        stageLock = LockStage();
+        if (_cancelled) {
+            return {};
+        }
+    }
+
+    // Compose the stage without the payloads, this is the part that can't be interrupted
+    SetPhase("Composing prims");
+    UsdStageRefPtr stage = UsdStage::Open(rootLayer, UsdStage::LoadNone);
+    if (!stage || _cancelled) {
+        return {};
+    }
+    _layersResolved = stage->GetUsedLayers().size();
+
+    if (_openLoaded) {
+        SetPhase("Loading payloads");
+        // Loading a payload with its descendants also loads the nested payloads, so we only keep the topmost ones
+        SdfPathSet loadableSet = stage->FindLoadable();
+        SdfPathVector loadable(loadableSet.begin(), loadableSet.end());
+        SdfPath::RemoveDescendentPaths(&loadable);
+        _payloadsToLoad = loadable.size();
+        for (size_t first = 0; first < loadable.size(); first += PayloadBatchSize) {
+            if (_cancelled) {
+                return {};
+            }
+            // The ui can draw between two batches
+            if (stageLock.owns_lock()) {
+                stageLock.unlock();
+                stageLock = LockStage();
+                if (_cancelled) {
+                    return {};
+                }
+            }
+            const size_t last = std::min(first + PayloadBatchSize, loadable.size());
+            const SdfPathSet batch(loadable.begin() + first, loadable.begin() + last);
+            stage->LoadAndUnload(batch, SdfPathSet(), UsdLoadWithDescendants);
+            _payloadsLoaded = last;
+            _layersResolved = stage->GetUsedLayers().size();
+        }
+        // Everything is loaded, this makes sure the payloads added later on will also be loaded, like
+        // a stage opened with UsdStage::LoadAll
+        stage->SetLoadRules(UsdStageLoadRules::LoadAll());
+    }
+    SetPhase("Done");
+    return _cancelled ? UsdStageRefPtr() : stage;
+}
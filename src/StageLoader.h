@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <string>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// StageLoader opens a stage in a background thread so the application is not frozen while the stage is composed.
+/// The stage is first opened without its payloads, which are then loaded by batches. This allows to report the progress
+/// and to cancel the loading between two batches.
+/// The loaded stage is returned to the editor only when the composition is finished.
+/// The layers of the new stage are opened first without the stage mutex. When the stage shares a layer with the
+/// stages already opened, which the editor might be editing, it is composed and loaded while holding the mutex.
+///
+class StageLoader {
+  public:
+    StageLoader(const std::string &path, bool openLoaded, std::mutex *stageMutex);
+    ~StageLoader();
+
+    // Delete copy
+    StageLoader(const StageLoader &) = delete;
+    StageLoader &operator=(const StageLoader &) = delete;
+
+    /// Ask the loading thread to stop, it will stop after the current batch of payloads
+    void Cancel() { _cancelled = true; }
+    bool IsCancelled() const { return _cancelled; }
+
+    /// Returns true when the background thread has finished, successfully or not
+    bool IsFinished() const;
+
+    /// Returns the opened stage, it must be called once when the loader is finished.
+    /// The stage is null if the loading failed or was cancelled
+    UsdStageRefPtr GetStage();
+
+    const std::string &GetPath() const { return _path; }
+
+    /// Human readable progress of the loading, safe to call from the ui thread
+    std::string GetProgressText() const;
+
+    /// Returns a value between 0 and 1
+    float GetProgress() const;
+
+  private:
+    UsdStageRefPtr Load();
+    bool OpenLayers(SdfLayerRefPtrVector &openedLayers);
+    std::unique_lock<std::mutex> LockStage();
+    void SetPhase(const char *phase);
+
+    const std::string _path;
+    const bool _openLoaded;
+    std::mutex *_stageMutex;
+    std::atomic<bool> _cancelled;
+    std::future<UsdStageRefPtr> _task;
+
+    // Progress
+    mutable std::mutex _phaseMutex;
+    std::string _phase;
+    std::atomic<size_t> _layersResolved;
+    std::atomic<size_t> _payloadsLoaded;
+    std::atomic<size_t> _payloadsToLoad;
+};
@@ -0,0 +1,168 @@
+#include <chrono>
+#include <iomanip>
+#include <map>
+#include <pxr/base/arch/timing.h>
+#include <pxr/base/trace/collection.h>
+#include <pxr/base/trace/collector.h>
+#include <pxr/base/trace/reporter.h>
+#include "TraceCapture.h"
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+// Delay between two reads of the collector
+static constexpr std::chrono::milliseconds CaptureInterval(200);
+
+namespace {
+
+// Writes the events of the collections in the json array variant of the chrome trace format, which doesn't need
+// the whole trace to be known before writing it
+class ChromeTraceWriter : public TraceCollection::Visitor {
+  public:
+    // The timestamps are relative to the start of the capture, written in microseconds with a fixed precision as
+    // the default notation would round them to 6 significant digits
+    explicit ChromeTraceWriter(std::ostream &out) : _out(out), _startTime(ArchGetTickTime()) {
+        _out << std::fixed << std::setprecision(3);
+    }
+
+    void OnBeginCollection() override {}
+    void OnEndCollection() override {}
+    void OnBeginThread(const TraceThreadId &) override {}
+    void OnEndThread(const TraceThreadId &) override {}
+    bool AcceptsCategory(TraceCategoryId) override { return true; }
+
+    void OnEvent(const TraceThreadId &threadId, const TfToken &key, const TraceEvent &event) override {
+        switch (event.GetType()) {
+        case TraceEvent::EventType::Begin:
+            WriteEvent(threadId, key, "B", event.GetTimeStamp());
+            break;
+        case TraceEvent::EventType::End:
+            WriteEvent(threadId, key, "E", event.GetTimeStamp());
+            break;
+        case TraceEvent::EventType::Timespan:
+            WriteEvent(threadId, key, "X", event.GetStartTimeStamp());
+            _out << ",\"dur\":" << ToMicroseconds(event.GetEndTimeStamp() - event.GetStartTimeStamp());
+            break;
+        case TraceEvent::EventType::Marker:
+            WriteEvent(threadId, key, "i", event.GetTimeStamp());
+            break;
+        default:
+            return; // Counters and scope data are not exported
+        }
+        _out << "}";
+        _eventCount++;
+    }
+
+    size_t GetEventCount() const { return _eventCount; }
+
+  private:
+    static double ToMicroseconds(TraceEvent::TimeStamp ticks) {
+        return static_cast<double>(ArchTicksToNanoseconds(ticks)) / 1000.0;
+    }
+
+    // Writes the beginning of an event, the caller closes it
+    void WriteEvent(const TraceThreadId &threadId, const TfToken &key, const char *phase, TraceEvent::TimeStamp time) {
+        _out << (_eventCount ? ",\n" : "") << "{\"name\":\"";
+        for (const char c : key.GetString()) {
+            if (c == '"' || c == '\\') {
+                _out << '\\';
+            }
+            _out << c;
+        }
+        _out << "\",\"cat\":\"usd\",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << GetThreadIndex(threadId)
+             << ",\"ts\":" << ToMicroseconds(time > _startTime ? time - _startTime : 0);
+    }
+
+    // The trace thread ids are strings, chrome expects integers
+    size_t GetThreadIndex(const TraceThreadId &threadId) {
+        return _threadIndices.emplace(threadId.ToString(), _threadIndices.size()).first->second;
+    }
+
+    std::ostream &_out;
+    const TraceEvent::TimeStamp _startTime;
+    size_t _eventCount = 0;
+    std::map<std::string, size_t> _threadIndices;
+};
+
+} // namespace
+
+TraceCapture &TraceCapture::GetInstance() {
+    static TraceCapture traceCapture;
+    return traceCapture;
+}
+
+TraceCapture::~TraceCapture() { Stop(); }
+
+bool TraceCapture::Start() {
+    Stop(); // The previous capture might have stopped by itself, its thread still has to be joined
+    _file.open(fileName, std::ios::out | std::ios::trunc);
+    if (!_file) {
+        return false;
+    }
+    _stopping = false;
+    _eventCount = 0;
+    _fileSize = 0;
+    _duration = 0.0;
+    _enabledCollector = !TraceCollector::IsEnabled();
+    if (_enabledCollector) {
+        TraceCollector::GetInstance().SetEnabled(true);
+    }
+    // Discard the events recorded before the capture
+    TraceCollector::GetInstance().CreateCollection();
+    _isCapturing = true;
+    _thread = std::thread(&TraceCapture::Run, this, static_cast<double>(maxDuration),
+                          static_cast<size_t>(maxFileSize) * 1024 * 1024);
+    return true;
+}
+
+void TraceCapture::Stop() {
+    if (!_thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _stopRequested.notify_one();
+    _thread.join();
+}
+
+void TraceCapture::Toggle() {
+    if (IsCapturing()) {
+        Stop();
+    } else {
+        Start();
+    }
+}
+
+void TraceCapture::Run(double maxDuration, size_t maxFileSize) {
+    const auto start = std::chrono::steady_clock::now();
+    ChromeTraceWriter writer(_file);
+    _file << "[\n";
+    bool stopping = false;
+    while (!stopping) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            stopping = _stopRequested.wait_for(lock, CaptureInterval, [this]() { return _stopping; });
+        }
+        std::unique_ptr<TraceCollection> collection = TraceCollector::GetInstance().CreateCollection();
+        if (collection) {
+            collection->Iterate(writer);
+        }
+        // The global reporter also receives the collections and keeps them until its tree is updated, they are
+        // already written to the file
+        TraceReporter::GetGlobalReporter()->ClearTree();
+        const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+        _eventCount = writer.GetEventCount();
+        _fileSize = static_cast<size_t>(_file.tellp());
+        _duration = duration.count();
+        if (_duration >= maxDuration || _fileSize >= maxFileSize || !_file) {
+            stopping = true;
+        }
+    }
+    _file << "\n]\n";
+    _file.close();
+    if (_enabledCollector) {
+        TraceCollector::GetInstance().SetEnabled(false);
+    }
+    _isCapturing = false;
+}
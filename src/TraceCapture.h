@@ -0,0 +1,51 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+///
+/// Streams the events of the usd TraceCollector to a file on a background thread, in the chrome trace event format.
+/// The ui doesn't build any report while capturing, so the capture doesn't distort the timings it measures, and the
+/// collections sent to the global TraceReporter are cleared as they are written, so the trace isn't kept in memory.
+/// A capture stops by itself when it reaches its maximum duration or file size.
+///
+class TraceCapture {
+  public:
+    static TraceCapture &GetInstance();
+    ~TraceCapture();
+
+    /// Enables the TraceCollector and starts writing its events. Returns false if the file can't be opened
+    bool Start();
+    void Stop();
+    void Toggle();
+
+    bool IsCapturing() const { return _isCapturing; }
+
+    /// Statistics of the current or last capture
+    size_t GetEventCount() const { return _eventCount; }
+    size_t GetFileSize() const { return _fileSize; }
+    double GetDuration() const { return _duration; }
+
+    /// Settings of the next capture
+    std::string fileName = "usdtweak_capture.json";
+    int maxDuration = 30; // seconds
+    int maxFileSize = 512; // megabytes
+
+  private:
+    TraceCapture() = default;
+    void Run(double maxDuration, size_t maxFileSize);
+
+    std::ofstream _file; // Only written by the capture thread
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _stopRequested;
+    bool _stopping = false;
+    bool _enabledCollector = false; // The capture enabled the collector and disables it when it finishes
+    std::atomic<bool> _isCapturing{false};
+    std::atomic<size_t> _eventCount{0};
+    std::atomic<size_t> _fileSize{0};
+    std::atomic<double> _duration{0.0};
+};
@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <iostream>
+#include <pxr/base/arch/fileSystem.h>
+#include <pxr/base/tf/fileUtils.h>
+#include <pxr/usd/sdf/changeBlock.h>
 #include "CommandStack.h"
 #include "SdfCommandGroupRecorder.h"
 
-CommandStack *CommandStack::instance = nullptr;
+thread_local CommandStack *CommandStack::instance = nullptr;
 
 CommandStack &CommandStack::GetInstance() {
     if (!instance) {
@@ -10,30 +15,167 @@ CommandStack &CommandStack::GetInstance() {
     return *instance;
 }
 
+void CommandStack::ReleaseInstance() {
+    delete instance;
+    instance = nullptr;
+}
+
 CommandStack::CommandStack() {}
 CommandStack::~CommandStack() {
-    if (instance) {
-        delete instance;
+    for (Command *command : _commandQueue) {
+        delete command;
     }
+    _RemoveCommands(0);
 }
 
 void CommandStack::ExecuteCommands() {
-    if (lastCmd) {
-        if (lastCmd->DoIt()) {
-            _PushCommand(lastCmd);
+    // The commands queued while executing will run on the next frame
+    std::vector<Command *> commands;
+    commands.swap(_commandQueue);
+    size_t first = 0;
+    while (first < commands.size()) {
+        // The Usd api can't be used in a change block, only the Sdf edits of the same layer are batched
+        const SdfLayerHandle layer = commands[first]->GetBatchedLayer();
+        size_t last = first + 1;
+        while (layer && last < commands.size() && commands[last]->GetBatchedLayer() == layer) {
+            last++;
+        }
+        if (last - first > 1) {
+            // The stages are recomposed only once for all the edits, which are undone together
+            _batch.reset(new CommandBatch());
+            {
+                SdfChangeBlock block;
+                for (size_t i = first; i < last; ++i) {
+                    _ExecuteCommand(commands[i]);
+                }
+            }
+            std::unique_ptr<CommandBatch> batch(std::move(_batch));
+            if (!batch->IsEmpty()) {
+                _PushCommand(batch.release());
+            }
+            first = last;
         } else {
-            delete lastCmd;
+            _ExecuteCommand(commands[first++]);
         }
-        lastCmd = nullptr; // Reset the command
+    }
+}
+
+void CommandStack::_ExecuteCommand(Command *cmd) {
+    if (cmd->DoIt()) {
+        _PushCommand(cmd);
+    } else {
+        delete cmd;
     }
 }
 
 void CommandStack::_PushCommand(Command *cmd) {
+    if (_batch) {
+        _batch->AddCommand(cmd);
+        return;
+    }
     if (undoStackPos != undoStack.size()) {
-        undoStack.resize(undoStackPos);
+        _RemoveCommands(undoStackPos);
     }
-    undoStack.emplace_back(std::move(cmd));
+    UndoStackEntry entry;
+    entry.command.reset(cmd);
+    entry.memorySize = cmd->GetMemorySize();
+    _memorySize += entry.memorySize;
+    undoStack.emplace_back(std::move(entry));
     undoStackPos++;
+    _EnforceMemoryBudget();
+}
+
+void CommandStack::SetMemoryBudget(size_t bytes) {
+    _memoryBudget = bytes;
+    _EnforceMemoryBudget();
+}
+
+Command *CommandStack::_GetLoadedCommand(size_t index) {
+    UndoStackEntry &entry = undoStack[index];
+    if (!entry.journalFile.empty()) {
+        SdfLayerRefPtr journal = SdfLayer::OpenAsAnonymous(entry.journalFile);
+        if (!journal || !entry.command->ReloadValues(journal, SdfPath::AbsoluteRootPath())) {
+            // The command can't be run without its values, and the commands beyond it would apply to a different
+            // state of the layers, they are all removed
+            _lastError = "Unable to read the undo journal " + entry.journalFile +
+                         ", the commands beyond it were removed from the undo history";
+            std::cerr << "ERROR: " << _lastError << std::endl;
+            if (index < static_cast<size_t>(undoStackPos)) {
+                _RemoveCommandsUntil(index);
+            } else {
+                _RemoveCommands(index);
+            }
+            return nullptr;
+        }
+        TfDeleteFile(entry.journalFile);
+        entry.journalFile.clear();
+        _memorySize += entry.memorySize;
+    }
+    return entry.command.get();
+}
+
+void CommandStack::_ReleaseEntry(UndoStackEntry &entry) {
+    if (entry.journalFile.empty()) {
+        _memorySize -= entry.memorySize;
+    } else {
+        TfDeleteFile(entry.journalFile);
+    }
+}
+
+void CommandStack::_RemoveCommands(size_t first) {
+    for (size_t i = first; i < undoStack.size(); ++i) {
+        _ReleaseEntry(undoStack[i]);
+    }
+    undoStack.resize(first);
+    undoStackPos = std::min(undoStackPos, static_cast<int>(first));
+}
+
+void CommandStack::_RemoveCommandsUntil(size_t last) {
+    for (size_t i = 0; i <= last; ++i) {
+        _ReleaseEntry(undoStack[i]);
+    }
+    undoStack.erase(undoStack.begin(), undoStack.begin() + last + 1);
+    undoStackPos = std::max(0, undoStackPos - static_cast<int>(last + 1));
+}
+
+void CommandStack::_SpillToJournal(UndoStackEntry &entry) {
+    if (!entry.journalFile.empty()) {
+        return;
+    }
+    const std::string journalFile = ArchMakeTmpFileName("usdtweak_undo", ".usdc");
+    SdfLayerRefPtr journal = SdfLayer::CreateNew(journalFile);
+    if (!journal) {
+        return;
+    }
+    if (!entry.command->SpillValues(journal, SdfPath::AbsoluteRootPath())) {
+        TfDeleteFile(journalFile);
+        return;
+    }
+    if (!journal->Save()) {
+        // The journal is still in memory, the values are copied back from it
+        if (!entry.command->ReloadValues(journal, SdfPath::AbsoluteRootPath())) {
+            std::cerr << "ERROR: unable to copy back the undo values from " << journalFile << std::endl;
+        }
+        TfDeleteFile(journalFile);
+        return;
+    }
+    entry.journalFile = journalFile;
+    _memorySize -= entry.memorySize;
+}
+
+void CommandStack::_EnforceMemoryBudget() {
+    if (_memoryBudget == 0) {
+        return;
+    }
+    // The oldest commands are the less likely to be undone, then the last commands of the redo list.
+    // The commands next to the current position stay in memory.
+    const size_t position = static_cast<size_t>(undoStackPos);
+    for (size_t i = 0; i + 1 < position && _memorySize > _memoryBudget; ++i) {
+        _SpillToJournal(undoStack[i]);
+    }
+    for (size_t i = undoStack.size(); i > position + 1 && _memorySize > _memoryBudget; --i) {
+        _SpillToJournal(undoStack[i - 1]);
+    }
 }
 
 struct UndoCommand : public Command {
@@ -72,8 +214,11 @@ bool UndoCommand::DoIt() {
     CommandStack &commandStack = CommandStack::GetInstance();
     // TODO : move into stacK ??
     if (commandStack.undoStackPos > 0) {
-        commandStack.undoStackPos--;
-        commandStack.undoStack[commandStack.undoStackPos]->UndoIt();
+        if (Command *command = commandStack._GetLoadedCommand(commandStack.undoStackPos - 1)) {
+            commandStack.undoStackPos--;
+            command->UndoIt();
+            commandStack._EnforceMemoryBudget();
+        }
     }
     return false; // Should never be stored in the stack
 }
@@ -85,8 +230,11 @@ bool RedoCommand::DoIt() {
     // TODO : move into stacK ??
     CommandStack &commandStack = CommandStack::GetInstance();
     if (commandStack.undoStackPos < commandStack.undoStack.size()) {
-        commandStack.undoStack[commandStack.undoStackPos]->DoIt();
-        commandStack.undoStackPos++;
+        if (Command *command = commandStack._GetLoadedCommand(commandStack.undoStackPos)) {
+            command->DoIt();
+            commandStack.undoStackPos++;
+            commandStack._EnforceMemoryBudget();
+        }
     }
 
     return false; // Should never be stored in the stack
@@ -98,9 +246,7 @@ template void ExecuteAfterDraw<RedoCommand>();
 bool ClearUndoRedoCommand::DoIt() {
     CommandStack &commandStack = CommandStack::GetInstance();
     commandStack.undoStackPos = 0;
-    commandStack.undoStack.clear();
-    delete commandStack.lastCmd;
-    commandStack.lastCmd = nullptr;
+    commandStack._RemoveCommands(0);
     return false; // Should never be stored in the stack
 }
 template void ExecuteAfterDraw<ClearUndoRedoCommand>();
@@ -136,3 +282,15 @@ template void ExecuteAfterDraw<UsdFunctionCall>(UsdStageRefPtr stage, std::funct
 void ExecuteCommands() {
     CommandStack::GetInstance().ExecuteCommands();
 }
+
+void SetUndoMemoryBudget(size_t bytes) {
+    CommandStack::GetInstance().SetMemoryBudget(bytes);
+}
+
+std::string TakeUndoError() {
+    return CommandStack::GetInstance().TakeLastError();
+}
+
+void ReleaseCommandStack() {
+    CommandStack::ReleaseInstance();
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <memory>
+#include <string>
 #include <vector>
 
 #include "CommandsImpl.h"
@@ -17,41 +18,86 @@ struct CommandStack {
     friend struct UsdFunctionCall;
     friend class SdfUndoRedoRecorder;
     
+    /// Each thread has its own stack, the batch mode executes commands on multiple stages in parallel
     static CommandStack &GetInstance();
 
-    inline bool HasNextCommand() { return lastCmd != nullptr; }
-    inline void SetNextCommand(Command *command) { lastCmd = command; }
-    
-    // Execute next command and push it on the stack
+    /// Deletes the stack of the calling thread, with its queued commands and its journal
+    static void ReleaseInstance();
+
+    /// Adds a command at the end of the queue, the queue now owns the command
+    inline void QueueCommand(Command *command) { _commandQueue.push_back(command); }
+
+    /// Execute the queued commands in order and push them on the stack.
+    /// The consecutive layer edits are executed in one SdfChangeBlock and pushed as a single command
     void ExecuteCommands();
+
+    /// When the estimated memory of the commands exceeds the budget, the data of the commands furthest from the
+    /// current position is moved to journal files on disk and read back when they are undone or redone.
+    /// A budget of 0 means unlimited
+    void SetMemoryBudget(size_t bytes);
+    size_t GetMemoryBudget() const { return _memoryBudget; }
+
+    /// Estimated memory used by the commands which are not stored on disk
+    size_t GetMemorySize() const { return _memorySize; }
+
+    /// Error of the last undo or redo which couldn't read its journal, it is cleared when returned
+    std::string TakeLastError() { return std::move(_lastError); }
     
 private:
 
+    struct UndoStackEntry {
+        std::unique_ptr<Command> command;
+        size_t memorySize = 0;   // Estimated memory used by the command when loaded
+        std::string journalFile; // Not empty when the command data is stored on disk
+    };
 
     // The undo stack should ultimately belong to an Editor, not be a global variable
-    using UndoStackT = std::vector<std::unique_ptr<Command>>;
+    using UndoStackT = std::vector<UndoStackEntry>;
     UndoStackT undoStack;
 
+    size_t _memoryBudget = 0;
+    size_t _memorySize = 0;
+    std::string _lastError;
+
     /// The pointer to the current command in the undo stack
     int undoStackPos = 0;
 
-    // Storing only one command per frame for now, easier to reason about.
-    Command *lastCmd = nullptr;
+    /// Commands waiting to be executed after the frame is rendered
+    std::vector<Command *> _commandQueue;
 
-    /// The ProcessCommands function is called after the frame is rendered and displayed and execute the
-    /// last command. The command passed here now belongs to this stack
+    /// Batch receiving the pushed commands while executing consecutive layer edits
+    std::unique_ptr<CommandBatch> _batch;
+
+    /// Executes the command and pushes it on the stack if it can be undone, or deletes it
+    void _ExecuteCommand(Command *cmd);
+
+    /// The ExecuteCommands function is called after the frame is rendered and displayed and execute the
+    /// queued commands. The command passed here now belongs to this stack
     void _PushCommand(Command *cmd);
 
+    /// Returns the command at index, reading its data from the journal if needed. Returns nullptr if the
+    /// journal couldn't be read
+    Command *_GetLoadedCommand(size_t index);
+
+    /// Removes the commands from index first to the end of the stack
+    void _RemoveCommands(size_t first);
+
+    /// Removes the commands from the beginning of the stack to index last included
+    void _RemoveCommandsUntil(size_t last);
+
+    /// Releases the memory or the journal file of a command being removed
+    void _ReleaseEntry(UndoStackEntry &entry);
+
+    void _SpillToJournal(UndoStackEntry &entry);
+    void _EnforceMemoryBudget();
+
   private:
     CommandStack();
     ~CommandStack();
-    static CommandStack *instance;
+    static thread_local CommandStack *instance;
 };
 
 /// Dispatching Commands.
 template <typename CommandClass, typename... ArgTypes> void ExecuteAfterDraw(ArgTypes... arguments) {
-    CommandStack &commandStack = CommandStack::GetInstance();
-    if (!commandStack.HasNextCommand()) {
-        commandStack.SetNextCommand(new CommandClass(arguments...));
-    }
+    CommandStack::GetInstance().QueueCommand(new CommandClass(arguments...));
 }
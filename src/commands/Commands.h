@@ -51,6 +51,7 @@ struct EditorSelectAttributePath;
 struct EditorShutdown;
 struct EditorStartPlayback;
 struct EditorStopPlayback;
+struct EditorToggleTraceCapture;
 struct EditorFindPrim;
 
 struct LayerRemoveSubLayer;
@@ -221,9 +222,20 @@ void ExecuteAfterDraw(FuncT &&func, const UsdGeomXformCommonAPI &api, ArgsT &&..
 //// We could simply copy the handle/ref/weak/ptrs
 
 
-/// Process the commands waiting in the queue. Only one command would be waiting at the moment
+/// Process the commands waiting in the queue, in order. The consecutive layer edits are executed in one
+/// change block and undone together
 void ExecuteCommands();
 
+/// Memory budget of the undo stack in bytes, the commands above are stored on disk. 0 means unlimited
+void SetUndoMemoryBudget(size_t bytes);
+
+/// Error of the last undo or redo which couldn't read its data back from disk, empty if there was none.
+/// The error is cleared when returned
+std::string TakeUndoError();
+
+/// Deletes the undo stack of the calling thread. The threads running commands must call it before exiting
+void ReleaseCommandStack();
+
 ///
 /// Allows to record one command spanning multiple frames.
 /// It is used in the manipulators, to record only one command for a translation/rotation etc.
@@ -1,3 +1,4 @@
+#include <pxr/usd/sdf/changeBlock.h>
 #include "CommandStack.h"
 #include "CommandsImpl.h"
 #include "SdfCommandGroup.h"
@@ -12,6 +13,12 @@ bool SdfLayerCommand::UndoIt() {
     return false;
 }
 
+size_t SdfLayerCommand::GetMemorySize() const { return sizeof(SdfLayerCommand) + _undoCommands.GetMemorySize(); }
+
+bool SdfLayerCommand::SpillValues(SdfLayerHandle journal, const SdfPath &root) { return _undoCommands.SpillValues(journal, root); }
+
+bool SdfLayerCommand::ReloadValues(SdfLayerHandle journal, const SdfPath &root) { return _undoCommands.ReloadValues(journal, root); }
+
 bool SdfUndoRedoCommand::UndoIt() {
     _undoCommands.UndoIt();
     return false;
@@ -21,6 +28,56 @@ bool SdfUndoRedoCommand::DoIt() {
     _undoCommands.DoIt();
     return true;
 }
+
+bool CommandBatch::DoIt() {
+    SdfChangeBlock block;
+    for (auto &command : _commands) {
+        command->DoIt();
+    }
+    return true;
+}
+
+bool CommandBatch::UndoIt() {
+    SdfChangeBlock block;
+    for (auto it = _commands.rbegin(); it != _commands.rend(); ++it) {
+        (*it)->UndoIt();
+    }
+    return false;
+}
+
+size_t CommandBatch::GetMemorySize() const {
+    size_t size = sizeof(CommandBatch) + _commands.capacity() * sizeof(std::unique_ptr<Command>);
+    for (const auto &command : _commands) {
+        size += command->GetMemorySize();
+    }
+    return size;
+}
+
+// Each command of the batch has its own prim in the journal
+static SdfPath GetBatchedCommandPath(const SdfPath &root, size_t commandIndex) {
+    return root.AppendChild(TfToken("Command" + std::to_string(commandIndex)));
+}
+
+bool CommandBatch::SpillValues(SdfLayerHandle journal, const SdfPath &root) {
+    for (size_t i = 0; i < _commands.size(); ++i) {
+        if (!_commands[i]->SpillValues(journal, GetBatchedCommandPath(root, i))) {
+            // The whole batch stays in memory, the values already moved are copied back from the journal
+            for (size_t j = 0; j < i; ++j) {
+                _commands[j]->ReloadValues(journal, GetBatchedCommandPath(root, j));
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CommandBatch::ReloadValues(SdfLayerHandle journal, const SdfPath &root) {
+    bool reloaded = true;
+    for (size_t i = 0; i < _commands.size(); ++i) {
+        reloaded = _commands[i]->ReloadValues(journal, GetBatchedCommandPath(root, i)) && reloaded;
+    }
+    return reloaded;
+}
 namespace {
 SdfUndoRedoRecorder *undoRedoRecorder = nullptr;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <SdfCommandGroup.h>
 #include <memory>
+#include <string>
 #include <pxr/usd/usd/stage.h> // For BeginEdition
 #include <vector>
 
@@ -10,12 +11,29 @@ struct Command {
     virtual ~Command(){};
     virtual bool DoIt() = 0;
     virtual bool UndoIt() { return false; }
+
+    /// Estimated memory used by the command, the undo stack uses it to stay in its memory budget
+    virtual size_t GetMemorySize() const { return sizeof(Command); }
+
+    /// Moves the data of the command in a journal layer, under the root path, and reads it back.
+    /// The commands which can't be stored in a journal return false, ReloadValues returns false if the data read
+    /// back is not the data moved
+    virtual bool SpillValues(SdfLayerHandle journal, const SdfPath &root) { return false; }
+    virtual bool ReloadValues(SdfLayerHandle journal, const SdfPath &root) { return true; }
+
+    /// Layer of the commands editing only with the Sdf api. The consecutive commands of a frame editing the same layer
+    /// are batched in one change block and undone together. The commands using the Usd api return an invalid handle,
+    /// they need a recomposed stage and can't run in a change block
+    virtual SdfLayerHandle GetBatchedLayer() const { return SdfLayerHandle(); }
 };
 
 struct SdfLayerCommand : public Command {
     virtual ~SdfLayerCommand(){};
     virtual bool DoIt() override = 0;
     bool UndoIt() override;
+    size_t GetMemorySize() const override;
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &root) override;
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &root) override;
     SdfCommandGroup _undoCommands;
 };
 
@@ -42,3 +60,19 @@ struct UsdFunctionCall : public Command {
     SdfLayerHandle _layer;
     std::function<void()> _func;
 };
+
+// Consecutive Sdf edits of a layer executed in one frame. They are stored in the undo stack as a single command
+struct CommandBatch : public Command {
+    ~CommandBatch() override {}
+
+    bool DoIt() override;
+    bool UndoIt() override;
+    size_t GetMemorySize() const override;
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &root) override;
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &root) override;
+
+    bool IsEmpty() const { return _commands.empty(); }
+    void AddCommand(Command *command) { _commands.emplace_back(command); }
+
+    std::vector<std::unique_ptr<Command>> _commands;
+};
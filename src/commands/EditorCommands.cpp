@@ -8,9 +8,13 @@
 ///
 #include "CommandsImpl.h"
 #include "Editor.h"
+#include <algorithm>
+#include <pxr/usd/usd/modelAPI.h>
 #include <pxr/usd/usd/primRange.h>
 #include <string>
 #include "WildcardsCompare.h"
+#include "PrimSearchIndex.h"
+#include "TraceCapture.h"
 
 #include "SdfUndoRedoRecorder.h"
 ///
@@ -272,6 +276,16 @@ struct EditorStopPlayback : public EditorCommand {
 };
 template void ExecuteAfterDraw<EditorStopPlayback>();
 
+struct EditorToggleTraceCapture : public EditorCommand {
+    EditorToggleTraceCapture() {}
+    ~EditorToggleTraceCapture() override {}
+    bool DoIt() override {
+        TraceCapture::GetInstance().Toggle();
+        return false;
+    }
+};
+template void ExecuteAfterDraw<EditorToggleTraceCapture>();
+
 // Launchers, for the moment we don't make the add/remove commands undoable, but they could be in the future
 struct EditorRunLauncher : public EditorCommand {
     EditorRunLauncher(const std::string launcherName) : _launcherName(launcherName) {}
@@ -316,51 +330,67 @@ template void ExecuteAfterDraw<EditorRemoveLauncher>(const std::string);
 
 // This will try to find the next matching prim after the selection
 struct EditorFindPrim : public EditorCommand {
-    EditorFindPrim(const std::string pattern, bool useRegex) : _pattern(pattern) {
-        if (useRegex) {
-            _matches = [&](const std::string &str) { return FastWildComparePortable(_pattern.c_str(), str.c_str()); };
-        } else {
-            _matches = [&](const std::string &str) { return str == _pattern; };
-        }
-    }
+    EditorFindPrim(const PrimSearchQuery query, bool selectAll) : _query(query), _selectAll(selectAll) {}
     ~EditorFindPrim() override{};
 
     bool DoIt() override {
-        if (_editor) {
-            const auto &stage = _editor->GetCurrentStage();
-            auto &selection = _editor->GetSelection();
-            auto anchor = selection.GetAnchorPrimPath(stage);
-            SdfPath found;
-            bool selectedFound = false;
-            // Traverse the stage and set the new selection
-            auto range = UsdPrimRange::Stage(stage, UsdTraverseInstanceProxies(UsdPrimAllPrimsPredicate));
-            for (auto iter = range.begin(); iter != range.end(); ++iter) {
-                if (iter->GetPath() == anchor) {
-                    selectedFound = true;
-                } else if (_matches(iter->GetName())) {
-                    // Store the first matching path in case we don't find the one
-                    // after the anchor
-                    if (found == SdfPath()) {
-                        found = iter->GetPath();
-                        // We don't have an anchor, so the first match is the correct one
-                        if (anchor == SdfPath())
-                            break;
-                    }
-                    if (selectedFound) {
-                        found = iter->GetPath();
-                        break;
-                    }
+        if (!_editor || !_editor->GetCurrentStage()) {
+            return false;
+        }
+        const auto &stage = _editor->GetCurrentStage();
+        auto &selection = _editor->GetSelection();
+        const PrimSearchIndex &index = _editor->GetPrimSearchIndex();
+        // The stage is traversed only while the index is being built
+        const SdfPathVector found = index.IsReady() ? SdfPathVector() : TraverseStage(stage);
+        if (_selectAll) {
+            const SdfPathVector &paths = index.IsReady() ? index.FindAll(_query) : found;
+            if (!paths.empty()) {
+                selection.Clear(stage);
+                for (const auto &path : paths) {
+                    selection.AddSelected(stage, path);
                 }
             }
-            if (found != SdfPath()) {
-                selection.SetSelected(stage, found);
+        } else {
+            const SdfPath anchor = selection.GetAnchorPrimPath(stage);
+            SdfPath next;
+            if (index.IsReady()) {
+                next = index.FindNext(_query, anchor);
+            } else if (!found.empty()) {
+                const auto it = anchor.IsEmpty() ? found.end() : std::upper_bound(found.begin(), found.end(), anchor);
+                next = it == found.end() ? found.front() : *it;
+            }
+            if (next != SdfPath()) {
+                selection.SetSelected(stage, next);
             }
         }
         return false;
     }
-    std::function<bool(const std::string &)> _matches;
-    std::string _pattern;
+
+    // Matching prims in path order, like the index returns them
+    SdfPathVector TraverseStage(const UsdStageRefPtr &stage) const {
+        SdfPathVector found;
+        const auto range = UsdPrimRange::Stage(stage, UsdTraverseInstanceProxies(UsdPrimAllPrimsPredicate));
+        for (const auto &prim : range) {
+            const std::string &name = prim.GetName().GetString();
+            if (_query.useWildcards ? !FastWildComparePortable(_query.pattern.c_str(), name.c_str()) : name != _query.pattern) {
+                continue;
+            }
+            if (!_query.typeName.IsEmpty() && prim.GetTypeName() != _query.typeName) {
+                continue;
+            }
+            TfToken kind;
+            if (!_query.kind.IsEmpty() && (!UsdModelAPI(prim).GetKind(&kind) || kind != _query.kind)) {
+                continue;
+            }
+            found.push_back(prim.GetPath());
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    PrimSearchQuery _query;
+    bool _selectAll;
 };
-template void ExecuteAfterDraw<EditorFindPrim>(const std::string, bool useRegex);
+template void ExecuteAfterDraw<EditorFindPrim>(const PrimSearchQuery, bool selectAll);
 
 
@@ -1,4 +1,7 @@
 
+#include <algorithm>
+#include <functional>
+#include <iostream>
 #include <pxr/usd/sdf/layer.h>
 #include <pxr/usd/sdf/primSpec.h>
 #include <pxr/usd/sdf/reference.h>
@@ -27,6 +30,7 @@ struct LayerRemoveSubLayer : public SdfLayerCommand {
         }
         return false;
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _layer; }
     SdfLayerRefPtr _layer;
     std::string _subLayerPath;
 };
@@ -74,6 +78,7 @@ struct LayerMoveSubLayer : public SdfLayerCommand {
         return false;
     }
 
+    SdfLayerHandle GetBatchedLayer() const override { return _layer; }
     SdfLayerRefPtr _layer;
     std::string _subLayerPath;
     bool _movingUp; /// Template instead ?
@@ -104,6 +109,7 @@ struct LayerRenameSubLayer : public SdfLayerCommand {
         return false;
     }
 
+    SdfLayerHandle GetBatchedLayer() const override { return _layer; }
     SdfLayerRefPtr _layer;
     std::string _oldName;
     std::string _newName;
@@ -149,37 +155,235 @@ struct LayerUnmute : public Command {
 template void ExecuteAfterDraw<LayerUnmute>(SdfLayerRefPtr layer);
 template void ExecuteAfterDraw<LayerUnmute>(SdfLayerHandle layer);
 
-/* WARNING: this is a brute force and dumb implementation of storing text modification.
- It basically stores the previous and new layer as text in a string. So .... this will eat up the memory
- quite quickly if used intensively.
- But for now it's a quick way to test if text editing is worth in the application.
- */
+/// Lines of a text, the text is not copied and must outlive this object
+struct TextLines {
+    explicit TextLines(const std::string &text_) : text(text_) {
+        offsets.push_back(0);
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '\n') {
+                offsets.push_back(i + 1);
+            }
+        }
+        if (offsets.back() != text.size()) {
+            offsets.push_back(text.size());
+        }
+        // Hashing the lines first avoids comparing strings most of the time
+        hashes.reserve(offsets.size());
+        for (size_t line = 0; line < size(); ++line) {
+            size_t hash = 14695981039346656037ULL; // FNV-1a
+            for (size_t i = offsets[line]; i < offsets[line + 1]; ++i) {
+                hash = (hash ^ static_cast<unsigned char>(text[i])) * 1099511628211ULL;
+            }
+            hashes.push_back(hash);
+        }
+    }
+
+    size_t size() const { return offsets.size() - 1; }
+
+    bool IsSameLine(size_t line, const TextLines &other, size_t otherLine) const {
+        const size_t length = offsets[line + 1] - offsets[line];
+        return hashes[line] == other.hashes[otherLine] && length == other.offsets[otherLine + 1] - other.offsets[otherLine] &&
+               text.compare(offsets[line], length, other.text, other.offsets[otherLine], length) == 0;
+    }
+
+    // Returns the text of count lines starting at first
+    std::string GetLines(size_t first, size_t count) const {
+        return text.substr(offsets[first], offsets[first + count] - offsets[first]);
+    }
+
+    const std::string &text;
+    std::vector<size_t> offsets; // Begin of each line plus the end of the text
+    std::vector<size_t> hashes;
+};
+
+/// A block of lines of the old text replaced by a block of lines of the new text
+struct TextHunk {
+    size_t oldFirst;
+    size_t oldCount;
+    size_t newFirst;
+    size_t newCount;
+    std::string oldLines;
+    std::string newLines;
+};
+
+// Maximum number of inserted and deleted lines the diff algorithm looks for. Its memory grows with the square
+// of this number, past it the changed lines are stored in a single hunk.
+static constexpr int MaxLineDiffEdits = 1024;
+
+// Myers diff on the lines [aBegin, aEnd) and [bBegin, bEnd), returns the pairs of matching lines in order
+static bool FindMatchingLines(const TextLines &a, size_t aBegin, size_t aEnd, const TextLines &b, size_t bBegin, size_t bEnd,
+                              std::vector<std::pair<size_t, size_t>> &matches) {
+    const int n = static_cast<int>(aEnd - aBegin);
+    const int m = static_cast<int>(bEnd - bBegin);
+    const int maxEdits = std::min(n + m, MaxLineDiffEdits);
+    const int offset = maxEdits + 1;
+    std::vector<int> v(2 * maxEdits + 3, 0);
+    std::vector<std::vector<int>> trace;
+    auto isDownMove = [&](const std::vector<int> &v_, int d, int k) {
+        return k == -d || (k != d && v_[k - 1 + offset] < v_[k + 1 + offset]);
+    };
+    for (int d = 0; d <= maxEdits; ++d) {
+        trace.push_back(v);
+        for (int k = -d; k <= d; k += 2) {
+            int x = isDownMove(v, d, k) ? v[k + 1 + offset] : v[k - 1 + offset] + 1;
+            int y = x - k;
+            while (x < n && y < m && a.IsSameLine(aBegin + x, b, bBegin + y)) {
+                ++x, ++y;
+            }
+            v[k + offset] = x;
+            if (x >= n && y >= m) {
+                // Walk back the edit path, collecting the diagonals
+                for (int step = d; step > 0; --step) {
+                    const std::vector<int> &previous = trace[step];
+                    const int stepK = x - y;
+                    const int previousK = isDownMove(previous, step, stepK) ? stepK + 1 : stepK - 1;
+                    const int previousX = previous[previousK + offset];
+                    const int previousY = previousX - previousK;
+                    while (x > previousX && y > previousY) {
+                        --x, --y;
+                        matches.emplace_back(aBegin + x, bBegin + y);
+                    }
+                    x = previousX;
+                    y = previousY;
+                }
+                while (x > 0 && y > 0) {
+                    --x, --y;
+                    matches.emplace_back(aBegin + x, bBegin + y);
+                }
+                std::reverse(matches.begin(), matches.end());
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static std::vector<TextHunk> ComputeLineDiff(const std::string &oldText, const std::string &newText) {
+    const TextLines oldLines(oldText);
+    const TextLines newLines(newText);
+
+    // Edits are usually localized, so the common lines at the beginning and the end are skipped first
+    size_t oldBegin = 0, newBegin = 0;
+    while (oldBegin < oldLines.size() && newBegin < newLines.size() && oldLines.IsSameLine(oldBegin, newLines, newBegin)) {
+        ++oldBegin, ++newBegin;
+    }
+    size_t oldEnd = oldLines.size(), newEnd = newLines.size();
+    while (oldEnd > oldBegin && newEnd > newBegin && oldLines.IsSameLine(oldEnd - 1, newLines, newEnd - 1)) {
+        --oldEnd, --newEnd;
+    }
+
+    std::vector<std::pair<size_t, size_t>> matches;
+    if (!FindMatchingLines(oldLines, oldBegin, oldEnd, newLines, newBegin, newEnd, matches)) {
+        matches.clear();
+    }
+    matches.emplace_back(oldEnd, newEnd);
+
+    std::vector<TextHunk> hunks;
+    size_t oldLine = oldBegin, newLine = newBegin;
+    for (const auto &match : matches) {
+        if (match.first > oldLine || match.second > newLine) {
+            const size_t oldCount = match.first - oldLine;
+            const size_t newCount = match.second - newLine;
+            hunks.push_back({oldLine, oldCount, newLine, newCount, oldLines.GetLines(oldLine, oldCount),
+                             newLines.GetLines(newLine, newCount)});
+        }
+        oldLine = match.first + 1;
+        newLine = match.second + 1;
+    }
+    return hunks;
+}
+
+// Applies the hunks to the old text when forward is true, or to the new text otherwise. Returns false if the lines
+// replaced by a hunk are not the ones it was computed from
+static bool ApplyLineDiff(const std::string &text, const std::vector<TextHunk> &hunks, bool forward, std::string &result) {
+    const TextLines lines(text);
+    result.clear();
+    result.reserve(text.size());
+    size_t line = 0;
+    for (const auto &hunk : hunks) {
+        const size_t first = forward ? hunk.oldFirst : hunk.newFirst;
+        const size_t count = forward ? hunk.oldCount : hunk.newCount;
+        const std::string &replacedLines = forward ? hunk.oldLines : hunk.newLines;
+        if (first < line || first + count > lines.size() ||
+            text.compare(lines.offsets[first], lines.offsets[first + count] - lines.offsets[first], replacedLines) != 0) {
+            return false; // The text is not the one the diff was computed from
+        }
+        result.append(text, lines.offsets[line], lines.offsets[first] - lines.offsets[line]);
+        result.append(forward ? hunk.newLines : hunk.oldLines);
+        line = first + count;
+    }
+    result.append(text, lines.offsets[line], std::string::npos);
+    return true;
+}
+
+/// Replaces the content of a layer with a new text.
+/// Only the lines which differ between the previous and the new text are kept for undo and redo, the layer is
+/// exported again and the difference applied when the command is undone or redone.
 struct LayerTextEdit : public SdfLayerCommand {
 
-    LayerTextEdit(SdfLayerRefPtr layer, std::string newText) : _layer(layer), _newText(newText) {}
+    LayerTextEdit(SdfLayerRefPtr layer, std::string newText) : _layer(layer), _newText(std::move(newText)) {}
 
     ~LayerTextEdit() override {}
 
     bool DoIt() override {
         if (!_layer)
             return false;
-        SdfCommandGroupRecorder recorder(_undoCommands, _layer);
-        if (_oldText.empty()) {
-            _layer->ExportToString(&_oldText);
+        std::string currentText;
+        _layer->ExportToString(&currentText);
+        if (!_hasDiff) {
+            if (!_layer->ImportFromString(_newText)) {
+                return false;
+            }
+            // The imported text is reformatted by usd, the diff must be computed with the exported one
+            // to be applied on the next exports
+            std::string importedText;
+            _layer->ExportToString(&importedText);
+            _hunks = ComputeLineDiff(currentText, importedText);
+            _oldTextHash = std::hash<std::string>()(currentText);
+            _newTextHash = std::hash<std::string>()(importedText);
+            _hasDiff = true;
+            std::string().swap(_newText);
+            return true;
+        }
+        if (std::hash<std::string>()(currentText) != _oldTextHash) {
+            std::cerr << "ERROR: the layer " << _layer->GetIdentifier() << " differs from the text edited" << std::endl;
+            return false;
         }
-        return _layer->ImportFromString(_newText);
-        //_layer->SetDirty();
+        std::string newText;
+        return ApplyLineDiff(currentText, _hunks, true, newText) && _layer->ImportFromString(newText);
     };
 
     bool UndoIt() override {
-        if (!_layer)
+        if (!_layer || !_hasDiff)
+            return false;
+        std::string currentText;
+        _layer->ExportToString(&currentText);
+        if (std::hash<std::string>()(currentText) != _newTextHash) {
+            std::cerr << "ERROR: the layer " << _layer->GetIdentifier() << " differs from the text edited" << std::endl;
             return false;
-        return _layer->ImportFromString(_oldText);
+        }
+        std::string oldText;
+        return ApplyLineDiff(currentText, _hunks, false, oldText) && _layer->ImportFromString(oldText);
     }
 
+    size_t GetMemorySize() const override {
+        size_t size = sizeof(LayerTextEdit) + _newText.size();
+        for (const auto &hunk : _hunks) {
+            size += sizeof(TextHunk) + hunk.oldLines.size() + hunk.newLines.size();
+        }
+        return size;
+    }
+
+    // The diff is kept in memory
+    bool SpillValues(SdfLayerHandle, const SdfPath &) override { return false; }
+
+    SdfLayerHandle GetBatchedLayer() const override { return _layer; }
     SdfLayerRefPtr _layer;
-    std::string _oldText;
     std::string _newText;
+    bool _hasDiff = false;
+    std::vector<TextHunk> _hunks;
+    size_t _oldTextHash = 0; // The diff is only applied on the exact texts it was computed from
+    size_t _newTextHash = 0;
 };
 template void ExecuteAfterDraw<LayerTextEdit>(SdfLayerRefPtr layer, std::string newText);
 
@@ -213,6 +417,7 @@ struct LayerCreateOversFromPath : public SdfLayerCommand {
         return true;
     }
 
+    SdfLayerHandle GetBatchedLayer() const override { return _layer; }
     SdfLayerRefPtr _layer;
     std::string _path;
 };
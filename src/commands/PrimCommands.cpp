@@ -41,6 +41,10 @@ struct PrimNew : public SdfLayerCommand {
         }
     }
 
+    SdfLayerHandle GetBatchedLayer() const override {
+        return _layer ? SdfLayerHandle(_layer) : (_primSpec ? _primSpec->GetLayer() : SdfLayerHandle());
+    }
+
     SdfPrimSpecHandle _newPrimSpec;
     SdfPrimSpecHandle _primSpec;
     SdfLayerRefPtr _layer;
@@ -82,6 +86,7 @@ struct PrimRemove : public SdfLayerCommand {
             return true;
         }
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _primSpec ? _primSpec->GetLayer() : SdfLayerHandle(); }
 
     SdfPrimSpecHandle _primSpec;
 };
@@ -103,6 +108,8 @@ template <typename ItemType> struct PrimCreateListEditorOperation : SdfLayerComm
     // Forced to inherit as the Specialize and Inherit arcs have the same type
     virtual SdfListEditorProxy<ItemType> GetListEditor() = 0;
 
+    SdfLayerHandle GetBatchedLayer() const override { return _primSpec ? _primSpec->GetLayer() : SdfLayerHandle(); }
+
     SdfPrimSpecHandle _primSpec;
     SdfListOpType _operation;
     typename ItemType::value_type _item;
@@ -163,6 +170,8 @@ struct PrimReparent : public SdfLayerCommand {
         return false;
     }
 
+    SdfLayerHandle GetBatchedLayer() const override { return _layer; }
+
     SdfLayerHandle _layer;
     std::vector<SdfPath> _source;
     SdfPath _destination;
@@ -192,6 +201,7 @@ struct PrimCreateAttribute : public SdfLayerCommand {
         }
         return false;
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _owner ? _owner->GetLayer() : SdfLayerHandle(); }
     //
     SdfPrimSpecHandle _owner;
     std::string _name;
@@ -221,6 +231,7 @@ struct PrimCreateRelationship : public SdfLayerCommand {
         }
         return false;
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _owner ? _owner->GetLayer() : SdfLayerHandle(); }
     //
     SdfPrimSpecHandle _owner;
     std::string _name;
@@ -268,6 +279,8 @@ struct PrimReorder : public SdfLayerCommand {
         return false;
     }
 
+    SdfLayerHandle GetBatchedLayer() const override { return _prim ? _prim->GetLayer() : SdfLayerHandle(); }
+
     bool _up = true;
     SdfPrimSpecHandle _prim;
 };
@@ -284,6 +297,8 @@ struct PrimDuplicate : public SdfLayerCommand {
         return false;
     }
 
+    SdfLayerHandle GetBatchedLayer() const override { return _prim ? _prim->GetLayer() : SdfLayerHandle(); }
+
     std::string _newName;
     SdfPrimSpecHandle _prim;
 };
@@ -319,6 +334,7 @@ struct PrimCopy : public CopyPasteCommand {
         }
         return false;
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _copyPasteLayer; }
     SdfPrimSpecHandle _prim;
 };
 
@@ -343,6 +359,7 @@ struct PrimPaste : public CopyPasteCommand {
         }
         return false;
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _prim ? _prim->GetLayer() : SdfLayerHandle(); }
     SdfPrimSpecHandle _prim;
 };
 
@@ -360,6 +377,8 @@ struct PrimCreateAttributeConnection : public SdfLayerCommand {
         return true;
     }
 
+    SdfLayerHandle GetBatchedLayer() const override { return _attr ? _attr->GetLayer() : SdfLayerHandle(); }
+
     SdfAttributeSpecHandle _attr;
     SdfListOpType _operation = SdfListOpTypeExplicit;
     SdfPath _connectionEndPoint;
@@ -385,6 +404,7 @@ struct PropertyCopy : public CopyPasteCommand {
         }
         return false;
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _copyPasteLayer; }
     SdfPropertySpecHandle _prop;
 };
 template void ExecuteAfterDraw<PropertyCopy>(SdfPropertySpecHandle prop);
@@ -410,6 +430,7 @@ struct PropertyPaste : public CopyPasteCommand {
         }
         return false;
     }
+    SdfLayerHandle GetBatchedLayer() const override { return _prim ? _prim->GetLayer() : SdfLayerHandle(); }
     SdfPrimSpecHandle _prim;
 };
 template void ExecuteAfterDraw<PropertyPaste>(SdfPrimSpecHandle prim);
@@ -1,48 +1,178 @@
 #include <boost/range/adaptor/reversed.hpp> // why reverse adaptor is not in std ?? seriously ...
+#include <algorithm>
 #include <memory>
 #include <iostream>
+#include <pxr/usd/sdf/primSpec.h>
 #include "SdfCommandGroup.h"
 #include "SdfLayerInstructions.h"
 
 
 
+// The first blocks are small as most of the groups only contain a few instructions
+static constexpr size_t ArenaMinBlockSize = 512;
+static constexpr size_t ArenaMaxBlockSize = 64 * 1024;
+
+void *InstructionArena::Allocate(size_t size, size_t alignment) {
+    size_t offset = (_blockOffset + alignment - 1) & ~(alignment - 1);
+    if (_blocks.empty() || offset + size > _blockSize) {
+        const size_t blockSize = _blocks.empty() ? ArenaMinBlockSize : std::min(_blockSize * 2, ArenaMaxBlockSize);
+        _blockSize = std::max(size, blockSize);
+        _blocks.emplace_back(new char[_blockSize]);
+        _allocatedSize += _blockSize;
+        offset = 0;
+    }
+    _blockOffset = offset + size;
+    return _blocks.back().get() + offset;
+}
+
+void InstructionArena::Clear() {
+    _blocks.clear();
+    _blockSize = 0;
+    _blockOffset = 0;
+    _allocatedSize = 0;
+}
+
+SdfCommandGroup::~SdfCommandGroup() { Clear(); }
+
 bool SdfCommandGroup::IsEmpty() const { return _instructions.empty(); }
 
-void SdfCommandGroup::Clear() { _instructions.clear(); }
+void SdfCommandGroup::Clear() {
+    for (auto &entry : _instructions) {
+        entry.instruction->~InstructionInterface();
+    }
+    _instructions.clear();
+    _arena.Clear();
+    _layers.clear();
+    _coalescedInstructions.clear();
+}
+
+size_t SdfCommandGroup::GetLayerIndex(const SdfLayerHandle &layer) {
+    for (size_t i = _layers.size(); i > 0; --i) {
+        if (boost::get_pointer(_layers[i - 1]) == boost::get_pointer(layer)) {
+            return i - 1;
+        }
+    }
+    _layers.emplace_back(layer);
+    return _layers.size() - 1;
+}
+
+void SdfCommandGroup::SetCoalescing(bool coalescing) {
+    _coalescing = coalescing;
+    if (!_coalescing) {
+        _coalescedInstructions.clear();
+    }
+}
+
+size_t SdfCommandGroup::GetMemorySize() const {
+    size_t size = sizeof(SdfCommandGroup) + _instructions.capacity() * sizeof(InstructionEntry) + _arena.GetAllocatedSize();
+    for (const auto &entry : _instructions) {
+        size += entry.instruction->GetMemorySize();
+    }
+    return size;
+}
+
+// Each instruction has a prim in the journal layer, holding its values as fields
+static SdfPath GetJournalPath(const SdfPath &root, size_t instructionIndex) {
+    return root.AppendChild(TfToken("Instruction" + std::to_string(instructionIndex)));
+}
+
+bool SdfCommandGroup::SpillValues(SdfLayerHandle journal, const SdfPath &root) {
+    for (size_t i = 0; i < _instructions.size(); ++i) {
+        const SdfPath path = GetJournalPath(root, i);
+        SdfCreatePrimInLayer(journal, path);
+        if (!_instructions[i].instruction->SpillValues(journal, path)) {
+            // The values already moved are copied back from the journal
+            for (size_t j = 0; j < i; ++j) {
+                _instructions[j].instruction->ReloadValues(journal, GetJournalPath(root, j));
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SdfCommandGroup::ReloadValues(SdfLayerHandle journal, const SdfPath &root) {
+    bool reloaded = true;
+    for (size_t i = 0; i < _instructions.size(); ++i) {
+        reloaded = _instructions[i].instruction->ReloadValues(journal, GetJournalPath(root, i)) && reloaded;
+    }
+    return reloaded;
+}
+
+size_t SdfCommandGroup::InstructionKeyHash::operator()(const InstructionKey &key) const {
+    size_t hash = key.layerIndex;
+    const auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+    combine(SdfPath::Hash()(key.path));
+    combine(TfToken::HashFunctor()(key.field));
+    combine(std::hash<double>()(key.time));
+    return hash;
+}
+
+bool SdfCommandGroup::CoalesceInstruction(size_t layerIndex, UndoRedoSetField &inst) {
+    // Setting the whole time samples field would overwrite the time sample instructions stored before
+    if (inst._fieldName == SdfFieldKeys->TimeSamples) {
+        _coalescedInstructions.clear();
+        return false;
+    }
+    const InstructionKey key{layerIndex, inst._path, inst._fieldName, 0.0, false};
+    auto found = _coalescedInstructions.find(key);
+    if (found != _coalescedInstructions.end()) {
+        auto storage = static_cast<InstructionStorage<UndoRedoSetField> *>(_instructions[found->second].instruction);
+        storage->_data._newValue = std::move(inst._newValue);
+        return true;
+    }
+    _coalescedInstructions.emplace(key, _instructions.size());
+    return false;
+}
+
+bool SdfCommandGroup::CoalesceInstruction(size_t layerIndex, UndoRedoSetTimeSample &inst) {
+    const InstructionKey key{layerIndex, inst._path, TfToken(), inst._timeCode, true};
+    auto found = _coalescedInstructions.find(key);
+    if (found != _coalescedInstructions.end()) {
+        auto storage = static_cast<InstructionStorage<UndoRedoSetTimeSample> *>(_instructions[found->second].instruction);
+        storage->_data._newValue = std::move(inst._newValue);
+        return true;
+    }
+    _coalescedInstructions.emplace(key, _instructions.size());
+    return false;
+}
 
 template <typename InstructionT>
-void SdfCommandGroup::StoreInstruction(InstructionT inst) {
-    // TODO: specialize by InstructionT type to compact the instructions in the command,
-    // typically we don't want to store thousand of setField instruction where only the last one matters
-    // One optim would be to look for the previous instruction, check if it is a setfield on the same path, same layer ?
-    // Update the latest instruction instead of inserting a new instruction
-    // As StoreInstruction is templatized, it is possible to specialize it.
-    _instructions.emplace_back(std::move(inst));
-}
-
-
-template void SdfCommandGroup::StoreInstruction<UndoRedoSetField>(UndoRedoSetField inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoSetFieldDictValueByKey>(UndoRedoSetFieldDictValueByKey inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoSetTimeSample>(UndoRedoSetTimeSample inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoCreateSpec>(UndoRedoCreateSpec inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoDeleteSpec>(UndoRedoDeleteSpec inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoMoveSpec>(UndoRedoMoveSpec inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoPushChild<TfToken>>(UndoRedoPushChild<TfToken> inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoPushChild<SdfPath>>(UndoRedoPushChild<SdfPath> inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoPopChild<TfToken>>(UndoRedoPopChild<TfToken> inst);
-template void SdfCommandGroup::StoreInstruction<UndoRedoPopChild<SdfPath>>(UndoRedoPopChild<SdfPath> inst);
+void SdfCommandGroup::StoreInstruction(SdfLayerHandle layer, InstructionT inst) {
+    const size_t layerIndex = GetLayerIndex(layer);
+    if (_coalescing && CoalesceInstruction(layerIndex, inst)) {
+        return;
+    }
+    using StorageT = InstructionStorage<InstructionT>;
+    void *memory = _arena.Allocate(sizeof(StorageT), alignof(StorageT));
+    _instructions.push_back({new (memory) StorageT(std::move(inst)), layerIndex});
+}
+
+
+template void SdfCommandGroup::StoreInstruction<UndoRedoSetField>(SdfLayerHandle layer, UndoRedoSetField inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoSetFieldDictValueByKey>(SdfLayerHandle layer, UndoRedoSetFieldDictValueByKey inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoSetTimeSample>(SdfLayerHandle layer, UndoRedoSetTimeSample inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoCreateSpec>(SdfLayerHandle layer, UndoRedoCreateSpec inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoDeleteSpec>(SdfLayerHandle layer, UndoRedoDeleteSpec inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoMoveSpec>(SdfLayerHandle layer, UndoRedoMoveSpec inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoPushChild<TfToken>>(SdfLayerHandle layer, UndoRedoPushChild<TfToken> inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoPushChild<SdfPath>>(SdfLayerHandle layer, UndoRedoPushChild<SdfPath> inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoPopChild<TfToken>>(SdfLayerHandle layer, UndoRedoPopChild<TfToken> inst);
+template void SdfCommandGroup::StoreInstruction<UndoRedoPopChild<SdfPath>>(SdfLayerHandle layer, UndoRedoPopChild<SdfPath> inst);
 
 // Call all the functions stored in _commands in reverse order
 void SdfCommandGroup::UndoIt() {
     SdfChangeBlock block;
-    for (auto &cmd : boost::adaptors::reverse(_instructions)) {
-        cmd.UndoIt();
+    const std::vector<SdfLayerHandle> layers(_layers.begin(), _layers.end());
+    for (auto &entry : boost::adaptors::reverse(_instructions)) {
+        entry.instruction->UndoIt(layers[entry.layerIndex]);
     }
 }
 
 void SdfCommandGroup::DoIt() {
     SdfChangeBlock block;
-    for (auto &cmd : _instructions) {
-        cmd.DoIt();
+    const std::vector<SdfLayerHandle> layers(_layers.begin(), _layers.end());
+    for (auto &entry : _instructions) {
+        entry.instruction->DoIt(layers[entry.layerIndex]);
     }
 }
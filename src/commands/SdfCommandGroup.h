@@ -3,61 +3,71 @@
 #include <functional>
 #include <memory>
 #include <iostream>
+#include <unordered_map>
+#include <string>
+#include <pxr/base/tf/token.h>
+#include <pxr/usd/sdf/layer.h>
+#include <pxr/usd/sdf/path.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+struct UndoRedoSetField;
+struct UndoRedoSetTimeSample;
+
+/// Type erased instruction. The layer is not stored in the instructions but in their SdfCommandGroup
+/// and passed when the instruction is run
+struct InstructionInterface {
+    virtual ~InstructionInterface() = default;
+    virtual void DoIt(SdfLayerHandle layer) = 0;
+    virtual void UndoIt(SdfLayerHandle layer) = 0;
+    virtual size_t GetMemorySize() const = 0;
+    virtual bool SpillValues(SdfLayerHandle journal, const SdfPath &path) = 0;
+    virtual bool ReloadValues(SdfLayerHandle journal, const SdfPath &path) = 0;
+};
 
+template <typename InstructionT>
+struct InstructionStorage : InstructionInterface {
+    InstructionStorage(InstructionT &&inst) : _data(std::move(inst)) {}
+    ~InstructionStorage() override {}
 
-class InstructionWrapper {
-public:
-
-    template <typename InstructionT>
-    InstructionWrapper(InstructionT &&instruction) :
-        _ref(std::make_unique<Storage<InstructionT>>(std::move(instruction))) {
-        _ref->ShowIt();
-    }
-
-    void DoIt() {
-        _ref->DoIt();
-    }
-
-    void UndoIt() {
-        _ref->UndoIt();
-    }
+    void DoIt(SdfLayerHandle layer) override { _data.DoIt(layer); }
+    void UndoIt(SdfLayerHandle layer) override { _data.UndoIt(layer); }
+    size_t GetMemorySize() const override { return _data.GetMemorySize(); }
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &path) override { return _data.SpillValues(journal, path); }
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &path) override { return _data.ReloadValues(journal, path); }
 
-    void ShowIt() {
-        _ref->ShowIt();
-    }
-
-    struct Interface {
-        virtual ~Interface() = default;
-        virtual void DoIt() = 0;
-        virtual void UndoIt() = 0;
-        virtual void ShowIt() = 0;
-    };
+    InstructionT _data;
+};
 
-    template <typename InstructionT>
-    struct Storage : Interface {
-        Storage(InstructionT &&inst) : _data(std::move(inst)) {
-        }
-        virtual ~Storage(){}
-        void DoIt () override {
-            _data.DoIt();
-        }
-        void UndoIt () override {
-            _data.UndoIt();
-        }
+/// Bump allocator for the instructions of a SdfCommandGroup. Recording a big edit stores hundreds of thousands
+/// of instructions, they are allocated one after the other in blocks of growing size.
+/// The memory is only released with Clear, the owner is responsible for destroying the instructions before.
+class InstructionArena {
+  public:
+    InstructionArena() = default;
+    InstructionArena(const InstructionArena &) = delete;
+    InstructionArena &operator=(const InstructionArena &) = delete;
 
-        void ShowIt() override { }
+    void *Allocate(size_t size, size_t alignment);
+    void Clear();
 
-        InstructionT _data;
-    };
+    size_t GetAllocatedSize() const { return _allocatedSize; }
 
-    std::unique_ptr<Interface> _ref;
+  private:
+    std::vector<std::unique_ptr<char[]>> _blocks;
+    size_t _blockSize = 0;   // Size of the last block
+    size_t _blockOffset = 0; // First free byte in the last block
+    size_t _allocatedSize = 0;
 };
 
 class SdfCommandGroup {
 
 public:
     SdfCommandGroup() = default;
-    ~SdfCommandGroup() = default;
+    ~SdfCommandGroup();
+
+    SdfCommandGroup(const SdfCommandGroup &) = delete;
+    SdfCommandGroup &operator=(const SdfCommandGroup &) = delete;
 
     /// Was it recorded
     bool IsEmpty() const;
@@ -67,11 +77,67 @@ public:
     void DoIt();
     void UndoIt();
 
+    /// Stores an instruction recorded on layer
     template <typename InstructionT>
-    void StoreInstruction(InstructionT);
+    void StoreInstruction(SdfLayerHandle layer, InstructionT);
+
+    /// When coalescing, a field or time sample edited multiple times is stored only once, with the
+    /// first previous value and the last new value. This is used by the interactive editions, like the
+    /// manipulators, which set the same fields at each mouse move.
+    void SetCoalescing(bool coalescing);
+
+    /// Estimated memory used by the instructions
+    size_t GetMemorySize() const;
+
+    /// Moves the values of the instructions in a journal layer, under the root path, and releases them from memory.
+    /// Returns false and keeps all the values in memory if one of them can't be stored in the journal
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &root);
+
+    /// Reads back the values moved with SpillValues. Returns false if a value couldn't be read back
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &root);
 
 private:
-    std::vector<InstructionWrapper> _instructions;
+    // Identifies the value modified by a SetField or SetTimeSample instruction
+    struct InstructionKey {
+        size_t layerIndex;
+        SdfPath path;
+        TfToken field;
+        double time;
+        bool isTimeSample;
+        bool operator==(const InstructionKey &other) const {
+            return layerIndex == other.layerIndex && path == other.path && field == other.field && time == other.time &&
+                   isTimeSample == other.isTimeSample;
+        }
+    };
+    struct InstructionKeyHash {
+        size_t operator()(const InstructionKey &key) const;
+    };
+
+    // Returns true if the instruction was merged in a previously stored one
+    bool CoalesceInstruction(size_t layerIndex, UndoRedoSetField &inst);
+    bool CoalesceInstruction(size_t layerIndex, UndoRedoSetTimeSample &inst);
+    template <typename InstructionT>
+    bool CoalesceInstruction(size_t, InstructionT &) {
+        // The other instructions might depend on the values set before them, so the following
+        // edits can't be merged with the instructions stored before
+        _coalescedInstructions.clear();
+        return false;
+    }
+
+    size_t GetLayerIndex(const SdfLayerHandle &layer);
+
+    struct InstructionEntry {
+        InstructionInterface *instruction; // Allocated in _arena
+        size_t layerIndex;
+    };
+
+    // The layers are held once per group instead of once per instruction, there is usually only one
+    std::vector<SdfLayerRefPtr> _layers;
+    InstructionArena _arena;
+    std::vector<InstructionEntry> _instructions;
+    bool _coalescing = false;
+    // Index in _instructions of the coalesced instructions
+    std::unordered_map<InstructionKey, size_t, InstructionKeyHash> _coalescedInstructions;
 };
 
 
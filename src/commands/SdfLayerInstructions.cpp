@@ -1,50 +1,176 @@
 #include <iostream>
 #include <pxr/usd/sdf/path.h>
 #include <pxr/usd/sdf/abstractData.h>
+#include <pxr/usd/sdf/listOp.h>
+#include <pxr/usd/sdf/payload.h>
+#include <pxr/usd/sdf/primSpec.h>
+#include <pxr/usd/sdf/reference.h>
+#include <pxr/usd/sdf/schema.h>
+#include <pxr/usd/sdf/types.h>
 #include "SdfLayerInstructions.h"
 
-static void _CopySpec(const SdfAbstractData &src, SdfAbstractData *dst, const SdfPath &path) {
-    if (!dst) {
-        std::cerr << "ERROR: when copying the destination prim is null at path " << path.GetString() << std::endl;
-        return;
+size_t GetValueMemorySize(const VtValue &value) {
+    size_t size = 0;
+    if (value.IsArrayValued()) {
+        // The element size is found with the schema, for the types unknown to sdf we assume a double
+        const SdfValueTypeName typeName = SdfSchema::GetInstance().FindType(value);
+        const size_t elementSize = typeName ? typeName.GetScalarType().GetType().GetSizeof() : sizeof(double);
+        size = value.GetArraySize() * elementSize;
+    } else if (value.IsHolding<std::string>()) {
+        size = value.UncheckedGet<std::string>().size();
+    } else if (value.IsHolding<SdfTimeSampleMap>()) {
+        for (const auto &sample : value.UncheckedGet<SdfTimeSampleMap>()) {
+            size += sizeof(double) + GetValueMemorySize(sample.second);
+        }
+    } else if (value.IsHolding<VtDictionary>()) {
+        for (const auto &entry : value.UncheckedGet<VtDictionary>()) {
+            size += entry.first.size() + GetValueMemorySize(entry.second);
+        }
     }
-    dst->CreateSpec(path, src.GetSpecType(path));
-    const TfTokenVector &fields = src.List(path);
-    TF_FOR_ALL(i, fields) { dst->Set(path, *i, src.Get(path, *i)); }
+    return sizeof(VtValue) + size;
 }
 
-UndoRedoDeleteSpec::_SpecCopier::_SpecCopier(SdfAbstractData *dst_) : dst(dst_) {}
+// The attribute value types and the types of the metadata edited in usdtweak. The crate format can't write the
+// other types in an arbitrary field, SdfTimeSampleMap in particular is only written in the timeSamples field
+bool IsSpillableValue(const VtValue &value) {
+    if (value.IsEmpty() || SdfSchema::GetInstance().FindType(value)) {
+        return true;
+    }
+    if (value.IsHolding<VtDictionary>()) {
+        for (const auto &entry : value.UncheckedGet<VtDictionary>()) {
+            if (!IsSpillableValue(entry.second)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return value.IsHolding<SdfPath>() || value.IsHolding<TfTokenVector>() || value.IsHolding<std::vector<std::string>>() ||
+           value.IsHolding<SdfSpecifier>() || value.IsHolding<SdfVariability>() || value.IsHolding<SdfPermission>() ||
+           value.IsHolding<SdfValueBlock>() || value.IsHolding<SdfVariantSelectionMap>() ||
+           value.IsHolding<SdfPathListOp>() || value.IsHolding<SdfTokenListOp>() || value.IsHolding<SdfStringListOp>() ||
+           value.IsHolding<SdfReferenceListOp>() || value.IsHolding<SdfPayloadListOp>() || value.IsHolding<SdfIntListOp>() ||
+           value.IsHolding<SdfInt64ListOp>() || value.IsHolding<SdfUIntListOp>() || value.IsHolding<SdfUInt64ListOp>();
+}
 
-bool UndoRedoDeleteSpec::_SpecCopier::VisitSpec(const SdfAbstractData &src, const SdfPath &path) {
-    _CopySpec(src, dst, path);
-    return true;
+// The type of each value is stored next to it, to check that the value read back is the value written
+static TfToken GetTypeFieldName(const std::string &fieldName) { return TfToken("type:" + fieldName); }
+
+void SpillValue(SdfLayerHandle journal, const SdfPath &path, const std::string &fieldName, VtValue &value) {
+    if (!value.IsEmpty()) {
+        journal->SetField(path, GetTypeFieldName(fieldName), VtValue(value.GetTypeName()));
+        journal->SetField(path, TfToken(fieldName), value);
+        value = VtValue();
+    }
 }
 
-void UndoRedoDeleteSpec::_SpecCopier::Done(const SdfAbstractData &) {}
+bool ReloadValue(SdfLayerHandle journal, const SdfPath &path, const std::string &fieldName, VtValue &value) {
+    const VtValue typeName = journal->GetField(path, GetTypeFieldName(fieldName));
+    value = journal->GetField(path, TfToken(fieldName));
+    if (typeName.IsEmpty()) {
+        return value.IsEmpty(); // The value was empty
+    }
+    return typeName.IsHolding<std::string>() && typeName.UncheckedGet<std::string>() == value.GetTypeName();
+}
 
 UndoRedoDeleteSpec::UndoRedoDeleteSpec(SdfLayerHandle layer, const SdfPath &path, bool inert, SdfAbstractDataPtr layerData)
-    : _layer(layer), _path(path), _inert(inert), _deletedSpecType(_layer->GetSpecType(path)), _layerData(layerData) {
-    // TODO: is there a faster way of copying and restoring the data ?
-    // This can be really slow on big scenes
-    SdfChangeBlock changeBlock;
-    _deletedData = TfCreateRefPtr(new SdfData());
-    SdfLayer::TraversalFunction copyFunc = std::bind(&_CopySpec, std::cref(*boost::get_pointer(_layerData)),
-                                                     boost::get_pointer(_deletedData), std::placeholders::_1);
-    _layer->Traverse(path, copyFunc);
+    : _path(path), _inert(inert), _layerData(layerData), _deletedSpecType(layer->GetSpecType(path)) {
+    // The deleted specs must be captured before the deletion, every field of every spec is still read. Compared to
+    // copying the specs in a new SdfData, this only saves creating the specs and inserting their fields in hash maps.
+    // In both cases the arrays share their buffer with the layer, the strings, dictionaries and list ops are copied.
+    const SdfAbstractData &data = *boost::get_pointer(_layerData);
+    layer->Traverse(path, [&](const SdfPath &specPath) {
+        _deletedSpecs.emplace_back();
+        DeletedSpec &deletedSpec = _deletedSpecs.back();
+        deletedSpec.path = specPath;
+        deletedSpec.specType = data.GetSpecType(specPath);
+        const TfTokenVector fields = data.List(specPath);
+        deletedSpec.fields.reserve(fields.size());
+        for (const TfToken &field : fields) {
+            deletedSpec.fields.emplace_back(field, data.Get(specPath, field));
+        }
+    });
 }
 
-
-void UndoRedoDeleteSpec::DoIt() {
-    if (_layer && _layer->GetStateDelegate()) {
-        _layer->GetStateDelegate()->DeleteSpec(_path, _inert);
+void UndoRedoDeleteSpec::DoIt(SdfLayerHandle layer) {
+    if (layer && layer->GetStateDelegate()) {
+        layer->GetStateDelegate()->DeleteSpec(_path, _inert);
     }
 }
 
-void UndoRedoDeleteSpec::UndoIt() {
-    if (_layer && _layer->GetStateDelegate()) {
+void UndoRedoDeleteSpec::UndoIt(SdfLayerHandle layer) {
+    if (layer && layer->GetStateDelegate() && _layerData) {
         SdfChangeBlock changeBlock;
-        _SpecCopier copier(boost::get_pointer(_layerData));
-        _layer->GetStateDelegate()->CreateSpec(_path, _deletedSpecType, _inert);
-        _deletedData->VisitSpecs(&copier);
+        layer->GetStateDelegate()->CreateSpec(_path, _deletedSpecType, _inert);
+        // The specs are written directly in the layer data, the creation of the root spec sends the notification
+        for (const DeletedSpec &deletedSpec : _deletedSpecs) {
+            _layerData->CreateSpec(deletedSpec.path, deletedSpec.specType);
+            for (const auto &field : deletedSpec.fields) {
+                _layerData->Set(deletedSpec.path, field.first, field.second);
+            }
+        }
+    }
+}
+
+// The deleted specs are stored in the journal as children of the instruction prim, their fields are prefixed
+// to avoid clashing with the fields of the journal prims
+static const char *DeletedSpecFieldPrefix = "field:";
+
+size_t UndoRedoDeleteSpec::GetMemorySize() const {
+    size_t size = sizeof(*this) + _deletedSpecs.capacity() * sizeof(DeletedSpec);
+    for (const DeletedSpec &deletedSpec : _deletedSpecs) {
+        size += deletedSpec.fields.capacity() * sizeof(DeletedSpec::Field);
+        for (const auto &field : deletedSpec.fields) {
+            size += GetValueMemorySize(field.second) - sizeof(VtValue);
+        }
+    }
+    return size;
+}
+
+bool UndoRedoDeleteSpec::SpillValues(SdfLayerHandle journal, const SdfPath &path) {
+    // The deleted attributes with time samples stay in memory
+    for (const DeletedSpec &deletedSpec : _deletedSpecs) {
+        for (const auto &field : deletedSpec.fields) {
+            if (!IsSpillableValue(field.second)) {
+                return false;
+            }
+        }
+    }
+    for (size_t i = 0; i < _deletedSpecs.size(); ++i) {
+        const DeletedSpec &deletedSpec = _deletedSpecs[i];
+        const SdfPath journalPath = path.AppendChild(TfToken("Spec" + std::to_string(i)));
+        SdfCreatePrimInLayer(journal, journalPath);
+        journal->SetField(journalPath, TfToken("specPath"), VtValue(deletedSpec.path));
+        journal->SetField(journalPath, TfToken("specType"), VtValue(static_cast<int>(deletedSpec.specType)));
+        for (const auto &field : deletedSpec.fields) {
+            VtValue value = field.second;
+            SpillValue(journal, journalPath, DeletedSpecFieldPrefix + field.first.GetString(), value);
+        }
+    }
+    std::vector<DeletedSpec>().swap(_deletedSpecs);
+    return true;
+}
+
+bool UndoRedoDeleteSpec::ReloadValues(SdfLayerHandle journal, const SdfPath &path) {
+    _deletedSpecs.clear();
+    SdfPrimSpecHandle instructionSpec = journal->GetPrimAtPath(path);
+    if (!instructionSpec) {
+        return false;
+    }
+    bool reloaded = true;
+    const std::string prefix(DeletedSpecFieldPrefix);
+    for (const SdfPrimSpecHandle &journalSpec : instructionSpec->GetNameChildren()) {
+        const SdfPath &journalPath = journalSpec->GetPath();
+        _deletedSpecs.emplace_back();
+        DeletedSpec &deletedSpec = _deletedSpecs.back();
+        deletedSpec.path = journal->GetFieldAs<SdfPath>(journalPath, TfToken("specPath"));
+        deletedSpec.specType = static_cast<SdfSpecType>(journal->GetFieldAs<int>(journalPath, TfToken("specType")));
+        for (const TfToken &field : journal->ListFields(journalPath)) {
+            if (field.GetString().compare(0, prefix.size(), prefix) == 0) {
+                VtValue value;
+                reloaded = ReloadValue(journal, journalPath, field.GetString(), value) && reloaded;
+                deletedSpec.fields.emplace_back(TfToken(field.GetString().substr(prefix.size())), std::move(value));
+            }
+        }
     }
+    return reloaded;
 }
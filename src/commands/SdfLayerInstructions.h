@@ -7,26 +7,57 @@
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+// Besides DoIt and UndoIt, the instructions provide an estimation of their memory size and can move their values
+// in a journal layer stored on disk when the undo stack exceeds its memory budget.
+
+/// Estimated memory used by a value, the arrays are counted as if they were not shared
+size_t GetValueMemorySize(const VtValue &value);
+
+/// True if the value can be stored in any field of a usdc journal. The time samples can only be stored in the
+/// timeSamples field, the instructions holding them stay in memory
+bool IsSpillableValue(const VtValue &value);
+
+/// Moves a spillable value in a field of the journal layer, the value is released
+void SpillValue(SdfLayerHandle journal, const SdfPath &path, const std::string &fieldName, VtValue &value);
+
+/// Reads back a value moved with SpillValue. Returns false if the value read doesn't have the type of the value moved
+bool ReloadValue(SdfLayerHandle journal, const SdfPath &path, const std::string &fieldName, VtValue &value);
+
 struct UndoRedoSetField {
-    UndoRedoSetField(SdfLayerHandle layer, const SdfPath& path, const TfToken& fieldName, VtValue newValue, VtValue previousValue )
-        : _layer(layer), _path(path), _fieldName(fieldName), _newValue(std::move(newValue)), _previousValue(std::move(previousValue)) {}
+    UndoRedoSetField(const SdfPath& path, const TfToken& fieldName, VtValue newValue, VtValue previousValue )
+        : _path(path), _fieldName(fieldName), _newValue(std::move(newValue)), _previousValue(std::move(previousValue)) {}
 
     UndoRedoSetField(UndoRedoSetField &&) = default;
     ~UndoRedoSetField() = default;
 
-    void DoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetField(_path, _fieldName, _newValue);
+    void DoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->SetField(_path, _fieldName, _newValue);
         }
     }
 
-    void UndoIt() {
-        if (_layer && _layer->GetStateDelegate()){
-            _layer->GetStateDelegate()->SetField(_path, _fieldName, _previousValue);
+    void UndoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()){
+            layer->GetStateDelegate()->SetField(_path, _fieldName, _previousValue);
         }
     }
 
-    SdfLayerRefPtr _layer;
+    size_t GetMemorySize() const { return sizeof(*this) + GetValueMemorySize(_newValue) + GetValueMemorySize(_previousValue); }
+
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &path) {
+        if (!IsSpillableValue(_newValue) || !IsSpillableValue(_previousValue)) {
+            return false;
+        }
+        SpillValue(journal, path, "newValue", _newValue);
+        SpillValue(journal, path, "previousValue", _previousValue);
+        return true;
+    }
+
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &path) {
+        const bool newValueReloaded = ReloadValue(journal, path, "newValue", _newValue);
+        return ReloadValue(journal, path, "previousValue", _previousValue) && newValueReloaded;
+    }
+
     const SdfPath _path;
     const TfToken _fieldName;
     VtValue _newValue;
@@ -35,25 +66,40 @@ struct UndoRedoSetField {
 
 
 struct UndoRedoSetFieldDictValueByKey {
-    UndoRedoSetFieldDictValueByKey(SdfLayerHandle layer, const SdfPath &path, const TfToken& fieldName, const TfToken& keyPath, VtValue value, VtValue previousValue)
-        :_layer(layer), _path(path), _fieldName(fieldName), _keyPath(keyPath), _newValue(std::move(value)), _previousValue(previousValue) {}
+    UndoRedoSetFieldDictValueByKey(const SdfPath &path, const TfToken& fieldName, const TfToken& keyPath, VtValue value, VtValue previousValue)
+        : _path(path), _fieldName(fieldName), _keyPath(keyPath), _newValue(std::move(value)), _previousValue(previousValue) {}
 
     UndoRedoSetFieldDictValueByKey(UndoRedoSetFieldDictValueByKey &&) = default;
     ~UndoRedoSetFieldDictValueByKey() = default;
 
-    void DoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetFieldDictValueByKey(_path, _fieldName, _keyPath, _newValue);
+    void DoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->SetFieldDictValueByKey(_path, _fieldName, _keyPath, _newValue);
         }
     }
 
-    void UndoIt() {
-        if (_layer && _layer->GetStateDelegate()){
-            _layer->GetStateDelegate()->SetFieldDictValueByKey(_path, _fieldName, _keyPath, _previousValue);
+    void UndoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()){
+            layer->GetStateDelegate()->SetFieldDictValueByKey(_path, _fieldName, _keyPath, _previousValue);
+        }
+    }
+
+    size_t GetMemorySize() const { return sizeof(*this) + GetValueMemorySize(_newValue) + GetValueMemorySize(_previousValue); }
+
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &path) {
+        if (!IsSpillableValue(_newValue) || !IsSpillableValue(_previousValue)) {
+            return false;
         }
+        SpillValue(journal, path, "newValue", _newValue);
+        SpillValue(journal, path, "previousValue", _previousValue);
+        return true;
+    }
+
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &path) {
+        const bool newValueReloaded = ReloadValue(journal, path, "newValue", _newValue);
+        return ReloadValue(journal, path, "previousValue", _previousValue) && newValueReloaded;
     }
 
-    SdfLayerRefPtr _layer;
     const SdfPath _path;
     const TfToken _fieldName;
     const TfToken _keyPath;
@@ -64,39 +110,54 @@ struct UndoRedoSetFieldDictValueByKey {
 
 struct UndoRedoSetTimeSample {
     UndoRedoSetTimeSample(SdfLayerHandle layer, const SdfPath &path, double timeCode, VtValue newValue)
-        : _layer(layer), _path(path), _timeCode(timeCode), _newValue(std::move(newValue)), _isKeyFrame(false),
+        : _path(path), _timeCode(timeCode), _newValue(std::move(newValue)), _isKeyFrame(false),
           _hasTimeSamples(false) {
 
-        if (_layer && _layer->HasField(path, SdfFieldKeys->TimeSamples)) {
+        if (layer && layer->HasField(path, SdfFieldKeys->TimeSamples)) {
             _hasTimeSamples = true;
-            _isKeyFrame = _layer->QueryTimeSample(_path, _timeCode, &_previousValue);
+            _isKeyFrame = layer->QueryTimeSample(_path, _timeCode, &_previousValue);
         }
     }
     ~UndoRedoSetTimeSample() = default;
     UndoRedoSetTimeSample(UndoRedoSetTimeSample &&) = default;
 
-    void DoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->SetTimeSample(_path, _timeCode, _newValue);
+    void DoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->SetTimeSample(_path, _timeCode, _newValue);
         }
     }
 
-    void UndoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
+    void UndoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
             if (_hasTimeSamples && _isKeyFrame) {
-                _layer->GetStateDelegate()->SetTimeSample(_path, _timeCode, _previousValue);
+                layer->GetStateDelegate()->SetTimeSample(_path, _timeCode, _previousValue);
             } else if (_hasTimeSamples && !_isKeyFrame) {
-                _layer->EraseTimeSample(_path, _timeCode);
+                layer->EraseTimeSample(_path, _timeCode);
             } else if (!_hasTimeSamples) {
-                _layer->GetStateDelegate()->SetField(_path, SdfFieldKeys->TimeSamples, _previousValue);
+                layer->GetStateDelegate()->SetField(_path, SdfFieldKeys->TimeSamples, _previousValue);
             } else {
                 // This shouldn't happen
             }
         }
     }
 
+    size_t GetMemorySize() const { return sizeof(*this) + GetValueMemorySize(_newValue) + GetValueMemorySize(_previousValue); }
+
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &path) {
+        if (!IsSpillableValue(_newValue) || !IsSpillableValue(_previousValue)) {
+            return false;
+        }
+        SpillValue(journal, path, "newValue", _newValue);
+        SpillValue(journal, path, "previousValue", _previousValue);
+        return true;
+    }
+
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &path) {
+        const bool newValueReloaded = ReloadValue(journal, path, "newValue", _newValue);
+        return ReloadValue(journal, path, "previousValue", _previousValue) && newValueReloaded;
+    }
+
     // TODO: look for reducing the size of this struct
-    SdfLayerRefPtr _layer;
     const SdfPath _path;
     double _timeCode;
     VtValue _newValue;
@@ -107,22 +168,25 @@ struct UndoRedoSetTimeSample {
 
 
 struct UndoRedoCreateSpec {
-    UndoRedoCreateSpec(SdfLayerHandle layer, const SdfPath& path, SdfSpecType specType, bool inert)
-        : _layer(layer), _path(path), _specType(specType), _inert(inert) {}
+    UndoRedoCreateSpec(const SdfPath& path, SdfSpecType specType, bool inert)
+        : _path(path), _specType(specType), _inert(inert) {}
 
-    void DoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->CreateSpec(_path, _specType, _inert);
+    void DoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->CreateSpec(_path, _specType, _inert);
         }
     }
 
-    void UndoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->DeleteSpec(_path, _inert);
+    void UndoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->DeleteSpec(_path, _inert);
         }
     }
 
-    SdfLayerRefPtr _layer;
+    size_t GetMemorySize() const { return sizeof(*this); }
+    bool SpillValues(SdfLayerHandle, const SdfPath &) { return true; }
+    bool ReloadValues(SdfLayerHandle, const SdfPath &) { return true; }
+
     const SdfPath _path;
     const SdfSpecType _specType;
     const bool _inert;
@@ -131,73 +195,80 @@ struct UndoRedoCreateSpec {
 
 struct UndoRedoDeleteSpec {
 
-    // Need a structure to copy the old data
-    struct _SpecCopier : public SdfAbstractDataSpecVisitor {
-        explicit _SpecCopier(SdfAbstractData* dst_);
-        bool VisitSpec(const SdfAbstractData& src, const SdfPath& path) override;
-        void Done(const SdfAbstractData&) override;
-
-        SdfAbstractData* const dst;
+    // Fields of a spec of the deleted hierarchy
+    struct DeletedSpec {
+        using Field = std::pair<TfToken, VtValue>;
+        SdfPath path;
+        SdfSpecType specType;
+        std::vector<Field> fields;
     };
 
-
     UndoRedoDeleteSpec(SdfLayerHandle layer, const SdfPath &path, bool inert, SdfAbstractDataPtr layerData);
 
-    void DoIt();
-    void UndoIt();
+    void DoIt(SdfLayerHandle layer);
+    void UndoIt(SdfLayerHandle layer);
+
+    size_t GetMemorySize() const;
+    bool SpillValues(SdfLayerHandle journal, const SdfPath &path);
+    bool ReloadValues(SdfLayerHandle journal, const SdfPath &path);
 
-    SdfLayerRefPtr _layer;
     const SdfPath _path;
     const bool _inert;
 
     SdfAbstractDataPtr _layerData; // TODO: this might change ? isn't it ? normally it's retrieved from the delegate
     const SdfSpecType _deletedSpecType;
-    SdfDataRefPtr _deletedData;
+    std::vector<DeletedSpec> _deletedSpecs;
 };
 
 
 struct UndoRedoMoveSpec {
 
-    UndoRedoMoveSpec(SdfLayerHandle layer, const SdfPath &oldPath, const SdfPath &newPath)
-    : _layer(layer), _oldPath(oldPath), _newPath(newPath) {}
+    UndoRedoMoveSpec(const SdfPath &oldPath, const SdfPath &newPath)
+    : _oldPath(oldPath), _newPath(newPath) {}
 
 
-    void DoIt() {
-        if (_layer && _layer->GetStateDelegate()){
-            _layer->GetStateDelegate()->MoveSpec(_oldPath, _newPath);
+    void DoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()){
+            layer->GetStateDelegate()->MoveSpec(_oldPath, _newPath);
         }
 
     };
-    void UndoIt() {
-        if (_layer && _layer->GetStateDelegate()){
-            _layer->GetStateDelegate()->MoveSpec(_newPath, _oldPath);
+    void UndoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()){
+            layer->GetStateDelegate()->MoveSpec(_newPath, _oldPath);
         }
     };
 
-    SdfLayerRefPtr _layer;
+    size_t GetMemorySize() const { return sizeof(*this); }
+    bool SpillValues(SdfLayerHandle, const SdfPath &) { return true; }
+    bool ReloadValues(SdfLayerHandle, const SdfPath &) { return true; }
+
     const SdfPath _oldPath;
     const SdfPath _newPath;
 };
 
 template <typename ValueT>
 struct UndoRedoPushChild {
-    UndoRedoPushChild(SdfLayerHandle layer, const SdfPath& parentPath, const TfToken& fieldName, const ValueT& value)
-        : _layer(layer), _parentPath(parentPath), _fieldName(fieldName), _value(value) {}
+    UndoRedoPushChild(const SdfPath& parentPath, const TfToken& fieldName, const ValueT& value)
+        : _parentPath(parentPath), _fieldName(fieldName), _value(value) {}
 
 
-    void UndoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PopChild(_parentPath, _fieldName, _value);
+    void UndoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PopChild(_parentPath, _fieldName, _value);
         }
     }
 
-    void DoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PushChild(_parentPath, _fieldName, _value);
+    void DoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PushChild(_parentPath, _fieldName, _value);
         }
     }
 
-    SdfLayerRefPtr _layer;
+    size_t GetMemorySize() const { return sizeof(*this); }
+    bool SpillValues(SdfLayerHandle, const SdfPath &) { return true; }
+    bool ReloadValues(SdfLayerHandle, const SdfPath &) { return true; }
+
     const SdfPath _parentPath;
     const TfToken _fieldName;
     const ValueT _value;
@@ -205,23 +276,26 @@ struct UndoRedoPushChild {
 
 template <typename ValueT>
 struct UndoRedoPopChild {
-    UndoRedoPopChild(SdfLayerHandle layer, const SdfPath& parentPath, const TfToken& fieldName, const ValueT& value)
-        : _layer(layer), _parentPath(parentPath), _fieldName(fieldName), _value(value) {}
+    UndoRedoPopChild(const SdfPath& parentPath, const TfToken& fieldName, const ValueT& value)
+        : _parentPath(parentPath), _fieldName(fieldName), _value(value) {}
 
 
-    void UndoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PushChild(_parentPath, _fieldName, _value);
+    void UndoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PushChild(_parentPath, _fieldName, _value);
         }
     }
 
-    void DoIt() {
-        if (_layer && _layer->GetStateDelegate()) {
-            _layer->GetStateDelegate()->PopChild(_parentPath, _fieldName, _value);
+    void DoIt(SdfLayerHandle layer) {
+        if (layer && layer->GetStateDelegate()) {
+            layer->GetStateDelegate()->PopChild(_parentPath, _fieldName, _value);
         }
     }
 
-    SdfLayerRefPtr _layer;
+    size_t GetMemorySize() const { return sizeof(*this); }
+    bool SpillValues(SdfLayerHandle, const SdfPath &) { return true; }
+    bool ReloadValues(SdfLayerHandle, const SdfPath &) { return true; }
+
     const SdfPath _parentPath;
     const TfToken _fieldName;
     const ValueT _value;
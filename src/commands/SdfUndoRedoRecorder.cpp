@@ -16,6 +16,8 @@ void SdfUndoRedoRecorder::StartRecording() {
         if (!_editedCommand) {
             _editedCommand = new SdfUndoRedoCommand();
         }
+        // Interactive editions set the same values many times, only the first and last values are kept
+        _editedCommand->_undoCommands.SetCoalescing(true);
         // Install undo/redo delegate
         _layer->SetStateDelegate(UndoRedoLayerStateDelegate::New(_editedCommand->_undoCommands));
     }
@@ -25,4 +27,7 @@ void SdfUndoRedoRecorder::StopRecording() {
     if (_layer && _previousDelegate) {
         _layer->SetStateDelegate(_previousDelegate);
     }
+    if (_editedCommand) {
+        _editedCommand->_undoCommands.SetCoalescing(false);
+    }
 }
@@ -91,7 +91,7 @@ UndoRedoLayerStateDelegate::_OnSetField(
     SetDirty();
     const VtValue previousValue = _layer->GetField(path, fieldName);
     const VtValue newValue = value;
-    _undoCommands.StoreInstruction<UndoRedoSetField>({_layer, path, fieldName, newValue, previousValue});
+    _undoCommands.StoreInstruction<UndoRedoSetField>(_layer, {path, fieldName, newValue, previousValue});
 }
 
 void
@@ -104,7 +104,7 @@ UndoRedoLayerStateDelegate::_OnSetField(
     const VtValue previousValue = _layer->GetField(path, fieldName);
     VtValue newValue;
     value.GetValue(&newValue);
-    _undoCommands.StoreInstruction<UndoRedoSetField>({_layer, path, fieldName, newValue, previousValue});
+    _undoCommands.StoreInstruction<UndoRedoSetField>(_layer, {path, fieldName, newValue, previousValue});
 }
 
 void
@@ -117,7 +117,7 @@ UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
     SetDirty();
     const VtValue previousValue = _layer->GetFieldDictValueByKey(path, fieldName, keyPath); // TODO should the instruction retrieve the value instead ?
     const VtValue newValue = value;
-    _undoCommands.StoreInstruction<UndoRedoSetFieldDictValueByKey>({_layer, path, fieldName, keyPath, newValue, previousValue});
+    _undoCommands.StoreInstruction<UndoRedoSetFieldDictValueByKey>(_layer, {path, fieldName, keyPath, newValue, previousValue});
 }
 
 void
@@ -132,7 +132,7 @@ UndoRedoLayerStateDelegate::_OnSetFieldDictValueByKey(
 
     VtValue newValue;
     value.GetValue(&newValue);
-    _undoCommands.StoreInstruction<UndoRedoSetFieldDictValueByKey>({_layer, path, fieldName, keyPath, newValue, previousValue});
+    _undoCommands.StoreInstruction<UndoRedoSetFieldDictValueByKey>(_layer, {path, fieldName, keyPath, newValue, previousValue});
 }
 
 void
@@ -142,7 +142,7 @@ UndoRedoLayerStateDelegate::_OnSetTimeSample(
     const VtValue& value)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoSetTimeSample>({_layer, path, timeCode, value});
+    _undoCommands.StoreInstruction<UndoRedoSetTimeSample>(_layer, {_layer, path, timeCode, value});
 }
 
 void
@@ -155,7 +155,7 @@ UndoRedoLayerStateDelegate::_OnSetTimeSample(
     VtValue newValue;
     value.GetValue(&newValue);
 
-    _undoCommands.StoreInstruction<UndoRedoSetTimeSample>({_layer, path, timeCode, newValue});
+    _undoCommands.StoreInstruction<UndoRedoSetTimeSample>(_layer, {_layer, path, timeCode, newValue});
 }
 
 void
@@ -165,7 +165,7 @@ UndoRedoLayerStateDelegate::_OnCreateSpec(
     bool inert)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoCreateSpec>({_layer, path, specType, inert});
+    _undoCommands.StoreInstruction<UndoRedoCreateSpec>(_layer, {path, specType, inert});
 }
 
 void
@@ -175,7 +175,7 @@ UndoRedoLayerStateDelegate::_OnDeleteSpec(
 {
     SetDirty();
 
-    _undoCommands.StoreInstruction<UndoRedoDeleteSpec>({_layer, path,  inert, _GetLayerData()});
+    _undoCommands.StoreInstruction<UndoRedoDeleteSpec>(_layer, {_layer, path,  inert, _GetLayerData()});
 
 }
 
@@ -185,7 +185,7 @@ UndoRedoLayerStateDelegate::_OnMoveSpec(
     const SdfPath& newPath)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoMoveSpec>({_layer, oldPath, newPath});
+    _undoCommands.StoreInstruction<UndoRedoMoveSpec>(_layer, {oldPath, newPath});
 }
 
 void
@@ -195,7 +195,7 @@ UndoRedoLayerStateDelegate::_OnPushChild(
     const TfToken& value)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPushChild<TfToken>>({_layer, parentPath, fieldName, value});
+    _undoCommands.StoreInstruction<UndoRedoPushChild<TfToken>>(_layer, {parentPath, fieldName, value});
 }
 
 void
@@ -205,7 +205,7 @@ UndoRedoLayerStateDelegate::_OnPushChild(
     const SdfPath& value)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPushChild<SdfPath>>({_layer, parentPath, fieldName, value});
+    _undoCommands.StoreInstruction<UndoRedoPushChild<SdfPath>>(_layer, {parentPath, fieldName, value});
 }
 
 void
@@ -215,7 +215,7 @@ UndoRedoLayerStateDelegate::_OnPopChild(
     const TfToken& oldValue)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPopChild<TfToken>>({_layer, parentPath, fieldName, oldValue});
+    _undoCommands.StoreInstruction<UndoRedoPopChild<TfToken>>(_layer, {parentPath, fieldName, oldValue});
 }
 
 void
@@ -225,7 +225,7 @@ UndoRedoLayerStateDelegate::_OnPopChild(
     const SdfPath& oldValue)
 {
     SetDirty();
-    _undoCommands.StoreInstruction<UndoRedoPopChild<SdfPath>>({_layer, parentPath, fieldName, oldValue});
+    _undoCommands.StoreInstruction<UndoRedoPopChild<SdfPath>>(_layer, {parentPath, fieldName, oldValue});
 }
 
 
@@ -1,7 +1,9 @@
 
 // clang-format off
 #include <iostream>
+#include <chrono>
 #include <cstdlib>
+#include <thread>
 #ifdef WANTS_PYTHON
 #include <Python.h>
 #endif
@@ -17,7 +19,9 @@
 #include "Constants.h"
 #include "ResourcesLoader.h"
 #include "CommandLineOptions.h"
+#include "BatchMode.h"
 #include "Gui.h"
+#include "Profiler.h"
 
 #ifdef _WIN64
 #include<process.h>
@@ -27,6 +31,10 @@
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+// In idle redraw mode, the ui is still drawn at this interval for the tooltips, the text cursor and the progress of
+// the background tasks. The hydra viewport is only rendered when it needs to
+static constexpr double IdleRedrawInterval = 0.5; // seconds
+
 // https://learn.microsoft.com/en-us/windows/win32/procthread/changing-environment-variables
 #ifdef _WIN64
 static std::vector<char *> ArchCurrentEnviron() {
@@ -57,6 +65,14 @@ static bool InstallApplicationPluginPaths(const std::vector<std::string> &plugin
 int main(int argc, char *const *argv) {
 
     CommandLineOptions options(argc, argv);
+    if (!options.isValid()) {
+        return EXIT_FAILURE;
+    }
+
+    // The batch mode doesn't need any window or ui resources
+    if (options.batchMode()) {
+        return RunBatchMode(options);
+    }
 
     // ResourceLoader will load the settings/fonts/textures and create an imgui context
     ResourcesLoader loader;
@@ -152,41 +168,73 @@ int main(int argc, char *const *argv) {
 
         // Loop until the user closes the window
         while (!editor.IsShutdown()) {
+            const bool idleRedraw = editor.IsIdleRedrawEnabled();
+            if (idleRedraw && !editor.IsRedrawNeeded()) {
+                // Block until an event arrives, a redraw is requested or the idle interval expires
+                glfwWaitEventsTimeout(IdleRedrawInterval);
+            }
+            const auto frameStart = std::chrono::steady_clock::now();
+            Profiler::GetInstance().BeginFrame();
+            // The frame scope ends before the frame rate limit, the profiler only measures the work of the frame
+            {
+                PROFILE_SCOPE("Frame");
+
+                // Poll and process events
+                glfwMakeContextCurrent(window);
+                glfwPollEvents();
+                // The imgui glfw callbacks queue the input events in the main context until the next NewFrame
+                if (mainUIContext->InputEventsQueue.Size > 0) {
+                    editor.RequestRedraw();
+                }
 
-            // Poll and process events
-            glfwMakeContextCurrent(window);
-            glfwPollEvents();
-
-            // Render the viewports first as textures
-            ImGui_ImplGlfw_RestoreCallbacks(window);
-            ImGui::SetCurrentContext(hydraUIContext);
-            editor.HydraRender(); // RenderViewports
-
-            // Render GUI next
-            ImGui::SetCurrentContext(mainUIContext);
-            ImGui_ImplGlfw_InstallCallbacks(window);
-            glfwGetFramebufferSize(window, &width, &height);
-            glViewport(0, 0, width, height);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            ImGui_ImplOpenGL3_NewFrame();
-            ImGui_ImplGlfw_NewFrame();
-            ImGui::NewFrame();
-            editor.Draw();
-            ImGui::Render();
-            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                // Render the viewports first as textures
+                ImGui_ImplGlfw_RestoreCallbacks(window);
+                ImGui::SetCurrentContext(hydraUIContext);
+                if (!idleRedraw || editor.IsRedrawNeeded()) {
+                    editor.HydraRender(); // RenderViewports
+                }
 
+                // Render GUI next
+                ImGui::SetCurrentContext(mainUIContext);
+                ImGui_ImplGlfw_InstallCallbacks(window);
+                glfwGetFramebufferSize(window, &width, &height);
+                glViewport(0, 0, width, height);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                ImGui_ImplOpenGL3_NewFrame();
+                ImGui_ImplGlfw_NewFrame();
+                ImGui::NewFrame();
+                editor.Draw();
+                {
+                    PROFILE_SCOPE("ImGui render");
+                    ImGui::Render();
+                    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+                }
+                {
+                    PROFILE_SCOPE("Swap buffers");
 #ifndef DISABLE_DOUBLE_BUFFER
-            // Swap front and back buffers
-            glfwSwapBuffers(window);
+                    // Swap front and back buffers
+                    glfwSwapBuffers(window);
 #else
-            glFlush();
+                    glFlush();
 #endif
-            // This forces to wait for the gpu commands to finish.
-            // Normally not required but it fixes a pcoip driver issue
-            glFinish();
+                    // This forces to wait for the gpu commands to finish.
+                    // Normally not required but it fixes a pcoip driver issue
+                    glFinish();
+                }
+                editor.OnFrameDrawn();
+
+                // Process edition commands
+                {
+                    PROFILE_SCOPE("Execute commands");
+                    const auto stageLock = editor.GetPrimSearchIndex().LockStage();
+                    ExecuteCommands();
+                }
+            }
 
-            // Process edition commands
-            ExecuteCommands();
+            // Frame rate limit
+            if (editor.GetMaxFrameRate() > 0) {
+                std::this_thread::sleep_until(frameStart + std::chrono::duration<double>(1.0 / editor.GetMaxFrameRate()));
+            }
         }
         editor.RemoveCallbacks(window);
     }
@@ -0,0 +1,133 @@
+#include <pxr/base/work/loops.h>
+#include <pxr/usd/usdGeom/bboxCache.h>
+#include <pxr/usd/usdGeom/imageable.h>
+#include "BoundingBoxCache.h"
+
+// The bounds of the other time codes are discarded when there are more, typically during playback
+static constexpr size_t MaxTimeCodes = 16;
+
+// Above this number of changed paths, comparing them with every cached bound is slower than clearing the cache
+static constexpr size_t MaxInvalidatedPaths = 1024;
+
+BoundingBoxCache::BoundingBoxCache() : _purposes(UsdGeomImageable::GetOrderedPurposeTokens()) {}
+
+BoundingBoxCache::~BoundingBoxCache() { TfNotice::Revoke(_objectsChangedKey); }
+
+void BoundingBoxCache::SetStage(UsdStageRefPtr stage) {
+    if (stage == _stage) {
+        return;
+    }
+    TfNotice::Revoke(_objectsChangedKey);
+    _stage = stage;
+    Clear();
+    if (_stage) {
+        _objectsChangedKey =
+            TfNotice::Register(TfCreateWeakPtr(this), &BoundingBoxCache::OnObjectsChanged, UsdStageWeakPtr(_stage));
+    }
+}
+
+void BoundingBoxCache::SetIncludedPurposes(const TfTokenVector &purposes) {
+    if (purposes != _purposes) {
+        _purposes = purposes;
+        Clear();
+    }
+}
+
+GfBBox3d BoundingBoxCache::ComputeWorldBound(const SdfPath &path, UsdTimeCode time) {
+    return ComputeWorldBound(SdfPathVector{path}, time);
+}
+
+GfBBox3d BoundingBoxCache::ComputeWorldBound(const SdfPathVector &paths, UsdTimeCode time) {
+    GfBBox3d bbox;
+    if (!_stage) {
+        return bbox;
+    }
+    if (_bounds.size() >= MaxTimeCodes && _bounds.find(time) == _bounds.end()) {
+        Clear();
+    }
+    Bounds &bounds = _bounds[time];
+
+    // Compute the missing bounds in parallel, each task has its own UsdGeomBBoxCache as they are not thread safe
+    SdfPathVector missingPaths;
+    for (const auto &path : paths) {
+        if (bounds.find(path) == bounds.end()) {
+            missingPaths.push_back(path);
+        }
+    }
+    std::vector<GfBBox3d> missingBounds(missingPaths.size());
+    WorkParallelForN(missingPaths.size(), [&](size_t begin, size_t end) {
+        UsdGeomBBoxCache bboxCache(time, _purposes);
+        for (size_t i = begin; i < end; ++i) {
+            const UsdPrim prim = _stage->GetPrimAtPath(missingPaths[i]);
+            if (prim) {
+                missingBounds[i] = bboxCache.ComputeWorldBound(prim);
+            }
+        }
+    });
+    for (size_t i = 0; i < missingPaths.size(); ++i) {
+        bounds[missingPaths[i]] = missingBounds[i];
+    }
+
+    for (const auto &path : paths) {
+        bbox = GfBBox3d::Combine(bounds[path], bbox);
+    }
+    return bbox;
+}
+
+// An edit changes the bound of the prim, its ancestors and, when it moves the prim, its descendants
+void BoundingBoxCache::Invalidate(const SdfPath &changedPath) {
+    for (auto &timeBounds : _bounds) {
+        Bounds &bounds = timeBounds.second;
+        for (auto it = bounds.begin(); it != bounds.end();) {
+            if (it->first.HasPrefix(changedPath) || changedPath.HasPrefix(it->first)) {
+                it = bounds.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+void BoundingBoxCache::OnObjectsChanged(const UsdNotice::ObjectsChanged &notice, const UsdStageWeakPtr &sender) {
+    if (_bounds.empty()) {
+        return;
+    }
+    const auto resyncedPaths = notice.GetResyncedPaths();
+    const auto changedInfoPaths = notice.GetChangedInfoOnlyPaths();
+    if (resyncedPaths.size() + changedInfoPaths.size() > MaxInvalidatedPaths) {
+        Clear();
+        return;
+    }
+    SdfPathVector changedPaths;
+    for (const auto &path : resyncedPaths) {
+        changedPaths.push_back(path.GetPrimPath());
+    }
+    for (const auto &path : changedInfoPaths) {
+        changedPaths.push_back(path.GetPrimPath());
+    }
+    // The edits of the prototypes are reported on the prototype paths, they change the bounds of every instance. The
+    // instances found in a prototype are also mapped to the instances of that prototype
+    for (size_t i = 0; i < changedPaths.size(); ++i) {
+        if (!UsdPrim::IsPathInPrototype(changedPaths[i])) {
+            continue;
+        }
+        const SdfPath prototypePath = changedPaths[i].GetPrefixes().front();
+        const UsdPrim prototype = _stage->GetPrimAtPath(prototypePath);
+        if (!prototype) {
+            Clear(); // The prototype was removed, its instances are not known anymore
+            return;
+        }
+        for (const auto &instance : prototype.GetInstances()) {
+            changedPaths.push_back(changedPaths[i].ReplacePrefix(prototypePath, instance.GetPath()));
+        }
+        if (changedPaths.size() > MaxInvalidatedPaths) {
+            Clear();
+            return;
+        }
+    }
+    for (const auto &path : changedPaths) {
+        if (!UsdPrim::IsPathInPrototype(path)) {
+            Invalidate(path);
+        }
+    }
+}
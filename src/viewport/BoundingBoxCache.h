@@ -0,0 +1,48 @@
+#pragma once
+#include <map>
+#include <unordered_map>
+#include <pxr/base/gf/bbox3d.h>
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/usd/notice.h>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// World bounds of the prims framed or manipulated in the viewport. The bounds are kept per time code until the
+/// prims, their ancestors or their descendants are edited, so framing the same prims again doesn't traverse their
+/// subtree. The missing bounds of a selection are computed in parallel.
+///
+class BoundingBoxCache : public TfWeakBase {
+  public:
+    BoundingBoxCache();
+    ~BoundingBoxCache();
+
+    BoundingBoxCache(const BoundingBoxCache &) = delete;
+    BoundingBoxCache &operator=(const BoundingBoxCache &) = delete;
+
+    void SetStage(UsdStageRefPtr stage);
+
+    /// Purposes included in the bounds, changing them clears the cache
+    void SetIncludedPurposes(const TfTokenVector &purposes);
+
+    /// World bound of a prim
+    GfBBox3d ComputeWorldBound(const SdfPath &path, UsdTimeCode time);
+
+    /// Combined world bounds of the prims
+    GfBBox3d ComputeWorldBound(const SdfPathVector &paths, UsdTimeCode time);
+
+    void Clear() { _bounds.clear(); }
+
+  private:
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice, const UsdStageWeakPtr &sender);
+    void Invalidate(const SdfPath &changedPath);
+
+    using Bounds = std::unordered_map<SdfPath, GfBBox3d, SdfPath::Hash>;
+
+    UsdStageRefPtr _stage;
+    TfNotice::Key _objectsChangedKey;
+    TfTokenVector _purposes;
+    std::map<UsdTimeCode, Bounds> _bounds; // Bounds by time code
+};
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <unordered_map>
+#include <pxr/base/gf/bbox3d.h>
+#include <pxr/usd/usd/primRange.h>
+#include <pxr/usd/usdGeom/bboxCache.h>
+#include <pxr/usd/usdGeom/boundable.h>
+#include <pxr/usd/usdGeom/imageable.h>
+#include <pxr/usd/usdGeom/pointBased.h>
+#include <pxr/usd/usdGeom/xformable.h>
+#include "BoundingVolumeHierarchy.h"
+
+// Maximum number of leaves in the nodes at the bottom of the hierarchy
+static constexpr size_t MaxLeavesPerNode = 4;
+
+// Above this number of edited prims, the hierarchy is rebuilt instead of refitted
+static constexpr size_t MaxRefittedPaths = 1024;
+
+// Number of prims read by the background thread each time it takes the stage mutex
+static constexpr size_t BuildChunkSize = 1024;
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy() : _purposes(UsdGeomImageable::GetOrderedPurposeTokens()) {}
+
+BoundingVolumeHierarchy::~BoundingVolumeHierarchy() {
+    TfNotice::Revoke(_objectsChangedKey);
+    StopBuild();
+}
+
+void BoundingVolumeHierarchy::SetStage(UsdStageRefPtr stage) {
+    if (stage == _stage) {
+        return;
+    }
+    TfNotice::Revoke(_objectsChangedKey);
+    StopBuild();
+    _stage = stage;
+    _hierarchy.reset();
+    _changedPaths.clear();
+    _mustRebuild = true;
+    if (_stage) {
+        _objectsChangedKey = TfNotice::Register(TfCreateWeakPtr(this), &BoundingVolumeHierarchy::OnObjectsChanged,
+                                                UsdStageWeakPtr(_stage));
+    }
+}
+
+void BoundingVolumeHierarchy::OnObjectsChanged(const UsdNotice::ObjectsChanged &notice, const UsdStageWeakPtr &sender) {
+    if (!notice.GetResyncedPaths().empty()) {
+        _resyncCount++;
+        _mustRebuild = true;
+        return;
+    }
+    for (const auto &path : notice.GetChangedInfoOnlyPaths()) {
+        _changedPaths.push_back(path.GetPrimPath());
+    }
+    if (_changedPaths.size() > MaxRefittedPaths) {
+        _mustRebuild = true;
+    }
+}
+
+void BoundingVolumeHierarchy::Update(UsdTimeCode time, const TfTokenVector &purposes) {
+    if (!_stage) {
+        return;
+    }
+    if (_buildFinished) {
+        _buildThread.join();
+        _buildFinished = false;
+        _hierarchy = std::move(_builtHierarchy);
+    }
+    if (purposes != _purposes) {
+        _purposes = purposes;
+        _mustRebuild = true;
+        StopBuild(); // The hierarchy being built is outdated
+    }
+    // Only the bounds of the animated leaves change with the time, the hierarchy built at another time is refitted
+    _time = time;
+    if (_hierarchy && _hierarchy->time != _time) {
+        if (_hierarchy->animatedLeaves.size() <= MaxRefittedPaths) {
+            RefitLeaves(_hierarchy->animatedLeaves);
+            _hierarchy->time = _time;
+        } else if (!_buildThread.joinable()) {
+            _mustRebuild = true;
+        }
+    }
+    if (_mustRebuild && !_buildThread.joinable()) {
+        _mustRebuild = false;
+        _changedPaths.clear();
+        StartBuild(); // The current hierarchy is used until the new one is built
+    }
+    // The edits made while building are refitted when the build is finished, a resync restarts the build
+    if (_hierarchy && !_buildThread.joinable() && !_changedPaths.empty()) {
+        Refit(_changedPaths);
+        _changedPaths.clear();
+    }
+}
+
+void BoundingVolumeHierarchy::StartBuild() {
+    StopBuild();
+    _buildFinished = false;
+    if (_stageMutex) {
+        _buildThread = std::thread(&BoundingVolumeHierarchy::Build, this, _stage, _time, _purposes);
+    } else {
+        Build(_stage, _time, _purposes);
+        _buildFinished = false;
+        _hierarchy = std::move(_builtHierarchy);
+    }
+}
+
+void BoundingVolumeHierarchy::StopBuild() {
+    if (_buildThread.joinable()) {
+        _cancelled = true;
+        _buildThread.join();
+        _cancelled = false;
+    }
+    _buildFinished = false;
+    _builtHierarchy.reset();
+}
+
+static GfRange3d ComputeBounds(const UsdStageRefPtr &stage, const SdfPath &path, UsdGeomBBoxCache &bboxCache) {
+    const UsdPrim prim = stage->GetPrimAtPath(path);
+    return prim ? bboxCache.ComputeWorldBound(prim).ComputeAlignedRange() : GfRange3d();
+}
+
+// The transforms of the ancestors are cached as the siblings share them
+using TimeVaryingTransforms = std::unordered_map<SdfPath, bool, SdfPath::Hash>;
+
+static bool TransformMightBeTimeVarying(const UsdPrim &prim, TimeVaryingTransforms &transforms) {
+    if (!prim || prim.IsPseudoRoot()) {
+        return false;
+    }
+    const auto it = transforms.find(prim.GetPath());
+    if (it != transforms.end()) {
+        return it->second;
+    }
+    const UsdGeomXformable xformable(prim);
+    const bool mightBeTimeVarying =
+        (xformable && xformable.TransformMightBeTimeVarying()) || TransformMightBeTimeVarying(prim.GetParent(), transforms);
+    transforms.emplace(prim.GetPath(), mightBeTimeVarying);
+    return mightBeTimeVarying;
+}
+
+// The world bounds are computed from the extent, or the points when there is no extent, and the transforms
+static bool BoundsMightBeTimeVarying(const UsdPrim &prim, TimeVaryingTransforms &transforms) {
+    const UsdGeomPointBased pointBased(prim);
+    return UsdGeomBoundable(prim).GetExtentAttr().ValueMightBeTimeVarying() ||
+           (pointBased && pointBased.GetPointsAttr().ValueMightBeTimeVarying()) ||
+           TransformMightBeTimeVarying(prim, transforms);
+}
+
+// Runs on the background thread when there is a stage mutex
+void BoundingVolumeHierarchy::Build(UsdStageRefPtr stage, UsdTimeCode time, TfTokenVector purposes) {
+    std::unique_ptr<Hierarchy> hierarchy(new Hierarchy());
+    std::unique_ptr<UsdGeomBBoxCache> bboxCache;
+    TimeVaryingTransforms transforms;
+    UsdPrimRange range;
+    UsdPrimRange::iterator it;
+    size_t resyncCount = 0;
+    bool mustRestart = true;
+    while (true) {
+        std::unique_lock<std::mutex> lock;
+        if (_stageMutex) {
+            // Try locking to give up quickly when cancelled, the ui thread might hold the lock while waiting for this thread
+            lock = std::unique_lock<std::mutex>(*_stageMutex, std::defer_lock);
+            while (!lock.try_lock()) {
+                if (_cancelled) {
+                    return;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        if (_cancelled) {
+            return;
+        }
+        // The iterator and the cached bounds are invalid after a resync, start again
+        if (mustRestart || resyncCount != _resyncCount) {
+            resyncCount = _resyncCount;
+            hierarchy->leaves.clear();
+            transforms.clear();
+            bboxCache.reset(new UsdGeomBBoxCache(time, purposes));
+            range = stage->Traverse(UsdTraverseInstanceProxies());
+            it = range.begin();
+            mustRestart = false;
+        }
+        // The leaves are the prims having their own extent: the gprims, the point instancers, etc
+        for (size_t i = 0; i < BuildChunkSize && it != range.end(); ++i, ++it) {
+            if (it->IsA<UsdGeomBoundable>()) {
+                const GfRange3d bounds = ComputeBounds(stage, it->GetPath(), *bboxCache);
+                if (!bounds.IsEmpty()) {
+                    hierarchy->leaves.push_back({it->GetPath(), bounds, BoundsMightBeTimeVarying(*it, transforms)});
+                }
+            }
+        }
+        if (it == range.end()) {
+            break;
+        }
+        if (lock.owns_lock()) {
+            lock.unlock();
+        }
+        std::this_thread::yield();
+    }
+    // The nodes are built without reading the stage
+    hierarchy->time = time;
+    hierarchy->Build();
+    _builtHierarchy = std::move(hierarchy);
+    _buildFinished = true;
+}
+
+void BoundingVolumeHierarchy::Hierarchy::Build() {
+    nodes.clear();
+    leafIndices.clear();
+    leafNodes.resize(leaves.size());
+    if (!leaves.empty()) {
+        nodes.reserve(2 * leaves.size() / MaxLeavesPerNode + 1);
+        BuildNode(0, leaves.size(), -1);
+    }
+    animatedLeaves.clear();
+    for (size_t i = 0; i < leaves.size(); ++i) {
+        leafIndices.emplace(leaves[i].path, i);
+        if (leaves[i].animated) {
+            animatedLeaves.push_back(i);
+        }
+    }
+}
+
+// Splits the leaves at the median of their centers along the largest axis
+int BoundingVolumeHierarchy::Hierarchy::BuildNode(size_t first, size_t count, int parent) {
+    const int nodeIndex = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+    GfRange3d bounds;
+    GfRange3d centers;
+    for (size_t i = first; i < first + count; ++i) {
+        bounds.UnionWith(leaves[i].bounds);
+        centers.UnionWith(leaves[i].bounds.GetMidpoint());
+    }
+    Node &node = nodes[nodeIndex];
+    node.bounds = bounds;
+    node.parent = parent;
+    node.first = first;
+    node.count = count;
+    if (count <= MaxLeavesPerNode) {
+        for (size_t i = first; i < first + count; ++i) {
+            leafNodes[i] = nodeIndex;
+        }
+        return nodeIndex;
+    }
+    const GfVec3d size = centers.GetSize();
+    const int axis = size[0] >= size[1] && size[0] >= size[2] ? 0 : (size[1] >= size[2] ? 1 : 2);
+    const size_t half = count / 2;
+    std::nth_element(leaves.begin() + first, leaves.begin() + first + half, leaves.begin() + first + count,
+                     [axis](const Leaf &a, const Leaf &b) { return a.bounds.GetMidpoint()[axis] < b.bounds.GetMidpoint()[axis]; });
+    // nodes grows while building the children, the node is accessed by index
+    const int left = BuildNode(first, half, nodeIndex);
+    const int right = BuildNode(first + half, count - half, nodeIndex);
+    nodes[nodeIndex].children[0] = left;
+    nodes[nodeIndex].children[1] = right;
+    return nodeIndex;
+}
+
+// Refits the leaves of the edited prims and their descendants
+void BoundingVolumeHierarchy::Refit(const SdfPathVector &changedPaths) {
+    const Hierarchy &hierarchy = *_hierarchy;
+    std::vector<size_t> leafIndices;
+    for (const auto &changedPath : changedPaths) {
+        for (auto it = hierarchy.leafIndices.lower_bound(changedPath);
+             it != hierarchy.leafIndices.end() && it->first.HasPrefix(changedPath); ++it) {
+            leafIndices.push_back(it->second);
+        }
+    }
+    RefitLeaves(leafIndices);
+}
+
+// Computes the bounds of the leaves, then grows or shrinks their ancestor nodes
+void BoundingVolumeHierarchy::RefitLeaves(const std::vector<size_t> &leafIndices) {
+    Hierarchy &hierarchy = *_hierarchy;
+    UsdGeomBBoxCache bboxCache(_time, _purposes);
+    std::vector<int> refittedNodes;
+    for (size_t leafIndex : leafIndices) {
+        Leaf &leaf = hierarchy.leaves[leafIndex];
+        leaf.bounds = ComputeBounds(_stage, leaf.path, bboxCache);
+        refittedNodes.push_back(hierarchy.leafNodes[leafIndex]);
+    }
+    std::sort(refittedNodes.begin(), refittedNodes.end());
+    refittedNodes.erase(std::unique(refittedNodes.begin(), refittedNodes.end()), refittedNodes.end());
+    for (int nodeIndex : refittedNodes) {
+        Node &node = hierarchy.nodes[nodeIndex];
+        node.bounds = GfRange3d();
+        for (size_t i = node.first; i < node.first + node.count; ++i) {
+            node.bounds.UnionWith(hierarchy.leaves[i].bounds);
+        }
+        for (int parent = node.parent; parent >= 0; parent = hierarchy.nodes[parent].parent) {
+            Node &parentNode = hierarchy.nodes[parent];
+            parentNode.bounds = GfRange3d::GetUnion(hierarchy.nodes[parentNode.children[0]].bounds,
+                                                    hierarchy.nodes[parentNode.children[1]].bounds);
+        }
+    }
+}
+
+SdfPathVector BoundingVolumeHierarchy::FindInFrustum(const GfFrustum &frustum) const {
+    SdfPathVector paths;
+    if (!_hierarchy || _hierarchy->nodes.empty()) {
+        return paths;
+    }
+    const auto &nodes = _hierarchy->nodes;
+    const auto &leaves = _hierarchy->leaves;
+    std::vector<int> stack = {0};
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        if (node.bounds.IsEmpty() || !frustum.Intersects(GfBBox3d(node.bounds))) {
+            continue;
+        }
+        if (node.children[0] >= 0) {
+            stack.push_back(node.children[0]);
+            stack.push_back(node.children[1]);
+            continue;
+        }
+        for (size_t i = node.first; i < node.first + node.count; ++i) {
+            if (!leaves[i].bounds.IsEmpty() && frustum.Intersects(GfBBox3d(leaves[i].bounds))) {
+                paths.push_back(leaves[i].path);
+            }
+        }
+    }
+    return paths;
+}
+
+SdfPath BoundingVolumeHierarchy::FindClosest(const GfRay &ray) const {
+    SdfPath closestPath;
+    if (!_hierarchy || _hierarchy->nodes.empty()) {
+        return closestPath;
+    }
+    const auto &nodes = _hierarchy->nodes;
+    const auto &leaves = _hierarchy->leaves;
+    double closestDistance = std::numeric_limits<double>::max();
+    // The bounds containing the camera, like a room, a set or a terrain, would always be the closest hit. They are
+    // only returned when the ray doesn't hit any other bounds, the one with the closest exit first
+    SdfPath enclosingPath;
+    double enclosingExitDistance = std::numeric_limits<double>::max();
+    double enterDistance = 0.0;
+    double exitDistance = 0.0;
+    const auto isHit = [&](const GfRange3d &bounds) {
+        return !bounds.IsEmpty() && ray.Intersect(bounds, &enterDistance, &exitDistance);
+    };
+    std::vector<int> stack = {0};
+    while (!stack.empty()) {
+        const Node &node = nodes[stack.back()];
+        stack.pop_back();
+        // The nodes further than the closest hit are skipped
+        if (!isHit(node.bounds) || std::max(enterDistance, 0.0) >= closestDistance) {
+            continue;
+        }
+        if (node.children[0] >= 0) {
+            stack.push_back(node.children[0]);
+            stack.push_back(node.children[1]);
+            continue;
+        }
+        for (size_t i = node.first; i < node.first + node.count; ++i) {
+            if (!isHit(leaves[i].bounds)) {
+                continue;
+            }
+            if (enterDistance < 0.0) {
+                if (exitDistance < enclosingExitDistance) {
+                    enclosingExitDistance = exitDistance;
+                    enclosingPath = leaves[i].path;
+                }
+            } else if (enterDistance < closestDistance) {
+                closestDistance = enterDistance;
+                closestPath = leaves[i].path;
+            }
+        }
+    }
+    return closestPath.IsEmpty() ? enclosingPath : closestPath;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pxr/base/gf/frustum.h>
+#include <pxr/base/gf/range3d.h>
+#include <pxr/base/gf/ray.h>
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/usd/notice.h>
+#include <pxr/usd/usd/stage.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// Bounding volume hierarchy of the world bounds of the boundable prims of a stage, used to find the prims in a
+/// region of the viewport without rendering a picking pass. It is built on a background thread when it is first
+/// queried and rebuilt when the stage is resynced, the current hierarchy is used until the new one is built.
+/// The bounds of the edited prims, and of the animated prims when the time changes, are refitted on the ui thread.
+/// The background thread reads the stage by small chunks, the stage must not be edited without holding the stage mutex.
+/// The tests are done on the axis aligned bounds, so they are approximate.
+///
+class BoundingVolumeHierarchy : public TfWeakBase {
+  public:
+    BoundingVolumeHierarchy();
+    ~BoundingVolumeHierarchy();
+
+    BoundingVolumeHierarchy(const BoundingVolumeHierarchy &) = delete;
+    BoundingVolumeHierarchy &operator=(const BoundingVolumeHierarchy &) = delete;
+
+    void SetStage(UsdStageRefPtr stage);
+
+    /// Mutex held by the ui while it edits the stage. Without it the hierarchy is built on the ui thread
+    void SetStageMutex(std::mutex *stageMutex) { _stageMutex = stageMutex; }
+
+    /// Takes the hierarchy built in the background, starts a new build if the stage or the purposes have changed and
+    /// refits the edited prims, and the animated prims if the time has changed. Called on the ui thread
+    void Update(UsdTimeCode time, const TfTokenVector &purposes);
+
+    /// The queries return nothing until the first hierarchy is built
+    bool IsReady() const { return _hierarchy != nullptr; }
+
+    /// Prims whose bounds intersect the frustum
+    SdfPathVector FindInFrustum(const GfFrustum &frustum) const;
+
+    /// Prim whose bound is the closest along the ray, an empty path if the ray doesn't hit any bound
+    SdfPath FindClosest(const GfRay &ray) const;
+
+    size_t GetPrimCount() const { return _hierarchy ? _hierarchy->leaves.size() : 0; }
+
+  private:
+    struct Leaf {
+        SdfPath path;
+        GfRange3d bounds;
+        bool animated = false; // The bounds might change with the time
+    };
+    struct Node {
+        GfRange3d bounds;
+        int parent = -1;
+        int children[2] = {-1, -1}; // Both are -1 for the nodes containing leaves
+        size_t first = 0;           // Range of the leaves of the node
+        size_t count = 0;
+    };
+    struct Hierarchy {
+        void Build();
+        int BuildNode(size_t first, size_t count, int parent);
+
+        std::vector<Leaf> leaves;              // Ordered by node
+        std::vector<Node> nodes;               // The first node is the root
+        std::vector<int> leafNodes;            // Node containing each leaf
+        std::map<SdfPath, size_t> leafIndices; // Ordered by path to find the leaves under an edited prim
+        std::vector<size_t> animatedLeaves;    // Refitted when the time changes
+        UsdTimeCode time;                      // Time of the bounds
+    };
+
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice, const UsdStageWeakPtr &sender);
+    void StartBuild();
+    void StopBuild();
+    void Build(UsdStageRefPtr stage, UsdTimeCode time, TfTokenVector purposes);
+    void Refit(const SdfPathVector &changedPaths);
+    void RefitLeaves(const std::vector<size_t> &leafIndices);
+
+    UsdStageRefPtr _stage;
+    TfNotice::Key _objectsChangedKey;
+    UsdTimeCode _time;
+    TfTokenVector _purposes;
+    std::unique_ptr<Hierarchy> _hierarchy;
+
+    bool _mustRebuild = true;
+    SdfPathVector _changedPaths; // Waiting to be refitted
+
+    // Background build
+    std::mutex *_stageMutex = nullptr;
+    std::thread _buildThread;
+    std::atomic<bool> _cancelled{false};
+    std::atomic<bool> _buildFinished{false};
+    std::atomic<size_t> _resyncCount{0}; // The build restarts when the stage is resynced while it reads it
+    std::unique_ptr<Hierarchy> _builtHierarchy;
+};
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <pxr/imaging/hd/tokens.h>
+#include <pxr/usd/usdUtils/stageCache.h>
+#include "Gui.h"
+#include "HydraEngineCache.h"
+
+namespace clk = std::chrono;
+
+// The render stats are queried at most once per interval, the memory of the engines doesn't need to be exact
+static constexpr clk::milliseconds MemoryUpdateInterval(1000);
+
+static size_t EstimateMemoryUsed(UsdImagingGLEngine &engine) {
+    const VtDictionary stats = engine.GetRenderStats();
+    const auto gpuMemoryUsed = stats.find(HdPerfTokens->gpuMemoryUsed.GetString());
+    if (gpuMemoryUsed != stats.end() && gpuMemoryUsed->second.CanCast<size_t>()) {
+        return VtValue::Cast<size_t>(gpuMemoryUsed->second).UncheckedGet<size_t>();
+    }
+    return 0;
+}
+
+std::list<HydraEngineCache::Entry>::iterator HydraEngineCache::Find(const UsdStageRefPtr &stage) {
+    // We expect a very limited number of engines
+    return std::find_if(_entries.begin(), _entries.end(), [&stage](const Entry &entry) { return entry.stage == stage; });
+}
+
+UsdImagingGLEngine *HydraEngineCache::GetEngine(const UsdStageRefPtr &stage, bool &created) {
+    const auto now = clk::steady_clock::now();
+    auto entry = Find(stage);
+    created = entry == _entries.end();
+    if (created) {
+        SdfPathVector excludedPaths;
+        _entries.emplace_front();
+        _entries.front().stage = stage;
+        _entries.front().engine.reset(new UsdImagingGLEngine(stage->GetPseudoRoot().GetPath(), excludedPaths));
+    } else if (entry != _entries.begin()) {
+        // The previous engine is now inactive, its memory won't change until it is used again
+        _entries.front().memoryUsed = EstimateMemoryUsed(*_entries.front().engine);
+        _entries.splice(_entries.begin(), _entries, entry);
+    }
+    Entry &active = _entries.front();
+    active.released = false; // Displayed again before being destroyed
+    active.lastUsed = now;
+    if (now - _lastMemoryUpdate > MemoryUpdateInterval) {
+        active.memoryUsed = EstimateMemoryUsed(*active.engine);
+        _lastMemoryUpdate = now;
+    }
+    return active.engine.get();
+}
+
+void HydraEngineCache::Evict(const UsdStageRefPtr &activeStage) {
+    // The engines of the closed stages are not useful anymore
+    const UsdStageCache &stageCache = UsdUtilsStageCache::Get();
+    for (auto entry = _entries.begin(); entry != _entries.end();) {
+        if (entry->stage != activeStage && (entry->released || !stageCache.Contains(entry->stage))) {
+            entry = _entries.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
+    // Then the least recently used, starting from the back of the list
+    const size_t budget = static_cast<size_t>(memoryBudget) * 1024 * 1024;
+    size_t engineCount = _entries.size();
+    size_t memoryUsed = GetMemoryUsed();
+    for (auto entry = _entries.rbegin(); entry != _entries.rend();) {
+        const bool overCount = maxEngines > 0 && engineCount > static_cast<size_t>(maxEngines);
+        const bool overBudget = memoryBudget > 0 && memoryUsed > budget;
+        if (!overCount && !overBudget) {
+            break;
+        }
+        if (entry->pinned || entry->stage == activeStage) {
+            ++entry;
+            continue;
+        }
+        engineCount--;
+        memoryUsed -= entry->memoryUsed;
+        entry = std::list<Entry>::reverse_iterator(_entries.erase(std::next(entry).base()));
+    }
+}
+
+void HydraEngineCache::Release(const UsdStageRefPtr &stage) {
+    auto entry = Find(stage);
+    if (entry != _entries.end()) {
+        entry->released = true;
+    }
+}
+
+void HydraEngineCache::Clear() { _entries.clear(); }
+
+void HydraEngineCache::SetPinned(const UsdStageRefPtr &stage, bool pinned) {
+    auto entry = Find(stage);
+    if (entry != _entries.end()) {
+        entry->pinned = pinned;
+    }
+}
+
+size_t HydraEngineCache::GetMemoryUsed() const {
+    size_t memoryUsed = 0;
+    for (const auto &entry : _entries) {
+        memoryUsed += entry.memoryUsed;
+    }
+    return memoryUsed;
+}
+
+static double ToMegabytes(size_t bytes) { return static_cast<double>(bytes) / (1024.0 * 1024.0); }
+
+void DrawHydraEngineCache(HydraEngineCache &cache, const UsdStageRefPtr &activeStage) {
+    ImGui::InputInt("Max engines", &cache.maxEngines);
+    cache.maxEngines = std::max(cache.maxEngines, 0);
+    ImGui::InputInt("Memory budget (MB)", &cache.memoryBudget, 256, 1024);
+    cache.memoryBudget = std::max(cache.memoryBudget, 0);
+    ImGui::Text("%zu engines, %.1f MB", cache.GetEntries().size(), ToMegabytes(cache.GetMemoryUsed()));
+
+    // The changes are applied after the table as they modify the list
+    UsdStageRefPtr stageToPin;
+    UsdStageRefPtr stageToUnpin;
+    UsdStageRefPtr stageToRelease;
+    constexpr ImGuiTableFlags tableFlags = ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+    if (ImGui::BeginTable("HydraEngines", 4, tableFlags)) {
+        ImGui::TableSetupColumn("Stage", ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableSetupColumn("Memory");
+        ImGui::TableSetupColumn("Pinned");
+        ImGui::TableSetupColumn("");
+        ImGui::TableHeadersRow();
+        const auto now = clk::steady_clock::now();
+        for (const auto &entry : cache.GetEntries()) {
+            const bool isActive = entry.stage == activeStage;
+            ImGui::PushID(entry.engine.get());
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            const std::string &identifier = entry.stage->GetRootLayer()->GetIdentifier();
+            if (isActive) {
+                ImGui::Text("%s (displayed)", identifier.c_str());
+            } else {
+                const auto idleTime = clk::duration_cast<clk::seconds>(now - entry.lastUsed).count();
+                ImGui::Text("%s (idle %llds)", identifier.c_str(), static_cast<long long>(idleTime));
+            }
+            ImGui::TableSetColumnIndex(1);
+            if (entry.memoryUsed) {
+                ImGui::Text("%.1f MB", ToMegabytes(entry.memoryUsed));
+            } else {
+                ImGui::TextDisabled("unknown");
+            }
+            ImGui::TableSetColumnIndex(2);
+            bool pinned = entry.pinned;
+            if (ImGui::Checkbox("##Pinned", &pinned)) {
+                (pinned ? stageToPin : stageToUnpin) = entry.stage;
+            }
+            ImGui::TableSetColumnIndex(3);
+            if (!isActive && !entry.released && ImGui::SmallButton("Release")) {
+                stageToRelease = entry.stage;
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+    if (stageToPin) {
+        cache.SetPinned(stageToPin, true);
+    }
+    if (stageToUnpin) {
+        cache.SetPinned(stageToUnpin, false);
+    }
+    if (stageToRelease) {
+        cache.Release(stageToRelease);
+    }
+}
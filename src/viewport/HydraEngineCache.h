@@ -0,0 +1,64 @@
+#pragma once
+#include <chrono>
+#include <list>
+#include <memory>
+#include <pxr/usd/usd/stage.h>
+#include <pxr/usdImaging/usdImagingGL/engine.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+///
+/// Hydra engines of the stages displayed in the viewport. An engine keeps the hydra scene and the gpu buffers of its
+/// stage, so switching back to a stage is instantaneous, but they can't all be kept when many stages are opened.
+/// The least recently used engines are destroyed when there are more than maxEngines or when their estimated memory
+/// exceeds the budget. The engine of the displayed stage and the pinned ones are kept.
+/// The engines must be created and destroyed with the viewport gl context current.
+///
+class HydraEngineCache {
+  public:
+    struct Entry {
+        UsdStageRefPtr stage;
+        std::unique_ptr<UsdImagingGLEngine> engine;
+        size_t memoryUsed = 0; // Estimated from the render stats, 0 if the renderer doesn't report it
+        bool pinned = false;
+        bool released = false; // Destroyed by the next Evict
+        std::chrono::steady_clock::time_point lastUsed;
+    };
+
+    HydraEngineCache() = default;
+    HydraEngineCache(const HydraEngineCache &) = delete;
+    HydraEngineCache &operator=(const HydraEngineCache &) = delete;
+
+    /// Returns the engine of the stage and makes it the most recently used. created is set to true when the engine
+    /// didn't exist
+    UsdImagingGLEngine *GetEngine(const UsdStageRefPtr &stage, bool &created);
+
+    /// Destroys the engines exceeding the limits, called at each frame. The engine of the active stage is never destroyed
+    void Evict(const UsdStageRefPtr &activeStage);
+
+    /// Destroys the engine of a stage at the next Evict, where the gl context is bound. It is created again when the
+    /// stage is displayed
+    void Release(const UsdStageRefPtr &stage);
+    void Clear();
+
+    void SetPinned(const UsdStageRefPtr &stage, bool pinned);
+
+    bool IsEmpty() const { return _entries.empty(); }
+    size_t GetMemoryUsed() const;
+
+    /// Entries ordered from the most to the least recently used
+    const std::list<Entry> &GetEntries() const { return _entries; }
+
+    /// Limits, 0 means unlimited
+    int maxEngines = 4;
+    int memoryBudget = 4096; // megabytes
+
+  private:
+    std::list<Entry>::iterator Find(const UsdStageRefPtr &stage);
+
+    std::list<Entry> _entries;
+    std::chrono::steady_clock::time_point _lastMemoryUpdate;
+};
+
+/// Table of the engines with their memory, to pin or release them
+void DrawHydraEngineCache(HydraEngineCache &cache, const UsdStageRefPtr &activeStage);
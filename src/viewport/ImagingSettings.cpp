@@ -36,6 +36,10 @@ ImagingSettings::ImagingSettings() {
     // Lights
     enableCameraLight = true;
 
+    adaptiveResolution = true;
+    targetFrameTime = 33.f;
+    hoverHighlight = true;
+
 
     // TODO: set color correction as well
 
@@ -126,6 +130,7 @@ void DrawImagingSettings(UsdImagingGLEngine &renderer, ImagingSettings &renderpa
 
     ImGui::Separator();
     ImGui::Checkbox("Highlight selection", &renderparams.highlight);
+    ImGui::Checkbox("Highlight prim under mouse", &renderparams.hoverHighlight);
 
     ImGui::Separator();
     ImGui::Checkbox("Enable lighting", &renderparams.enableLighting);
@@ -134,6 +139,12 @@ void DrawImagingSettings(UsdImagingGLEngine &renderer, ImagingSettings &renderpa
     ImGui::Checkbox("Enable ID render", &renderparams.enableIdRender);
     ImGui::Checkbox("Enable USD draw modes", &renderparams.enableUsdDrawModes);
     ImGui::Checkbox("Enable camera light", &renderparams.enableCameraLight);
+
+    ImGui::Separator();
+    ImGui::Checkbox("Adaptive resolution", &renderparams.adaptiveResolution);
+    if (renderparams.adaptiveResolution) {
+        ImGui::SliderFloat("Target frame time", &renderparams.targetFrameTime, 5.f, 200.f, "%.0f ms");
+    }
 }
 
 void DrawRendererSelection(UsdImagingGLEngine &renderer) {
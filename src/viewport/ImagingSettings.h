@@ -14,6 +14,13 @@ struct ImagingSettings : UsdImagingGLRenderParams {
 
     // Defaults GL lights and materials
     bool enableCameraLight;
+
+    // The resolution is reduced while interacting with the viewport to render in the target time
+    bool adaptiveResolution;
+    float targetFrameTime; // milliseconds
+
+    // Draws the bounds of the prim under the mouse
+    bool hoverHighlight;
     const GlfSimpleLightVector &GetLights();
 
     
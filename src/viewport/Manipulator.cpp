@@ -1 +1,33 @@
 #include "Manipulator.h"
+#include "Viewport.h"
+
+std::vector<UsdGeomXformable> GetSelectedXformables(Viewport &viewport) {
+    std::vector<UsdGeomXformable> xformables;
+    const UsdStageRefPtr stage = viewport.GetCurrentStage();
+    if (!stage) {
+        return xformables;
+    }
+    SdfPathVector selectedPaths = viewport.GetSelection().GetSelectedPaths(stage);
+    SdfPath::RemoveDescendentPaths(&selectedPaths);
+    xformables.reserve(selectedPaths.size());
+    for (const SdfPath &path : selectedPaths) {
+        UsdGeomXformable xformable(stage->GetPrimAtPath(path));
+        if (xformable) {
+            xformables.push_back(xformable);
+        }
+    }
+    return xformables;
+}
+
+UsdGeomXformCache &ResetManipulatorXformCache(UsdTimeCode time) {
+    static UsdGeomXformCache xformCache;
+    xformCache.Clear();
+    xformCache.SetTime(time);
+    return xformCache;
+}
+
+UsdTimeCode GetEditionTimeCode(const UsdGeomXformable &xformable, UsdTimeCode currentTime) {
+    std::vector<double> timeSamples; // TODO: is there a faster way to know it the xformable has timesamples ?
+    xformable.GetTimeSamples(&timeSamples);
+    return timeSamples.empty() ? UsdTimeCode::Default() : currentTime;
+}
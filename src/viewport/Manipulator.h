@@ -1,4 +1,10 @@
 #pragma once
+#include <vector>
+#include <pxr/usd/usd/timeCode.h>
+#include <pxr/usd/usdGeom/xformable.h>
+#include <pxr/usd/usdGeom/xformCache.h>
+
+PXR_NAMESPACE_USING_DIRECTIVE
 
 class Viewport;
 
@@ -33,3 +39,16 @@ struct Manipulator {
     } ManipulatorAxis;
 };
 
+/// Functions shared by the position, rotation and scale manipulators which edit all the selected prims.
+
+/// Returns the xformables of the stage selection. The prims with a selected ancestor are skipped as they are
+/// already transformed by their ancestor.
+std::vector<UsdGeomXformable> GetSelectedXformables(Viewport &viewport);
+
+/// Returns the xform cache shared by the manipulators, cleared and set to the time passed in argument.
+/// The cache doesn't track the stage changes, it is only valid until the stage is modified.
+UsdGeomXformCache &ResetManipulatorXformCache(UsdTimeCode time);
+
+/// Returns the time code used to edit the xformable: default if it is not animated, the current time otherwise
+UsdTimeCode GetEditionTimeCode(const UsdGeomXformable &xformable, UsdTimeCode currentTime);
+
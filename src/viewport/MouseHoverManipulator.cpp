@@ -25,7 +25,11 @@ Manipulator * MouseHoverManipulator::OnUpdate(Viewport &viewport) {
         }
     } else {
         auto &manipulator = viewport.GetActiveManipulator();
-        manipulator.IsMouseOver(viewport);
+        if (manipulator.IsMouseOver(viewport)) {
+            viewport.ClearHoveredPrim();
+        } else if (io.MouseDelta.x != 0.f || io.MouseDelta.y != 0.f) {
+            viewport.UpdateHoveredPrim();
+        }
     }
     return this;
 }
\ No newline at end of file
@@ -1,9 +1,22 @@
-#include "FileBrowser.h"
-#include "Gui.h"
-#include "Playblast.h"
+#include <pxr/imaging/garch/glApi.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <pxr/imaging/glf/drawTarget.h>
+#include <pxr/imaging/hio/image.h>
 #include <pxr/usd/usd/primRange.h>
 #include <pxr/usd/usd/stage.h>
 #include <pxr/usd/usdGeom/camera.h>
+#include <pxr/usdImaging/usdImagingGL/engine.h>
+#include "FileBrowser.h"
+#include "Gui.h"
+#include "ImagingSettings.h"
+#include "Playblast.h"
 
 #if defined(__cplusplus) && __cplusplus >= 201703L && defined(__has_include) && __has_include(<filesystem>)
 #include <filesystem>
@@ -16,11 +29,302 @@ namespace fs = ghc::filesystem;
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+namespace {
+
+struct PlayblastImage {
+    std::string fileName;
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels; // RGBA, the bottom row first
+};
+
+bool WriteImage(const PlayblastImage &image) {
+    HioImageSharedPtr output = HioImage::OpenForWriting(image.fileName);
+    if (!output) {
+        return false;
+    }
+    HioImage::StorageSpec storage;
+    storage.width = image.width;
+    storage.height = image.height;
+    storage.format = HioFormatUNorm8Vec4;
+    storage.flipped = true;
+    storage.data = const_cast<unsigned char *>(image.pixels.data());
+    return output->Write(storage);
+}
+
+///
+/// Encodes and writes the images on a pool of threads. The queue is bounded, the renderer waits for the writers
+/// when it is full so the memory used by the images in flight stays under control.
+///
+class ImageWriterPool {
+  public:
+    ImageWriterPool(size_t threadCount, size_t maxQueuedImages) : _maxQueuedImages(maxQueuedImages) {
+        for (size_t i = 0; i < threadCount; ++i) {
+            _threads.emplace_back(&ImageWriterPool::Run, this);
+        }
+    }
+
+    // The queued images are written before the threads stop
+    ~ImageWriterPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _imageQueued.notify_all();
+        for (auto &thread : _threads) {
+            thread.join();
+        }
+    }
+
+    bool IsFull() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _queue.size() >= _maxQueuedImages;
+    }
+
+    void Push(PlayblastImage image) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queue.push_back(std::move(image));
+        }
+        _imageQueued.notify_one();
+    }
+
+    /// Drops the images waiting to be written
+    void Cancel() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _queue.clear();
+    }
+
+    size_t GetWrittenCount() const { return _written; }
+    size_t GetFailedCount() const { return _failed; }
+
+  private:
+    void Run() {
+        while (true) {
+            PlayblastImage image;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _imageQueued.wait(lock, [this]() { return _stopping || !_queue.empty(); });
+                if (_queue.empty()) {
+                    return;
+                }
+                image = std::move(_queue.front());
+                _queue.pop_front();
+            }
+            if (WriteImage(image)) {
+                _written++;
+            } else {
+                _failed++;
+            }
+        }
+    }
+
+    const size_t _maxQueuedImages;
+    mutable std::mutex _mutex;
+    std::condition_variable _imageQueued;
+    std::deque<PlayblastImage> _queue;
+    bool _stopping = false;
+    std::atomic<size_t> _written{0};
+    std::atomic<size_t> _failed{0};
+    std::vector<std::thread> _threads;
+};
+
+// Maximum number of passes of a progressive renderer for a frame
+constexpr int MaxRenderPasses = 512;
+
+size_t GetWriterThreadCount() {
+    // Keep one core for the ui and the renderer
+    const unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 2 ? std::min<size_t>(cores - 1, 8) : 1;
+}
+
+} // namespace
+
+///
+/// Renders the frames of a playblast on the ui thread, a few at a time. The pixels of a frame are copied in a pixel
+/// buffer object asynchronously and only read when the next frame is rendered, then they are passed to the writers.
+///
+class PlayblastRecorder {
+  public:
+    struct Frame {
+        UsdTimeCode timeCode;
+        std::string fileName;
+    };
+
+    PlayblastRecorder(UsdStageRefPtr stage, const SdfPath &cameraPath, const TfToken &rendererPlugin, int width,
+                      std::vector<Frame> frames);
+    ~PlayblastRecorder();
+
+    /// Renders frames for about the time budget. It must be called with the ui GL context current
+    void Update(std::chrono::milliseconds timeBudget);
+
+    void Cancel();
+    bool IsCancelled() const { return _cancelled; }
+    bool IsFinished() const;
+
+    size_t GetFrameCount() const { return _frames.size(); }
+    size_t GetRenderedCount() const { return _nextFrame; }
+    size_t GetWrittenCount() const { return _writers.GetWrittenCount(); }
+    size_t GetFailedCount() const { return _writers.GetFailedCount() + _readbackFailures; }
+
+  private:
+    /// Renders one pass of the frame and starts copying its pixels when the renderer has converged. Returns false
+    /// if the frame needs more passes
+    bool RenderFrame(size_t frameIndex);
+    void ReadbackFrame(size_t frameIndex);
+
+    UsdStageRefPtr _stage;
+    SdfPath _cameraPath;
+    std::vector<Frame> _frames;
+    GfVec2i _imageSize;
+    GlfDrawTargetRefPtr _drawTarget;
+    std::unique_ptr<UsdImagingGLEngine> _engine;
+    ImagingSettings _imagingSettings;
+    GLuint _pixelBuffers[2] = {0, 0};
+
+    size_t _nextFrame = 0;
+    int _renderPasses = 0;    // Passes rendered for the next frame
+    size_t _pendingFrame = 0; // Frame rendered and waiting to be read back
+    bool _hasPendingFrame = false;
+    size_t _readbackFailures = 0;
+    bool _cancelled = false;
+
+    ImageWriterPool _writers;
+};
+
+PlayblastRecorder::PlayblastRecorder(UsdStageRefPtr stage, const SdfPath &cameraPath, const TfToken &rendererPlugin,
+                                     int width, std::vector<Frame> frames)
+    : _stage(stage), _cameraPath(cameraPath), _frames(std::move(frames)),
+      _writers(GetWriterThreadCount(), 2 * GetWriterThreadCount()) {
+    // The image height follows the camera aspect ratio
+    const UsdGeomCamera camera(_stage->GetPrimAtPath(_cameraPath));
+    const float aspectRatio = _frames.empty() ? 1.f : camera.GetCamera(_frames.front().timeCode).GetAspectRatio();
+    const int height = aspectRatio > 0.f ? std::max(1, static_cast<int>(static_cast<float>(width) / aspectRatio)) : width;
+    _imageSize = GfVec2i(width, height);
+
+    _drawTarget = GlfDrawTarget::New(_imageSize, false);
+    _drawTarget->Bind();
+    _drawTarget->AddAttachment("color", GL_RGBA, GL_UNSIGNED_BYTE, GL_RGBA8);
+    _drawTarget->AddAttachment("depth", GL_DEPTH_COMPONENT, GL_FLOAT, GL_DEPTH_COMPONENT32F);
+    _engine.reset(new UsdImagingGLEngine(_stage->GetPseudoRoot().GetPath(), SdfPathVector()));
+    _engine->SetRendererPlugin(rendererPlugin);
+    _drawTarget->Unbind();
+
+    const size_t imageSize = static_cast<size_t>(_imageSize[0]) * static_cast<size_t>(_imageSize[1]) * 4;
+    glGenBuffers(2, _pixelBuffers);
+    for (GLuint pixelBuffer : _pixelBuffers) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, imageSize, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    _imagingSettings.enableSceneMaterials = true;
+    _imagingSettings.showGuides = false;
+    _imagingSettings.highlight = false;
+}
+
+PlayblastRecorder::~PlayblastRecorder() {
+    _drawTarget->Bind();
+    _engine.reset();
+    _drawTarget->Unbind();
+    glDeleteBuffers(2, _pixelBuffers);
+}
+
+void PlayblastRecorder::Update(std::chrono::milliseconds timeBudget) {
+    const auto start = std::chrono::steady_clock::now();
+    while (!_cancelled && !_writers.IsFull() && std::chrono::steady_clock::now() - start < timeBudget) {
+        if (_nextFrame < _frames.size()) {
+            if (!RenderFrame(_nextFrame)) {
+                continue; // A progressive renderer needs more passes
+            }
+            // The previous frame was copied while this one was rendered
+            if (_hasPendingFrame) {
+                ReadbackFrame(_pendingFrame);
+            }
+            _pendingFrame = _nextFrame++;
+            _hasPendingFrame = true;
+        } else if (_hasPendingFrame) {
+            ReadbackFrame(_pendingFrame);
+            _hasPendingFrame = false;
+        } else {
+            break;
+        }
+    }
+}
+
+void PlayblastRecorder::Cancel() {
+    _cancelled = true;
+    _writers.Cancel();
+}
+
+bool PlayblastRecorder::IsFinished() const {
+    return _cancelled || (_nextFrame == _frames.size() && !_hasPendingFrame &&
+                          GetWrittenCount() + GetFailedCount() == _frames.size());
+}
+
+bool PlayblastRecorder::RenderFrame(size_t frameIndex) {
+    const UsdTimeCode timeCode = _frames[frameIndex].timeCode;
+    const int width = _imageSize[0];
+    const int height = _imageSize[1];
+
+    _drawTarget->Bind();
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(_imagingSettings.clearColor[0], _imagingSettings.clearColor[1], _imagingSettings.clearColor[2],
+                 _imagingSettings.clearColor[3]);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glViewport(0, 0, width, height);
+
+    const UsdGeomCamera camera(_stage->GetPrimAtPath(_cameraPath));
+    _imagingSettings.frame = timeCode;
+    _imagingSettings.SetLightPositionFromCamera(camera.GetCamera(timeCode));
+    _engine->SetLightingState(_imagingSettings.GetLights(), _imagingSettings._material, _imagingSettings._ambient);
+    _engine->SetRenderViewport(GfVec4d(0, 0, width, height));
+    _engine->SetWindowPolicy(CameraUtilConformWindowPolicy::CameraUtilMatchHorizontally);
+    _engine->SetCameraPath(_cameraPath);
+    // The progressive renderers need multiple passes to converge, one pass is rendered per call so the time budget
+    // is respected. The renderers which never report the convergence are stopped after MaxRenderPasses
+    _engine->Render(_stage->GetPseudoRoot(), _imagingSettings);
+    if (!_engine->IsConverged() && ++_renderPasses < MaxRenderPasses) {
+        _drawTarget->Unbind();
+        return false;
+    }
+    _renderPasses = 0;
+
+    // Start copying the pixels, the copy is asynchronous as we read in a pixel buffer object
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pixelBuffers[frameIndex % 2]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    _drawTarget->Unbind();
+    return true;
+}
+
+void PlayblastRecorder::ReadbackFrame(size_t frameIndex) {
+    PlayblastImage image;
+    image.fileName = _frames[frameIndex].fileName;
+    image.width = _imageSize[0];
+    image.height = _imageSize[1];
+    const size_t imageSize = static_cast<size_t>(image.width) * static_cast<size_t>(image.height) * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _pixelBuffers[frameIndex % 2]);
+    if (const void *pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY)) {
+        const unsigned char *begin = static_cast<const unsigned char *>(pixels);
+        image.pixels.assign(begin, begin + imageSize);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (image.pixels.empty()) {
+        _readbackFailures++;
+    } else {
+        _writers.Push(std::move(image));
+    }
+}
+
 std::string PlayblastModalDialog::directory = "";
 std::string PlayblastModalDialog::filenamePrefix = "";
 int PlayblastModalDialog::start = -1;
 int PlayblastModalDialog::end = -1;
 int PlayblastModalDialog::width = 960;
+TfToken PlayblastModalDialog::rendererPlugin("HdStormRendererPlugin");
 
 PlayblastModalDialog::PlayblastModalDialog(UsdStagePtr stage) : _stage(stage) {
     if (directory.empty()) {
@@ -45,9 +349,20 @@ PlayblastModalDialog::PlayblastModalDialog(UsdStagePtr stage) : _stage(stage) {
     if (!_stageCameras.empty()) {
         _cameraPath = _stageCameras[0];
     }
+    _rendererPlugins = UsdImagingGLEngine::GetRendererPlugins();
 };
 
+PlayblastModalDialog::~PlayblastModalDialog() {}
+
 void PlayblastModalDialog::Draw() {
+    if (_recorder) {
+        DrawProgress();
+    } else {
+        DrawSettings();
+    }
+}
+
+void PlayblastModalDialog::DrawSettings() {
     // Draw available cameras
     const char *selectedCameraName = _cameraPath == SdfPath() ? "No camera" : _cameraPath.GetText();
     if (ImGui::BeginCombo("Stage camera", selectedCameraName)) {
@@ -58,6 +373,15 @@ void PlayblastModalDialog::Draw() {
         }
         ImGui::EndCombo();
     }
+    // The renderers running on the cpu, like Embree, allow to blast on the machines without gpu
+    if (ImGui::BeginCombo("Renderer", UsdImagingGLEngine::GetRendererDisplayName(rendererPlugin).c_str())) {
+        for (const TfToken &plugin : _rendererPlugins) {
+            if (ImGui::Selectable(UsdImagingGLEngine::GetRendererDisplayName(plugin).c_str(), plugin == rendererPlugin)) {
+                rendererPlugin = plugin;
+            }
+        }
+        ImGui::EndCombo();
+    }
     ImGui::Text("Scene materials ON");
     ImGui::Text("Purposes: default+proxy");
     ImGui::InputText("Output directory", &directory);
@@ -69,34 +393,21 @@ void PlayblastModalDialog::Draw() {
     }
     ImGui::InputInt("Image width", &width);
 
-    ImGui::BeginDisabled(directory.empty() || filenamePrefix.empty() || start > end || _cameraPath == SdfPath());
+    ImGui::BeginDisabled(directory.empty() || filenamePrefix.empty() || start > end || _cameraPath == SdfPath() ||
+                         width <= 0 || !fs::is_directory(fs::path(directory)));
     ImGui::Text("Rendering to : %s\\%s.#.jpg", directory.c_str(), filenamePrefix.c_str());
     if (ImGui::Button("Blast")) {
-        if (width > 0) {
-            _recorder.SetImageWidth(width);
-        }
-        _recorder.SetRendererPlugin(TfToken("HdStormRendererPlugin"));
-        _recorder.SetColorCorrectionMode(TfToken("sRGB"));
-        _recorder.SetComplexity(1.0);
-        UsdGeomCamera camera(_stage->GetPrimAtPath(_cameraPath));
+        std::vector<PlayblastRecorder::Frame> frames;
         if (isSequence) {
             for (int i = start; i <= end; ++i) {
-                std::string frameName = filenamePrefix + "." + std::to_string(i) + ".jpg";
-                fs::path outputFrame(directory);
-                if (fs::is_directory(outputFrame)) {
-                    outputFrame /= frameName;
-                    _recorder.Record(_stage, camera, UsdTimeCode(i), outputFrame.string());
-                }
+                const fs::path outputFrame = fs::path(directory) / (filenamePrefix + "." + std::to_string(i) + ".jpg");
+                frames.push_back({UsdTimeCode(i), outputFrame.string()});
             }
         } else {
-            std::string frameName = filenamePrefix + "." + ".jpg";
-            fs::path outputFrame(directory);
-            if (fs::is_directory(outputFrame)) {
-                outputFrame /= frameName;
-                _recorder.Record(_stage, camera, UsdTimeCode::Default(), outputFrame.string());
-            }
+            const fs::path outputFrame = fs::path(directory) / (filenamePrefix + ".jpg");
+            frames.push_back({UsdTimeCode::Default(), outputFrame.string()});
         }
-        CloseModal();
+        _recorder.reset(new PlayblastRecorder(_stage, _cameraPath, rendererPlugin, width, std::move(frames)));
     }
     ImGui::SameLine();
     ImGui::EndDisabled();
@@ -105,3 +416,27 @@ void PlayblastModalDialog::Draw() {
         CloseModal();
     }
 }
+
+void PlayblastModalDialog::DrawProgress() {
+    // Keep the ui responsive while rendering
+    _recorder->Update(std::chrono::milliseconds(30));
+
+    const int frameCount = static_cast<int>(_recorder->GetFrameCount());
+    const int renderedCount = static_cast<int>(_recorder->GetRenderedCount());
+    const int writtenCount = static_cast<int>(_recorder->GetWrittenCount());
+    const int failedCount = static_cast<int>(_recorder->GetFailedCount());
+    ImGui::Text("Rendered %d/%d frames", renderedCount, frameCount);
+    ImGui::ProgressBar(frameCount ? static_cast<float>(renderedCount) / frameCount : 1.f);
+    ImGui::Text("Written %d/%d images", writtenCount, frameCount);
+    ImGui::ProgressBar(frameCount ? static_cast<float>(writtenCount + failedCount) / frameCount : 1.f);
+    if (failedCount) {
+        ImGui::Text("%d images could not be written", failedCount);
+    }
+    if (ImGui::Button("Cancel")) {
+        _recorder->Cancel();
+    }
+    if (_recorder->IsFinished()) {
+        _recorder.reset();
+        CloseModal();
+    }
+}
@@ -1,33 +1,39 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
-#include <pxr/usdImaging/usdAppUtils/frameRecorder.h>
+#include <pxr/usd/usd/stage.h>
 
 #include "ModalDialogs.h"
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
+class PlayblastRecorder;
+
 /// Playblast dialog
-/// This is a minimal implementation of a playblast dialog using UsdAppUtilsFrameRecorder.
-/// It needs some improvements as it's not possible to blast the viewport camera unless it's a stage camera,
-/// we can't select the renderer, we can't change options like loading materials or not, change the file format ...
-/// Also there is not ui for selecting the output directory, and no progress bar.
-///
-/// For all of those desirable features we need to extract the code from UsdAppUtilsFrameRecorder into another frame recorder.
+/// The frames are rendered a few at a time on each ui frame, so the application stays responsive and the blast can be
+/// cancelled. The rendering, the readback of the images and their encoding overlap: an image is read back while the
+/// next one is rendered and the images are written to disk by a pool of threads.
+/// It's still not possible to blast the viewport camera unless it's a stage camera, and there is no ui for selecting
+/// the output directory.
 ///
 struct PlayblastModalDialog : public ModalDialog {
 
     PlayblastModalDialog(UsdStagePtr stage);
-    ~PlayblastModalDialog() override {}
+    ~PlayblastModalDialog() override;
 
     void Draw() override;
     const char *DialogId() const override { return "Playblast"; }
 
-    UsdAppUtilsFrameRecorder _recorder;
+    void DrawSettings();
+    void DrawProgress();
+
+    std::unique_ptr<PlayblastRecorder> _recorder;
     UsdStagePtr _stage;
     SdfPath _cameraPath;
     SdfPathVector _stageCameras;
+    TfTokenVector _rendererPlugins;
 
     static std::string directory;
     static std::string filenamePrefix;
@@ -35,4 +41,5 @@ struct PlayblastModalDialog : public ModalDialog {
     static int start;
     static int end;
     static int width;
+    static TfToken rendererPlugin;
 };
@@ -6,6 +6,7 @@
 #include "Viewport.h"
 #include <iostream>
 #include <pxr/base/gf/matrix4f.h>
+#include <pxr/usd/sdf/changeBlock.h>
 
 /*
     TODO:  we ultimately want to be compatible with Vulkan / Metal, the following opengl/glsl code should really be using the
@@ -163,19 +164,47 @@ void PositionManipulator::OnDrawFrame(const Viewport &viewport) {
 }
 
 void PositionManipulator::OnBeginEdition(Viewport &viewport) {
-    // Save original translation values
-    GfVec3f scale, pivot, rotation;
-    GfMatrix4d localTransform;
-    bool resetsXformStack = false;
-    _xformable.GetLocalTransformation(&localTransform, &resetsXformStack, viewport.GetCurrentTimeCode());
-    _translationOnBegin = localTransform.ExtractTranslation();
-
     // Save mouse position on selected axis
     const GfMatrix4d objectTransform = ComputeManipulatorToWorldTransform(viewport);
     _axisLine = GfLine(objectTransform.ExtractTranslation(), objectTransform.GetRow3(_selectedAxis));
     ProjectMouseOnAxis(viewport, _originMouseOnAxis);
 
     BeginEdition(viewport.GetCurrentStage());
+
+    // Save original translation values of all the selected prims. The xform ops are created here, as part of the edition,
+    // so they are only set when the mouse moves
+    _editedXformables.clear();
+    if (_xformable) {
+        const auto currentTime = viewport.GetCurrentTimeCode();
+        UsdGeomXformCache &xformCache = ResetManipulatorXformCache(currentTime);
+        const GfMatrix4d anchorParentToWorld = xformCache.GetParentToWorldTransform(_xformable.GetPrim());
+        for (const auto &xformable : GetSelectedXformables(viewport)) {
+            EditedXformable edited;
+            edited.editionTimeCode = GetEditionTimeCode(xformable, currentTime);
+            edited.isMatrixOp = false;
+            UsdGeomXformCommonAPI xformAPI(xformable.GetPrim());
+            if (xformAPI) {
+                edited.translateOp = xformAPI.CreateXformOps(UsdGeomXformCommonAPI::OpTranslate).translateOp;
+            } else { // Modify only if we have a single matrix
+                bool reset = false;
+                auto ops = xformable.GetOrderedXformOps(&reset);
+                if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
+                    edited.translateOp = ops[0];
+                    edited.isMatrixOp = true;
+                    edited.matrixOnBegin = ops[0].GetOpTransform(edited.editionTimeCode);
+                }
+            }
+            if (!edited.translateOp) {
+                continue;
+            }
+            GfMatrix4d localTransform;
+            bool resetsXformStack = false;
+            xformable.GetLocalTransformation(&localTransform, &resetsXformStack, currentTime);
+            edited.translationOnBegin = localTransform.ExtractTranslation();
+            edited.anchorToParent = anchorParentToWorld * xformCache.GetParentToWorldTransform(xformable.GetPrim()).GetInverse();
+            _editedXformables.push_back(edited);
+        }
+    }
 }
 
 Manipulator *PositionManipulator::OnUpdate(Viewport &viewport) {
@@ -184,7 +213,7 @@ Manipulator *PositionManipulator::OnUpdate(Viewport &viewport) {
         return viewport.GetManipulator<MouseHoverManipulator>();
     }
 
-    if (_xformable && _selectedAxis < 3) {
+    if (!_editedXformables.empty() && _selectedAxis < 3) {
         GfVec3d mouseOnAxis;
         ProjectMouseOnAxis(viewport, mouseOnAxis);
 
@@ -195,24 +224,30 @@ Manipulator *PositionManipulator::OnUpdate(Viewport &viewport) {
         _axisLine.FindClosestPoint(mouseOnAxis, &cur);
         double sign = cur > ori ? 1.0 : -1.0;
 
-        GfVec3d translation = _translationOnBegin;
-        translation[_selectedAxis] += sign * (_originMouseOnAxis - mouseOnAxis).GetLength();
-        if (_xformAPI) {
-            _xformAPI.SetTranslate(translation, GetEditionTimeCode(viewport));
-        } else {
-            bool reset = false;
-            auto ops = _xformable.GetOrderedXformOps(&reset);
-            if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
-                GfMatrix4d current = ops[0].GetOpTransform(GetEditionTimeCode(viewport));
+        // Translation in the anchor parent space
+        GfVec3d delta(0.0);
+        delta[_selectedAxis] = sign * (_originMouseOnAxis - mouseOnAxis).GetLength();
+
+        // All the prims are modified at once, the stage is recomposed only once per mouse move
+        SdfChangeBlock changeBlock;
+        for (const auto &edited : _editedXformables) {
+            const GfVec3d translation = edited.translationOnBegin + edited.anchorToParent.TransformDir(delta);
+            if (edited.isMatrixOp) {
+                GfMatrix4d current = edited.matrixOnBegin;
                 current.SetTranslateOnly(translation); // TODO: what happens if there is a pivot ???
-                ops[0].Set(current, GetEditionTimeCode(viewport));
+                edited.translateOp.Set(current, edited.editionTimeCode);
+            } else {
+                edited.translateOp.Set(translation, edited.editionTimeCode);
             }
         }
     }
     return this;
 };
 
-void PositionManipulator::OnEndEdition(Viewport &) { EndEdition(); };
+void PositionManipulator::OnEndEdition(Viewport &) {
+    _editedXformables.clear();
+    EndEdition();
+};
 
 ///
 void PositionManipulator::ProjectMouseOnAxis(const Viewport &viewport, GfVec3d &linePoint) {
@@ -225,14 +260,3 @@ void PositionManipulator::ProjectMouseOnAxis(const Viewport &viewport, GfVec3d &
         GfFindClosestPoints(mouseRay, _axisLine, &rayPoint, &linePoint, &a, &b);
     }
 }
-
-UsdTimeCode PositionManipulator::GetEditionTimeCode(const Viewport &viewport) {
-    std::vector<double> timeSamples; // TODO: is there a faster way to know it the xformable has timesamples ?
-    const auto xformable = UsdGeomXformable(_xformAPI.GetPrim());
-    xformable.GetTimeSamples(&timeSamples);
-    if (timeSamples.empty()) {
-        return UsdTimeCode::Default();
-    } else {
-        return viewport.GetCurrentTimeCode();
-    }
-}
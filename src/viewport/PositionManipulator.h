@@ -35,14 +35,23 @@ class PositionManipulator : public Manipulator {
     void ProjectMouseOnAxis(const Viewport &viewport, GfVec3d &closestPoint);
     GfMatrix4d ComputeManipulatorToWorldTransform(const Viewport &viewport);
 
-    UsdTimeCode GetEditionTimeCode(const Viewport &viewport);
-
     ManipulatorAxis _selectedAxis;
 
     GfVec3d _originMouseOnAxis;
-    GfVec3d _translationOnBegin;
     GfLine _axisLine;
 
+    // The manipulator is drawn on the anchor prim
     UsdGeomXformable _xformable;
     UsdGeomXformCommonAPI _xformAPI;
+
+    // Selected prims moved by the manipulator, with their values when the edition began
+    struct EditedXformable {
+        UsdGeomXformOp translateOp; // Translate op of the common api or single transform op
+        bool isMatrixOp;
+        GfVec3d translationOnBegin;
+        GfMatrix4d matrixOnBegin;
+        GfMatrix4d anchorToParent; // Converts a translation in the anchor parent space to the prim parent space
+        UsdTimeCode editionTimeCode;
+    };
+    std::vector<EditedXformable> _editedXformables;
 };
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <pxr/base/gf/line.h>
 #include <pxr/base/gf/math.h>
+#include <pxr/usd/sdf/changeBlock.h>
 #include <vector>
 
 #include "Commands.h"
@@ -222,94 +223,103 @@ void RotationManipulator::OnBeginEdition(Viewport &viewport) {
 
         // Compute rotation starting point
         _rotateFrom = ComputeClockHandVector(viewport);
-
-        // Save the rotation values
-        GfVec3d translation;
-        GfVec3f rotation, scale, pivot;
-        UsdGeomXformCommonAPI::RotationOrder rotOrder;
-        _xformAPI.GetXformVectorsByAccumulation(&translation, &rotation, &scale, &pivot, &rotOrder,
-                                                GetViewportTimeCode(viewport));
-
-        _rotateMatrixOnBegin =
-            UsdGeomXformOp::GetOpTransform(UsdGeomXformCommonAPI::ConvertRotationOrderToOpType(rotOrder), VtValue(rotation));
     }
     BeginEdition(viewport.GetCurrentStage());
+
+    // Save the rotation values of all the selected prims
+    _editedXformables.clear();
+    if (_xformable) {
+        const auto currentTime = GetViewportTimeCode(viewport);
+        for (const auto &xformable : GetSelectedXformables(viewport)) {
+            EditedXformable edited;
+            edited.editionTimeCode = GetEditionTimeCode(xformable, currentTime);
+            edited.isMatrixOp = false;
+            UsdGeomXformCommonAPI xformAPI(xformable.GetPrim());
+            GfVec3f pivot;
+            UsdGeomXformCommonAPI::RotationOrder rotOrder;
+            xformAPI.GetXformVectorsByAccumulation(&edited.translation, &edited.rotation, &edited.scale, &pivot, &rotOrder,
+                                                   currentTime);
+            if (xformAPI) {
+                edited.rotateOp = xformAPI.CreateXformOps(rotOrder, UsdGeomXformCommonAPI::OpRotate).rotateOp;
+            } else { // Modify only if we have a single matrix
+                bool reset = false;
+                auto ops = xformable.GetOrderedXformOps(&reset);
+                if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
+                    edited.rotateOp = ops[0];
+                    edited.isMatrixOp = true;
+                }
+            }
+            if (!edited.rotateOp) {
+                continue;
+            }
+            edited.rotateMatrixOnBegin = UsdGeomXformOp::GetOpTransform(
+                UsdGeomXformCommonAPI::ConvertRotationOrderToOpType(rotOrder), VtValue(edited.rotation));
+            _editedXformables.push_back(edited);
+        }
+    }
 }
 
 Manipulator *RotationManipulator::OnUpdate(Viewport &viewport) {
     if (ImGui::IsMouseReleased(0)) {
         return viewport.GetManipulator<MouseHoverManipulator>();
     }
-    if (_xformable && _selectedAxis != None) {
+    if (!_editedXformables.empty() && _selectedAxis != None) {
 
         // Compute rotation angle in world coordinates
         const GfVec3d rotateTo = ComputeClockHandVector(viewport);
         const GfRotation worldRotation(_rotateFrom, rotateTo);
         const auto axisSign = _planeNormal3d * worldRotation.GetAxis() > 0 ? 1.0 : -1.0;
 
-        // Compute rotation axis in local coordinates
-        // We use the plane normal as the rotation between _rotateFrom and rotateTo might not land exactly on the rotation axis
-        const GfVec3d xAxis = _rotateMatrixOnBegin.GetRow3(0);
-        const GfVec3d yAxis = _rotateMatrixOnBegin.GetRow3(1);
-        const GfVec3d zAxis = _rotateMatrixOnBegin.GetRow3(2);
-
-        GfVec3d localPlaneNormal = xAxis; // default init
-        if (_selectedAxis == XAxis) {
-            localPlaneNormal = xAxis;
-        } else if (_selectedAxis == YAxis) {
-            localPlaneNormal = yAxis;
-        } else if (_selectedAxis == ZAxis) {
-            localPlaneNormal = zAxis;
-        }
-
-        const GfRotation deltaRotation(localPlaneNormal * axisSign, worldRotation.GetAngle());
-        // NOTE: should that be _rotateMatrixOnBegin * deltaRotation instead ? the formula for opTrans use this order
-        const GfMatrix4d resultingRotation = GfMatrix4d(1.0).SetRotate(deltaRotation) * _rotateMatrixOnBegin;
+        // All the prims are modified at once, the stage is recomposed only once per mouse move
+        SdfChangeBlock changeBlock;
+        for (auto &edited : _editedXformables) {
+            // Compute rotation axis in local coordinates
+            // We use the plane normal as the rotation between _rotateFrom and rotateTo might not land exactly on the rotation
+            // axis
+            const GfVec3d xAxis = edited.rotateMatrixOnBegin.GetRow3(0);
+            const GfVec3d yAxis = edited.rotateMatrixOnBegin.GetRow3(1);
+            const GfVec3d zAxis = edited.rotateMatrixOnBegin.GetRow3(2);
+
+            GfVec3d localPlaneNormal = xAxis; // default init
+            if (_selectedAxis == XAxis) {
+                localPlaneNormal = xAxis;
+            } else if (_selectedAxis == YAxis) {
+                localPlaneNormal = yAxis;
+            } else if (_selectedAxis == ZAxis) {
+                localPlaneNormal = zAxis;
+            }
 
-        // Get latest rotation values to give a hint to the decompose function
-        GfVec3d translation;
-        GfVec3f rotation, scale, pivot;
-        UsdGeomXformCommonAPI::RotationOrder rotOrder;
-        _xformAPI.GetXformVectorsByAccumulation(&translation, &rotation, &scale, &pivot, &rotOrder,
-                                                GetViewportTimeCode(viewport));
-        double thetaTw = GfDegreesToRadians(rotation[0]);
-        double thetaFB = GfDegreesToRadians(rotation[1]);
-        double thetaLR = GfDegreesToRadians(rotation[2]);
-        double thetaSw = 0.0;
-        // Decompose the matrix in angle values
-        GfRotation::DecomposeRotation(resultingRotation, xAxis, yAxis, zAxis, 1.0, &thetaTw, &thetaFB, &thetaLR, &thetaSw, true);
-        const GfVec3f newRotationValues =
-            GfVec3f(GfRadiansToDegrees(thetaTw), GfRadiansToDegrees(thetaFB), GfRadiansToDegrees(thetaLR));
-        if (_xformAPI) {
-            _xformAPI.SetRotate(newRotationValues, rotOrder, GetEditionTimeCode(viewport));
-        } else { // Modify only if we have a single matrix
-            bool reset = false;
-            auto ops = _xformable.GetOrderedXformOps(&reset);
-            if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
+            const GfRotation deltaRotation(localPlaneNormal * axisSign, worldRotation.GetAngle());
+            if (edited.isMatrixOp) {
                 // [ "xformOp:translate", "xformOp:translate:pivot", "xformOp:rotateXYZ",
                 // "xformOp:scale", "!invert!xformOp:translate:pivot" ] - No pivot here
-                GfMatrix4d current = GfMatrix4d().SetScale(scale) * _rotateMatrixOnBegin *
-                                     GfMatrix4d(1.0).SetRotate(deltaRotation) * GfMatrix4d().SetTranslate(translation);
-                ops[0].Set(current, GetEditionTimeCode(viewport));
+                GfMatrix4d current = GfMatrix4d().SetScale(edited.scale) * edited.rotateMatrixOnBegin *
+                                     GfMatrix4d(1.0).SetRotate(deltaRotation) * GfMatrix4d().SetTranslate(edited.translation);
+                edited.rotateOp.Set(current, edited.editionTimeCode);
+                continue;
             }
+            // NOTE: should that be rotateMatrixOnBegin * deltaRotation instead ? the formula for opTrans use this order
+            const GfMatrix4d resultingRotation = GfMatrix4d(1.0).SetRotate(deltaRotation) * edited.rotateMatrixOnBegin;
+
+            // The latest rotation values give a hint to the decompose function
+            double thetaTw = GfDegreesToRadians(edited.rotation[0]);
+            double thetaFB = GfDegreesToRadians(edited.rotation[1]);
+            double thetaLR = GfDegreesToRadians(edited.rotation[2]);
+            double thetaSw = 0.0;
+            // Decompose the matrix in angle values
+            GfRotation::DecomposeRotation(resultingRotation, xAxis, yAxis, zAxis, 1.0, &thetaTw, &thetaFB, &thetaLR, &thetaSw,
+                                          true);
+            edited.rotation = GfVec3f(GfRadiansToDegrees(thetaTw), GfRadiansToDegrees(thetaFB), GfRadiansToDegrees(thetaLR));
+            edited.rotateOp.Set(edited.rotation, edited.editionTimeCode);
         }
     }
 
     return this;
 };
 
-void RotationManipulator::OnEndEdition(Viewport &) { EndEdition(); }
-
-// TODO code should be shared with position manipulator
-UsdTimeCode RotationManipulator::GetEditionTimeCode(const Viewport &viewport) {
-    std::vector<double> timeSamples; // TODO: is there a faster way to know it the xformable has timesamples ?
-    const auto xformable = UsdGeomXformable(_xformAPI.GetPrim());
-    xformable.GetTimeSamples(&timeSamples);
-    if (timeSamples.empty()) {
-        return UsdTimeCode::Default();
-    } else {
-        return GetViewportTimeCode(viewport);
-    }
+void RotationManipulator::OnEndEdition(Viewport &) {
+    _editedXformables.clear();
+    EndEdition();
 }
 
 UsdTimeCode RotationManipulator::GetViewportTimeCode(const Viewport &viewport) { return viewport.GetCurrentTimeCode(); }
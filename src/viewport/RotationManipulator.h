@@ -31,7 +31,6 @@ class RotationManipulator : public Manipulator {
     void OnSelectionChange(Viewport &) override;
 
   private:
-    UsdTimeCode GetEditionTimeCode(const Viewport &);
     UsdTimeCode GetViewportTimeCode(const Viewport &);
 
     GfVec3d ComputeClockHandVector(Viewport &viewport);
@@ -39,11 +38,23 @@ class RotationManipulator : public Manipulator {
     GfMatrix4d ComputeManipulatorToWorldTransform(const Viewport &viewport);
     ManipulatorAxis _selectedAxis;
 
+    // The manipulator is drawn on the anchor prim
     UsdGeomXformCommonAPI _xformAPI;
     UsdGeomXformable _xformable;
 
+    // Selected prims rotated by the manipulator, each one around its own pivot
+    struct EditedXformable {
+        UsdGeomXformOp rotateOp; // Rotate op of the common api or single transform op
+        bool isMatrixOp;
+        GfMatrix4d rotateMatrixOnBegin;
+        GfVec3f rotation; // Last rotation values, they give a hint to the decompose function
+        GfVec3d translation;
+        GfVec3f scale;
+        UsdTimeCode editionTimeCode;
+    };
+    std::vector<EditedXformable> _editedXformables;
+
     GfVec3d _rotateFrom;
-    GfMatrix4d _rotateMatrixOnBegin;
 
     GfVec3d _planeOrigin3d; // Global
     GfVec3d _planeNormal3d; // TODO rename global
@@ -6,6 +6,7 @@
 #include "Viewport.h"
 #include <iostream>
 #include <pxr/base/gf/matrix4f.h>
+#include <pxr/usd/sdf/changeBlock.h>
 
 /*
  *   Same code as PositionManipulator
@@ -139,19 +140,45 @@ void ScaleManipulator::OnDrawFrame(const Viewport &viewport) {
 }
 
 void ScaleManipulator::OnBeginEdition(Viewport &viewport) {
-    // Save original translation values
-    GfVec3d translation;
-    GfVec3f pivot, rotation;
-    UsdGeomXformCommonAPI::RotationOrder rotOrder;
-    _xformAPI.GetXformVectorsByAccumulation(&translation, &rotation, &_scaleOnBegin, &pivot, &rotOrder,
-                                            viewport.GetCurrentTimeCode());
-
     // Save mouse position on selected axis
     const GfMatrix4d objectTransform = ComputeManipulatorToWorldTransform(viewport);
     _axisLine = GfLine(objectTransform.ExtractTranslation(), objectTransform.GetRow3(_selectedAxis));
     ProjectMouseOnAxis(viewport, _originMouseOnAxis);
 
     BeginEdition(viewport.GetCurrentStage());
+
+    // Save original scale values of all the selected prims
+    _editedXformables.clear();
+    if (_xformable) {
+        const auto currentTime = viewport.GetCurrentTimeCode();
+        for (const auto &xformable : GetSelectedXformables(viewport)) {
+            EditedXformable edited;
+            edited.editionTimeCode = GetEditionTimeCode(xformable, currentTime);
+            edited.isMatrixOp = false;
+            UsdGeomXformCommonAPI xformAPI(xformable.GetPrim());
+            GfVec3d translation;
+            GfVec3f pivot, rotation;
+            UsdGeomXformCommonAPI::RotationOrder rotOrder;
+            xformAPI.GetXformVectorsByAccumulation(&translation, &rotation, &edited.scaleOnBegin, &pivot, &rotOrder,
+                                                   currentTime);
+            if (xformAPI) {
+                edited.scaleOp = xformAPI.CreateXformOps(UsdGeomXformCommonAPI::OpScale).scaleOp;
+            } else { // Modify only if we have a single matrix
+                bool reset = false;
+                auto ops = xformable.GetOrderedXformOps(&reset);
+                if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
+                    edited.scaleOp = ops[0];
+                    edited.isMatrixOp = true;
+                    const auto transMat = GfMatrix4d(1.0).SetTranslate(translation);
+                    const auto rotMat = xformAPI.GetRotationTransform(rotation, rotOrder);
+                    edited.rotateTranslateMatrix = rotMat * transMat;
+                }
+            }
+            if (edited.scaleOp) {
+                _editedXformables.push_back(edited);
+            }
+        }
+    }
 }
 
 Manipulator *ScaleManipulator::OnUpdate(Viewport &viewport) {
@@ -160,7 +187,7 @@ Manipulator *ScaleManipulator::OnUpdate(Viewport &viewport) {
         return viewport.GetManipulator<MouseHoverManipulator>();
     }
 
-    if (_xformable && _selectedAxis < 3) {
+    if (!_editedXformables.empty() && _selectedAxis < 3) {
         GfVec3d mouseOnAxis;
         ProjectMouseOnAxis(viewport, mouseOnAxis);
 
@@ -171,41 +198,34 @@ Manipulator *ScaleManipulator::OnUpdate(Viewport &viewport) {
         _axisLine.FindClosestPoint(mouseOnAxis, &cur);
         double sign = cur > ori ? 1.0 : -1.0;
 
-        GfVec3f scale = _scaleOnBegin;
-
         // TODO division per zero check
-        scale[_selectedAxis] = _scaleOnBegin[_selectedAxis] * mouseOnAxis.GetLength() / _originMouseOnAxis.GetLength();
-
-        if (ImGui::IsKeyDown(ImGuiKey_LeftShift)) {
-            scale[XAxis] = _scaleOnBegin[XAxis] * mouseOnAxis.GetLength() / _originMouseOnAxis.GetLength();
-            scale[YAxis] = _scaleOnBegin[YAxis] * mouseOnAxis.GetLength() / _originMouseOnAxis.GetLength();
-            scale[ZAxis] = _scaleOnBegin[XAxis] * mouseOnAxis.GetLength() / _originMouseOnAxis.GetLength();
-        } else {
-            scale[_selectedAxis] = _scaleOnBegin[_selectedAxis] * mouseOnAxis.GetLength() / _originMouseOnAxis.GetLength();
-        }
-
-        if (_xformAPI) {
-            _xformAPI.SetScale(scale, GetEditionTimeCode(viewport));
-        } else {
-            bool reset = false;
-            auto ops = _xformable.GetOrderedXformOps(&reset);
-            if (ops.size() == 1 && ops[0].GetOpType() == UsdGeomXformOp::Type::TypeTransform) {
-                GfVec3d translation;
-                GfVec3f scale_, pivot, rotation;
-                UsdGeomXformCommonAPI::RotationOrder rotOrder;
-                _xformAPI.GetXformVectorsByAccumulation(&translation, &rotation, &scale_, &pivot, &rotOrder,
-                                                        GetEditionTimeCode(viewport));
-                const auto transMat = GfMatrix4d(1.0).SetTranslate(translation);
-                const auto rotMat = _xformAPI.GetRotationTransform(rotation, rotOrder);
-                GfMatrix4d current = GfMatrix4d().SetScale(scale) * rotMat * transMat;
-                ops[0].Set(current, GetEditionTimeCode(viewport));
+        const float scaleFactor = mouseOnAxis.GetLength() / _originMouseOnAxis.GetLength();
+        const bool uniformScale = ImGui::IsKeyDown(ImGuiKey_LeftShift);
+
+        // All the prims are modified at once, the stage is recomposed only once per mouse move
+        SdfChangeBlock changeBlock;
+        for (const auto &edited : _editedXformables) {
+            GfVec3f scale = edited.scaleOnBegin;
+            if (uniformScale) {
+                scale *= scaleFactor;
+            } else {
+                scale[_selectedAxis] *= scaleFactor;
+            }
+            if (edited.isMatrixOp) {
+                GfMatrix4d current = GfMatrix4d().SetScale(scale) * edited.rotateTranslateMatrix;
+                edited.scaleOp.Set(current, edited.editionTimeCode);
+            } else {
+                edited.scaleOp.Set(scale, edited.editionTimeCode);
             }
         }
     }
     return this;
 };
 
-void ScaleManipulator::OnEndEdition(Viewport &) { EndEdition(); };
+void ScaleManipulator::OnEndEdition(Viewport &) {
+    _editedXformables.clear();
+    EndEdition();
+};
 
 ///
 void ScaleManipulator::ProjectMouseOnAxis(const Viewport &viewport, GfVec3d &linePoint) {
@@ -218,14 +238,3 @@ void ScaleManipulator::ProjectMouseOnAxis(const Viewport &viewport, GfVec3d &lin
         GfFindClosestPoints(mouseRay, _axisLine, &rayPoint, &linePoint, &a, &b);
     }
 }
-
-UsdTimeCode ScaleManipulator::GetEditionTimeCode(const Viewport &viewport) {
-    std::vector<double> timeSamples; // TODO: is there a faster way to know it the xformable has timesamples ?
-    const auto xformable = UsdGeomXformable(_xformAPI.GetPrim());
-    xformable.GetTimeSamples(&timeSamples);
-    if (timeSamples.empty()) {
-        return UsdTimeCode::Default();
-    } else {
-        return viewport.GetCurrentTimeCode();
-    }
-}
@@ -36,14 +36,22 @@ class ScaleManipulator : public Manipulator {
     void ProjectMouseOnAxis(const Viewport &viewport, GfVec3d &closestPoint);
     GfMatrix4d ComputeManipulatorToWorldTransform(const Viewport &viewport);
 
-    UsdTimeCode GetEditionTimeCode(const Viewport &viewport);
-
     ManipulatorAxis _selectedAxis;
 
     GfVec3d _originMouseOnAxis;
-    GfVec3f _scaleOnBegin;
     GfLine _axisLine;
 
+    // The manipulator is drawn on the anchor prim
     UsdGeomXformCommonAPI _xformAPI;
     UsdGeomXformable _xformable;
+
+    // Selected prims scaled by the manipulator, with their values when the edition began
+    struct EditedXformable {
+        UsdGeomXformOp scaleOp; // Scale op of the common api or single transform op
+        bool isMatrixOp;
+        GfVec3f scaleOnBegin;
+        GfMatrix4d rotateTranslateMatrix; // Kept when modifying a single transform op
+        UsdTimeCode editionTimeCode;
+    };
+    std::vector<EditedXformable> _editedXformables;
 };
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <pxr/usd/kind/registry.h>
 #include <pxr/usd/usd/modelAPI.h>
 #include <pxr/usd/usd/prim.h>
@@ -33,7 +34,60 @@ bool SelectionManipulator::IsPickablePath(const UsdStage &stage, const SdfPath &
     return false;
 }
 
+SdfPath SelectionManipulator::GetPickablePath(const UsdStage &stage, SdfPath path) {
+    while (!IsPickablePath(stage, path)) {
+        path = path.GetParentPath();
+    }
+    return path;
+}
+
+void SelectionManipulator::OnBeginEdition(Viewport &viewport) {
+    _rectangleStart = viewport.GetMousePosition();
+    _rectangleEnd = _rectangleStart;
+    _isDraggingRectangle = false;
+}
+
 Manipulator *SelectionManipulator::OnUpdate(Viewport &viewport) {
+    _rectangleEnd = viewport.GetMousePosition();
+    // Dragging a few pixels starts a rectangle selection
+    _isDraggingRectangle |= ImGui::IsMouseDragging(ImGuiMouseButton_Left);
+    if (ImGui::IsMouseDown(ImGuiMouseButton_Left)) {
+        return this;
+    }
+    if (_isDraggingRectangle) {
+        SelectInRectangle(viewport);
+    } else {
+        SelectUnderMouse(viewport);
+    }
+    return viewport.GetManipulator<MouseHoverManipulator>();
+}
+
+// The rectangle selection doesn't render a picking pass, it uses the bounds of the prims
+void SelectionManipulator::SelectInRectangle(Viewport &viewport) {
+    if (!viewport.GetCurrentStage()) {
+        return;
+    }
+    const UsdStage &stage = *viewport.GetCurrentStage();
+    const SdfPathVector paths = viewport.FindPrimsInRectangle(_rectangleStart, _rectangleEnd);
+    SdfPathSet pickedPaths;
+    for (const auto &path : paths) {
+        const SdfPath pickablePath = GetPickablePath(stage, path);
+        // No model or assembly above the prim
+        if (!pickablePath.IsAbsoluteRootPath()) {
+            pickedPaths.insert(pickablePath);
+        }
+    }
+    Selection &selection = viewport.GetSelection();
+    if (!ImGui::IsKeyDown(ImGuiKey_LeftShift)) {
+        selection.Clear(viewport.GetCurrentStage());
+    }
+    for (const auto &path : pickedPaths) {
+        // TODO: a command
+        selection.AddSelected(viewport.GetCurrentStage(), path);
+    }
+}
+
+void SelectionManipulator::SelectUnderMouse(Viewport &viewport) {
     Selection &selection = viewport.GetSelection();
     auto mousePosition = viewport.GetMousePosition();
     SdfPath outHitPrimPath;
@@ -42,9 +96,7 @@ Manipulator *SelectionManipulator::OnUpdate(Viewport &viewport) {
     viewport.TestIntersection(mousePosition, outHitPrimPath, outHitInstancerPath, outHitInstanceIndex);
     if (!outHitPrimPath.IsEmpty()) {
         if (viewport.GetCurrentStage()) {
-            while (!IsPickablePath(*viewport.GetCurrentStage(), outHitPrimPath)) {
-                outHitPrimPath = outHitPrimPath.GetParentPath();
-            }
+            outHitPrimPath = GetPickablePath(*viewport.GetCurrentStage(), outHitPrimPath);
         }
 
         if (ImGui::IsKeyDown(ImGuiKey_LeftShift)) {
@@ -56,11 +108,24 @@ Manipulator *SelectionManipulator::OnUpdate(Viewport &viewport) {
     } else if (outHitInstancerPath.IsEmpty()) {
         selection.Clear(viewport.GetCurrentStage());
     }
-    return viewport.GetManipulator<MouseHoverManipulator>();
 }
 
 void SelectionManipulator::OnDrawFrame(const Viewport &) {
-    // Draw a rectangle for the selection
+    if (!_isDraggingRectangle) {
+        return;
+    }
+    // Normalized screen coordinates to pixels
+    const ImVec2 size = ImGui::GetMainViewport()->WorkSize;
+    const auto toScreen = [&size](const GfVec2d &point) {
+        return ImVec2((point[0] + 1.0) * 0.5 * size.x, (1.0 - point[1]) * 0.5 * size.y);
+    };
+    const ImVec2 start = toScreen(_rectangleStart);
+    const ImVec2 end = toScreen(_rectangleEnd);
+    const ImVec2 rectMin(std::min(start.x, end.x), std::min(start.y, end.y));
+    const ImVec2 rectMax(std::max(start.x, end.x), std::max(start.y, end.y));
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    drawList->AddRectFilled(rectMin, rectMax, ImColor(ImVec4(1.0, 1.0, 1.0, 0.1)));
+    drawList->AddRect(rectMin, rectMax, ImColor(ImVec4(1.0, 1.0, 1.0, 0.8)));
 }
 
 void DrawPickMode(SelectionManipulator &manipulator) {
@@ -1,15 +1,19 @@
 #pragma once
+#include <pxr/base/gf/vec2d.h>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
 #include "Manipulator.h"
 
-/// The selection manipulator will help selecting a region of the viewport, drawing a rectangle.
+/// The selection manipulator selects the prim under the mouse when clicking, or the prims in the rectangle drawn
+/// when dragging the mouse.
 class SelectionManipulator : public Manipulator {
   public:
     SelectionManipulator() = default;
     ~SelectionManipulator() = default;
 
+    void OnBeginEdition(Viewport &) override;
+
     void OnDrawFrame(const Viewport &) override;
 
     Manipulator *OnUpdate(Viewport &) override;
@@ -19,10 +23,21 @@ class SelectionManipulator : public Manipulator {
     void SetPickMode(PickMode pickMode) { _pickMode = pickMode; }
     PickMode GetPickMode() const { return _pickMode; }
 
+    /// Returns the first ancestor of path, or path, which can be picked with the current pick mode
+    SdfPath GetPickablePath(const class UsdStage &stage, SdfPath path);
+
   private:
     // Returns true
     bool IsPickablePath(const class UsdStage &stage, const class SdfPath &path);
+    void SelectUnderMouse(Viewport &viewport);
+    void SelectInRectangle(Viewport &viewport);
+
     PickMode _pickMode = PickMode::Prim;
+
+    // Rectangle selection, in normalized screen coordinates
+    GfVec2d _rectangleStart;
+    GfVec2d _rectangleEnd;
+    bool _isDraggingRectangle = false;
 };
 
 /// Draw an ImGui menu to select the picking mode
@@ -1,3 +1,5 @@
+#include <array>
+#include <cmath>
 #include <iostream>
 
 #include <pxr/imaging/garch/glApi.h>
@@ -5,7 +7,6 @@
 #include <pxr/usd/usdGeom/boundable.h>
 #include <pxr/usd/usdGeom/camera.h>
 #include <pxr/usd/usdGeom/metrics.h>
-#include <pxr/usd/usdGeom/bboxCache.h>
 #include <pxr/usd/usdGeom/imageable.h>
 #include <pxr/usd/usdUtils/stageCache.h>
 
@@ -13,6 +14,8 @@
 #include "Viewport.h"
 #include "Commands.h"
 #include "Constants.h"
+#include "GeometricFunctions.h"
+#include "Profiler.h"
 #include "Shortcuts.h"
 #include "UsdPrimEditor.h" // DrawUsdPrimEditTarget
 
@@ -124,6 +127,8 @@ Viewport::Viewport(UsdStageRefPtr stage, Selection &selection)
     : _stage(stage), _cameraManipulator({InitialWindowWidth, InitialWindowHeight}),
       _currentEditingState(new MouseHoverManipulator()), _activeManipulator(&_positionManipulator), _selection(selection),
       _textureSize(1, 1), _selectedCameraPath(perspectiveCameraPath), _renderCamera(&_perspectiveCamera) {
+    _bboxCache.SetStage(stage);
+    _bvh.SetStage(stage);
 
     // Viewport draw target
     _cameraManipulator.ResetPosition(GetCurrentCamera());
@@ -138,21 +143,11 @@ Viewport::Viewport(UsdStageRefPtr stage, Selection &selection)
 }
 
 Viewport::~Viewport() {
-    if (_renderer) {
-        _renderer = nullptr; // will be deleted in the map
-    }
+    _renderer = nullptr; // will be deleted in the cache
     // Delete renderers
     _drawTarget->Bind();
-    for (auto &renderer : _renderers) {
-        // Warning, InvalidateBuffers might be defered ... :S to check
-        // removed in 20.11: renderer.second->InvalidateBuffers();
-        if (renderer.second) {
-            delete renderer.second;
-            renderer.second = nullptr;
-        }
-    }
+    _engines.Clear();
     _drawTarget->Unbind();
-    _renderers.clear();
 
 }
 
@@ -191,6 +186,10 @@ void Viewport::Draw() {
             DrawRendererSettings(*_renderer, _imagingSettings);
             ImGui::EndMenu();
         }
+        if (ImGui::BeginMenu("Hydra engines")) {
+            DrawHydraEngineCache(_engines, GetCurrentStage());
+            ImGui::EndMenu();
+        }
         ImGui::EndPopup();
     }
     ImGui::SameLine();
@@ -289,12 +288,8 @@ void Viewport::DrawManipulatorToolbox(const ImVec2 &cursorPos) {
 /// Frane the viewport using the bounding box of the selection
 void Viewport::FrameSelection(const Selection &selection) { // Camera manipulator ???
     if (GetCurrentStage() && !selection.IsSelectionEmpty(GetCurrentStage())) {
-        UsdGeomBBoxCache bboxcache(_imagingSettings.frame, UsdGeomImageable::GetOrderedPurposeTokens());
-        GfBBox3d bbox;
-        for (const auto &primPath : selection.GetSelectedPaths(GetCurrentStage())) {
-            bbox = GfBBox3d::Combine(bboxcache.ComputeWorldBound(GetCurrentStage()->GetPrimAtPath(primPath)), bbox);
-        }
-        auto defaultPrim = GetCurrentStage()->GetDefaultPrim();
+        _bboxCache.SetIncludedPurposes(GetDisplayedPurposes());
+        const GfBBox3d bbox = _bboxCache.ComputeWorldBound(selection.GetSelectedPaths(GetCurrentStage()), _imagingSettings.frame);
         _cameraManipulator.FrameBoundingBox(GetCurrentCamera(), bbox);
     }
 }
@@ -302,13 +297,89 @@ void Viewport::FrameSelection(const Selection &selection) { // Camera manipulato
 /// Frame the viewport using the bounding box of the root prim
 void Viewport::FrameRootPrim(){
     if (GetCurrentStage()) {
-        UsdGeomBBoxCache bboxcache(_imagingSettings.frame, UsdGeomImageable::GetOrderedPurposeTokens());
+        _bboxCache.SetIncludedPurposes(GetDisplayedPurposes());
         auto defaultPrim = GetCurrentStage()->GetDefaultPrim();
-        if(defaultPrim){
-            _cameraManipulator.FrameBoundingBox(GetCurrentCamera(), bboxcache.ComputeWorldBound(defaultPrim));
-        } else {
-            auto rootPrim = GetCurrentStage()->GetPrimAtPath(SdfPath("/"));
-            _cameraManipulator.FrameBoundingBox(GetCurrentCamera(), bboxcache.ComputeWorldBound(rootPrim));
+        const SdfPath framedPath = defaultPrim ? defaultPrim.GetPath() : SdfPath::AbsoluteRootPath();
+        _cameraManipulator.FrameBoundingBox(GetCurrentCamera(), _bboxCache.ComputeWorldBound(framedPath, _imagingSettings.frame));
+    }
+}
+
+// The framing and the bounds picking only include the purposes displayed in the viewport
+TfTokenVector Viewport::GetDisplayedPurposes() const {
+    TfTokenVector purposes = {UsdGeomTokens->default_};
+    if (_imagingSettings.showRender) {
+        purposes.push_back(UsdGeomTokens->render);
+    }
+    if (_imagingSettings.showProxy) {
+        purposes.push_back(UsdGeomTokens->proxy);
+    }
+    if (_imagingSettings.showGuides) {
+        purposes.push_back(UsdGeomTokens->guide);
+    }
+    return purposes;
+}
+
+SdfPathVector Viewport::FindPrimsInRectangle(const GfVec2d &corner1, const GfVec2d &corner2) {
+    if (!GetCurrentStage()) {
+        return {};
+    }
+    _bvh.Update(_imagingSettings.frame, GetDisplayedPurposes());
+    const GfVec2d center = (corner1 + corner2) * 0.5;
+    // The size of the narrowed frustum is relative to the full window which is 2 units wide in normalized coordinates
+    const GfVec2d size(std::max(std::abs(corner2[0] - corner1[0]) * 0.5, 1e-6),
+                       std::max(std::abs(corner2[1] - corner1[1]) * 0.5, 1e-6));
+    return _bvh.FindInFrustum(GetCurrentCamera().GetFrustum().ComputeNarrowedFrustum(center, size));
+}
+
+void Viewport::UpdateHoveredPrim() {
+    _hoveredPrimPath = SdfPath();
+    // The time changes every frame during playback, the hierarchy would never be up to date
+    if (!GetCurrentStage() || !_imagingSettings.hoverHighlight || IsPlaying()) {
+        return;
+    }
+    _bvh.Update(_imagingSettings.frame, GetDisplayedPurposes());
+    const SdfPath hitPath = _bvh.FindClosest(GetCurrentCamera().GetFrustum().ComputeRay(GetMousePosition()));
+    if (!hitPath.IsEmpty()) {
+        const SdfPath pickablePath = _selectionManipulator.GetPickablePath(*GetCurrentStage(), hitPath);
+        // No model or assembly above the prim
+        if (!pickablePath.IsAbsoluteRootPath()) {
+            _hoveredPrimPath = pickablePath;
+        }
+    }
+}
+
+// Draws the bounding box of the hovered prim
+void Viewport::DrawHoveredPrim() {
+    if (_hoveredPrimPath.IsEmpty() || !_imagingSettings.hoverHighlight || !GetCurrentStage() ||
+        _selection.IsSelected(GetCurrentStage(), _hoveredPrimPath)) {
+        return;
+    }
+    const GfBBox3d bbox = _bboxCache.ComputeWorldBound(_hoveredPrimPath, _imagingSettings.frame);
+    if (bbox.GetRange().IsEmpty()) {
+        return;
+    }
+    const auto &frustum = GetCurrentCamera().GetFrustum();
+    const auto mv = frustum.ComputeViewMatrix();
+    const auto proj = frustum.ComputeProjectionMatrix();
+    ImGuiViewport *viewport = ImGui::GetMainViewport();
+    const auto textureSize = GfVec2d(viewport->WorkSize[0], viewport->WorkSize[1]);
+    std::array<ImVec2, 8> corners;
+    for (size_t i = 0; i < corners.size(); ++i) {
+        const GfVec3d corner = bbox.GetMatrix().Transform(bbox.GetRange().GetCorner(i));
+        if (mv.Transform(corner)[2] >= 0.0) {
+            return; // The corner is behind the camera
+        }
+        const GfVec2d onScreen = ProjectToTextureScreenSpace(mv, proj, textureSize, corner);
+        corners[i] = ImVec2(onScreen[0], onScreen[1]);
+    }
+    // The corners of an edge differ by one bit of their index
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    const ImColor color(ImVec4(1.0, 1.0, 0.6, 0.8));
+    for (size_t i = 0; i < corners.size(); ++i) {
+        for (size_t axisBit = 1; axisBit < corners.size(); axisBit <<= 1) {
+            if (!(i & axisBit)) {
+                drawList->AddLine(corners[i], corners[i | axisBit], color);
+            }
         }
     }
 }
@@ -418,6 +489,7 @@ void Viewport::HandleManipulationEvents() {
             _currentEditingState->OnBeginEdition(*this);
         }
     } else { // Mouse is outside of the viewport, reset the state
+        ClearHoveredPrim();
         if (_currentEditingState) {
             _currentEditingState->OnEndEdition(*this);
             _currentEditingState = nullptr;
@@ -476,7 +548,27 @@ void Viewport::BeginHydraUI(int width, int height) {
 
 void Viewport ::EndHydraUI() { ImGui::End(); }
 
+// The hover manipulator is the idle state, the others are dragging the camera or the selected prims
+bool Viewport::IsInteracting() const {
+    return _currentEditingState && !dynamic_cast<MouseHoverManipulator *>(_currentEditingState);
+}
+
+// Smallest scale of the width and height of the hydra render
+static constexpr float MinRenderScale = 0.25f;
+
+// The render time is roughly proportional to the number of pixels, so the scale of the next interactive frame is
+// estimated with the square root of the ratio between the target time and the measured time.
+// The scale is kept between two interactions, the next one starts with the last resolution
+void Viewport::UpdateRenderScale(float renderScale, double renderTime) {
+    const double targetTime = _imagingSettings.targetFrameTime / 1000.0;
+    const double estimatedScale = renderScale * std::sqrt(targetTime / std::max(renderTime, 1e-4));
+    const float nextScale = static_cast<float>(std::max<double>(MinRenderScale, std::min(1.0, estimatedScale)));
+    // Smooth the changes of resolution while dragging
+    _interactiveRenderScale = 0.5f * (_interactiveRenderScale + nextScale);
+}
+
 void Viewport::Render() {
+    PROFILE_SCOPE("Viewport render");
     GfVec2i renderSize = _drawTarget->GetSize();
     int width = renderSize[0];
     int height = renderSize[1];
@@ -486,7 +578,11 @@ void Viewport::Render() {
 
     // Draw active manipulator and HUD
     BeginHydraUI(width, height);
+    DrawHoveredPrim();
     GetActiveManipulator().OnDrawFrame(*this);
+    if (_currentEditingState == &_selectionManipulator && _activeManipulator != &_selectionManipulator) {
+        _selectionManipulator.OnDrawFrame(*this); // Rectangle selection
+    }
     // DrawHUD(this);
     EndHydraUI();
 
@@ -497,13 +593,36 @@ void Viewport::Render() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glViewport(0, 0, width, height);
 
+    // Hydra renders at a reduced resolution while interacting, and at full resolution once the interaction stops
+    const bool adaptiveResolution = _imagingSettings.adaptiveResolution && _renderer && GetCurrentStage();
+    const float renderScale = adaptiveResolution && IsInteracting() ? _interactiveRenderScale : 1.f;
+    const GfVec2i hydraSize(std::max(1, static_cast<int>(width * renderScale)),
+                            std::max(1, static_cast<int>(height * renderScale)));
+    const bool isReduced = hydraSize != renderSize;
+    if (isReduced) {
+        if (!_reducedDrawTarget) {
+            _reducedDrawTarget = GlfDrawTarget::New(hydraSize, false);
+            _reducedDrawTarget->Bind();
+            _reducedDrawTarget->AddAttachment("color", GL_RGBA, GL_FLOAT, GL_RGBA);
+            _reducedDrawTarget->AddAttachment("depth", GL_DEPTH_COMPONENT, GL_FLOAT, GL_DEPTH_COMPONENT32F);
+        } else {
+            _reducedDrawTarget->Bind();
+            if (_reducedDrawTarget->GetSize() != hydraSize) {
+                _reducedDrawTarget->SetSize(hydraSize);
+            }
+        }
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glViewport(0, 0, hydraSize[0], hydraSize[1]);
+    }
+
     if (_renderer && GetCurrentStage()) {
         // Render hydra
         // Set camera and lighting state
+        const auto renderStart = clk::steady_clock::now();
 
         _imagingSettings.SetLightPositionFromCamera(GetCurrentCamera());
         _renderer->SetLightingState(_imagingSettings.GetLights(), _imagingSettings._material, _imagingSettings._ambient);
-        _renderer->SetRenderViewport(GfVec4d(0, 0, width, height));
+        _renderer->SetRenderViewport(GfVec4d(0, 0, hydraSize[0], hydraSize[1]));
         _renderer->SetWindowPolicy(CameraUtilConformWindowPolicy::CameraUtilMatchHorizontally);
         _imagingSettings.forceRefresh = true;
 
@@ -517,10 +636,26 @@ void Viewport::Render() {
                                   GetCurrentCamera().GetFrustum().ComputeProjectionMatrix());
         }
         _renderer->Render(GetCurrentStage()->GetPseudoRoot(), _imagingSettings);
+        if (adaptiveResolution && IsInteracting()) {
+            // Wait for the gpu, otherwise only the time spent on the cpu is measured. The idle frames are not
+            // measured so they don't stall the pipeline
+            glFinish();
+            UpdateRenderScale(renderScale, std::chrono::duration<double>(clk::steady_clock::now() - renderStart).count());
+        }
     } else {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     }
 
+    if (isReduced) {
+        // Upscale the color, the depth is copied for the grid
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, _reducedDrawTarget->GetFramebufferId());
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, _drawTarget->GetFramebufferId());
+        glBlitFramebuffer(0, 0, hydraSize[0], hydraSize[1], 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBlitFramebuffer(0, 0, hydraSize[0], hydraSize[1], 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        _reducedDrawTarget->Unbind(); // Binds _drawTarget again
+        glViewport(0, 0, width, height);
+    }
+
     // Draw grid. TODO: this should be in a usd render task
     _grid.Render(*this);
 
@@ -536,20 +671,22 @@ void Viewport::SetCurrentTimeCode(const UsdTimeCode &tc) {
 
 /// Update anything that could have change after a frame render
 void Viewport::Update() {
+    PROFILE_SCOPE("Viewport update");
     if (GetCurrentStage()) {
-        auto whichRenderer = _renderers.find(GetCurrentStage()); /// We expect a very limited number of opened stages
-        if (whichRenderer == _renderers.end()) {
-            SdfPathVector excludedPaths;
-            _renderer = new UsdImagingGLEngine(GetCurrentStage()->GetPseudoRoot().GetPath(), excludedPaths);
-            if (_renderers.empty()) {
+        const bool isFirstEngine = _engines.IsEmpty();
+        bool created = false;
+        UsdImagingGLEngine *renderer = _engines.GetEngine(GetCurrentStage(), created);
+        if (created) {
+            _renderer = renderer;
+            if (isFirstEngine) {
                 FrameRootPrim();
             }
-            _renderers[GetCurrentStage()] = _renderer;
             _cameraManipulator.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
             _grid.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
             InitializeRendererAov(*_renderer);
-        } else if (whichRenderer->second != _renderer) {
-            _renderer = whichRenderer->second;
+            _lastSelectionHash = 0; // The selection is sent to the new engine
+        } else if (renderer != _renderer) {
+            _renderer = renderer;
             _cameraManipulator.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
             // TODO: should reset the camera otherwise, depending on the position of the camera, the transform is incorrect
             _grid.SetZIsUp(UsdGeomGetStageUpAxis(GetCurrentStage()) == "Z");
@@ -557,6 +694,11 @@ void Viewport::Update() {
             //_selection =
         }
 
+        // Destroy the engines of the stages not displayed when the cache exceeds its limits
+        _drawTarget->Bind();
+        _engines.Evict(GetCurrentStage());
+        _drawTarget->Unbind();
+
         // This should be extracted in a Playback module,
         // also the current code is not providing the exact frame rate, it doesn't take into account when the frame is
         // displayed. This is a first implementation to get an idea of how it should interact with the rest of the application.
@@ -623,6 +765,8 @@ bool Viewport::TestIntersection(GfVec2d clickedPoint, SdfPath &outHitPrimPath, S
 }
 
 
+bool Viewport::IsConverged() const { return !_renderer || _renderer->IsConverged(); }
+
 void Viewport::StartPlayback() {
     _playing = true;
     _lastFrameTime = clk::steady_clock::now();
@@ -15,6 +15,9 @@
 #include "ScaleManipulator.h"
 #include "Selection.h"
 #include "Grid.h"
+#include "BoundingBoxCache.h"
+#include "BoundingVolumeHierarchy.h"
+#include "HydraEngineCache.h"
 #include <pxr/imaging/glf/drawTarget.h>
 #include <pxr/usd/usd/stage.h>
 #include <pxr/usdImaging/usdImagingGL/engine.h>
@@ -64,6 +67,14 @@ class Viewport final {
     bool TestIntersection(GfVec2d clickedPoint, SdfPath &outHitPrimPath, SdfPath &outHitInstancerPath, int &outHitInstanceIndex);
     GfVec2d GetPickingBoundarySize() const;
 
+    /// Prims whose bounds are in the rectangle defined by 2 corners in normalized screen coordinates. It doesn't render
+    /// a picking pass
+    SdfPathVector FindPrimsInRectangle(const GfVec2d &corner1, const GfVec2d &corner2);
+
+    /// Pre-highlight of the pickable prim under the mouse, found with its bounds
+    void UpdateHoveredPrim();
+    void ClearHoveredPrim() { _hoveredPrimPath = SdfPath(); }
+
     // Utility function for compute a scale for the manipulators. It uses the distance between the camera
     // and objectPosition. TODO: remove multiplier, not useful anymore
     double ComputeScaleFactor(const GfVec3d &objectPosition, double multiplier = 1.0) const;
@@ -93,7 +104,14 @@ class Viewport final {
     UsdStageRefPtr GetCurrentStage() { return _stage; }
     const UsdStageRefPtr GetCurrentStage() const { return _stage; };
 
-    void SetCurrentStage(UsdStageRefPtr stage) { _stage = stage; }
+    void SetCurrentStage(UsdStageRefPtr stage) {
+        _stage = stage;
+        _bboxCache.SetStage(stage);
+        _bvh.SetStage(stage);
+    }
+
+    /// The bounding volume hierarchy is built in the background when the stage is not edited
+    void SetStageMutex(std::mutex &stageMutex) { _bvh.SetStageMutex(&stageMutex); }
 
     Selection &GetSelection() { return _selection; }
 
@@ -107,6 +125,14 @@ class Viewport final {
     /// Playback controls
     void StartPlayback();
     void StopPlayback();
+    bool IsPlaying() const { return _playing; }
+
+    /// False while a progressive renderer is still refining the image
+    bool IsConverged() const;
+
+    /// Hydra engines of the stages displayed in this viewport
+    HydraEngineCache &GetHydraEngines() { return _engines; }
+    const HydraEngineCache &GetHydraEngines() const { return _engines; }
 
   private:
     // Manipulators
@@ -133,19 +159,30 @@ class Viewport final {
     // Hydra canvas
     void BeginHydraUI(int width, int height);
     void EndHydraUI();
+    bool IsInteracting() const;
+    void UpdateRenderScale(float renderScale, double renderTime);
+    TfTokenVector GetDisplayedPurposes() const;
+    void DrawHoveredPrim();
     GfVec2i _textureSize;
     GfVec2d _mousePosition;
     Grid _grid;
 
     UsdStageRefPtr _stage;
+    BoundingBoxCache _bboxCache;
+    BoundingVolumeHierarchy _bvh;
+    SdfPath _hoveredPrimPath;
 
     // Renderer
     GLuint _textureId = 0;
-    std::map<UsdStageRefPtr, UsdImagingGLEngine *> _renderers;
-    UsdImagingGLEngine *_renderer = nullptr;
+    HydraEngineCache _engines;
+    UsdImagingGLEngine *_renderer = nullptr; // Engine of the current stage, owned by _engines
     ImagingSettings _imagingSettings;
     GlfDrawTargetRefPtr _drawTarget;
 
+    // Adaptive resolution: hydra renders in a smaller draw target which is upscaled in _drawTarget
+    GlfDrawTargetRefPtr _reducedDrawTarget;
+    float _interactiveRenderScale = 1.f; // Scale of the next frame rendered while interacting
+
     // Playback controls
     bool _playing = false;
     std::chrono::time_point<std::chrono::steady_clock> _lastFrameTime;
@@ -3,6 +3,11 @@
 #include <memory>
 #include <regex>
 #include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/sdf/notice.h>
 #include <pxr/usd/usd/stage.h>
 #include "Gui.h"
 #include "ImGuiHelpers.h"
@@ -62,54 +67,210 @@ void DrawLayerTooltip(SdfLayerHandle layer) {
     }
 }
 
-static bool PassOptionsFilter(SdfLayerHandle layer, const ContentBrowserOptions &options, bool isStage) {
-    if (!options._filterAnonymous) {
-        if (layer->IsAnonymous())
-            return false;
+// Delay between two comparisons of the loaded layers with the registered ones, in seconds. There is no notice when a
+// layer is opened or released, the layers are also compared when the number of stages changes
+static constexpr double LayerRescanDelay = 2.0;
+
+///
+/// Layers listed by the content browser. Copying and hashing all the loaded layers every frame is costly in sessions
+/// with tens of thousands of layers, so the registry keeps the layers with their display data, updated by the Sdf
+/// notices, and a sorted and filtered view which is only computed again when the layers, the filter or the options
+/// have changed.
+///
+class LayerRegistry : public TfWeakBase {
+  public:
+    struct LayerEntry {
+        SdfLayerHandle layer;
+        std::string identifier;
+        std::string assetName;
+        std::string displayName; // GetDisplayName proved to be really slow when the number of layers is high
+        std::string realPath;
+        bool isAnonymous;
+        bool isDirty;
+        bool isStage;
+
+        const std::string &GetName(const ContentBrowserOptions &options) const {
+            if (options._showAssetName) {
+                return assetName;
+            } else if (options._showDisplayName) {
+                return displayName;
+            } else if (options._showRealPath) {
+                return realPath;
+            }
+            return identifier;
+        }
+    };
+
+    LayerRegistry() {
+        _noticeKeys.push_back(TfNotice::Register(TfCreateWeakPtr(this), &LayerRegistry::OnLayerDirtinessChanged));
+        _noticeKeys.push_back(TfNotice::Register(TfCreateWeakPtr(this), &LayerRegistry::OnLayerIdentifierDidChange));
+    }
+    ~LayerRegistry() { TfNotice::Revoke(&_noticeKeys); }
+
+    /// Returns the layers passing the filters, sorted by name
+    const std::vector<const LayerEntry *> &Update(UsdStageCache &cache, const TextFilter &filter,
+                                                 const ContentBrowserOptions &options);
+
+    /// A layer of the view was released, the loaded layers must be compared again
+    void InvalidateLayers() { _mustRescan = true; }
+
+  private:
+    // Only the entries of the sender layers are updated
+    void OnLayerDirtinessChanged(const SdfNotice::LayerDirtinessChanged &, const SdfLayerHandle &sender) {
+        _dirtinessChangedLayers.push_back(sender);
+    }
+    void OnLayerIdentifierDidChange(const SdfNotice::LayerIdentifierDidChange &, const SdfLayerHandle &sender) {
+        _identifierChangedLayers.push_back(sender);
+    }
+    LayerEntry *FindEntry(const SdfLayerHandle &layer);
+
+    bool RescanLayers();
+    void UpdateStageFlags(UsdStageCache &cache);
+    static void UpdateNames(LayerEntry &entry);
+    bool PassOptionsFilter(const LayerEntry &entry, const ContentBrowserOptions &options) const;
+
+    // The layers are keyed by their address, the entry is replaced if its handle expired and the address was reused
+    std::unordered_map<const SdfLayer *, std::unique_ptr<LayerEntry>> _entries;
+    std::vector<const LayerEntry *> _view;
+    TfNotice::Keys _noticeKeys;
+
+    double _lastRescanTime = -1.0;
+    size_t _stageCount = 0;
+    bool _mustRescan = true;
+    SdfLayerHandleVector _dirtinessChangedLayers;
+    SdfLayerHandleVector _identifierChangedLayers;
+    bool _viewChanged = true;
+    size_t _textFilterHash = 0;
+    size_t _optionsHash = 0;
+};
+
+// Returns nullptr if the layer is not registered yet, its entry is created with up to date data by the next rescan
+LayerRegistry::LayerEntry *LayerRegistry::FindEntry(const SdfLayerHandle &layer) {
+    if (!layer) {
+        return nullptr;
+    }
+    auto found = _entries.find(boost::get_pointer(layer));
+    return found != _entries.end() && found->second->layer == layer ? found->second.get() : nullptr;
+}
+
+void LayerRegistry::UpdateNames(LayerEntry &entry) {
+    entry.identifier = entry.layer->GetIdentifier();
+    entry.assetName = entry.layer->GetAssetName();
+    entry.displayName = entry.layer->GetDisplayName();
+    entry.realPath = entry.layer->GetRealPath();
+    entry.isAnonymous = entry.layer->IsAnonymous();
+}
+
+// Returns true if the registered layers have changed
+bool LayerRegistry::RescanLayers() {
+    const SdfLayerHandleSet loadedLayers = SdfLayer::GetLoadedLayers();
+    bool hasChanged = loadedLayers.size() != _entries.size();
+    std::unordered_map<const SdfLayer *, std::unique_ptr<LayerEntry>> entries;
+    entries.reserve(loadedLayers.size());
+    for (const auto &layer : loadedLayers) {
+        if (!layer) {
+            continue;
+        }
+        const SdfLayer *key = boost::get_pointer(layer);
+        auto found = _entries.find(key);
+        if (found != _entries.end() && found->second->layer) {
+            entries.emplace(key, std::move(found->second));
+        } else {
+            std::unique_ptr<LayerEntry> entry(new LayerEntry());
+            entry->layer = layer;
+            UpdateNames(*entry);
+            entry->isDirty = layer->IsDirty();
+            entry->isStage = false;
+            entries.emplace(key, std::move(entry));
+            hasChanged = true;
+        }
+    }
+    _entries.swap(entries);
+    return hasChanged;
+}
+
+void LayerRegistry::UpdateStageFlags(UsdStageCache &cache) {
+    std::unordered_set<const SdfLayer *> stageRootLayers;
+    for (const auto &stage : cache.GetAllStages()) {
+        stageRootLayers.insert(boost::get_pointer(stage->GetRootLayer()));
+    }
+    for (auto &entry : _entries) {
+        entry.second->isStage = stageRootLayers.count(entry.first) != 0;
+    }
+    _stageCount = cache.Size();
+}
+
+bool LayerRegistry::PassOptionsFilter(const LayerEntry &entry, const ContentBrowserOptions &options) const {
+    if (!options._filterAnonymous && entry.isAnonymous) {
+        return false;
     }
-    if (!options._filterFiles) {
-        if (!layer->IsAnonymous())
-            return false;
+    if (!options._filterFiles && !entry.isAnonymous) {
+        return false;
     }
-    if (!options._filterModified) {
-        if (layer->IsDirty())
-            return false;
+    if (!options._filterModified && entry.isDirty) {
+        return false;
     }
-    if (!options._filterUnmodified) {
-        if (!layer->IsDirty())
-            return false;
+    if (!options._filterUnmodified && !entry.isDirty) {
+        return false;
     }
-    if (!options._filterStage && isStage) {
+    if (!options._filterStage && entry.isStage) {
         return false;
     }
-    if (!options._filterLayer && !isStage) {
+    if (!options._filterLayer && !entry.isStage) {
         return false;
     }
     return true;
 }
 
-static const std::string &LayerNameFromOptions(const SdfLayerHandle &layer, const ContentBrowserOptions &options) {
-    // GetDisplayName proved to be really slow when the number of layers is high.
-    // We maintain a map to store the displayName and avoid allocating and releasing memory
-    static std::unordered_map<void const *, std::string> displayNames;
-    if (options._showAssetName) {
-        return layer->GetAssetName();
-    } else if (options._showDisplayName) {
-        auto displayNameIt = displayNames.find(layer->GetUniqueIdentifier());
-        if (displayNameIt == displayNames.end()) {
-            displayNames[layer->GetUniqueIdentifier()] = layer->GetDisplayName();
+const std::vector<const LayerRegistry::LayerEntry *> &LayerRegistry::Update(UsdStageCache &cache, const TextFilter &filter,
+                                                                            const ContentBrowserOptions &options) {
+    const double time = ImGui::GetTime();
+    if (_mustRescan || cache.Size() != _stageCount || time - _lastRescanTime >= LayerRescanDelay) {
+        if (RescanLayers() || cache.Size() != _stageCount) {
+            UpdateStageFlags(cache);
+            _viewChanged = true;
         }
-        return displayNames[layer->GetUniqueIdentifier()];
-    } else if (options._showRealPath) {
-        return layer->GetRealPath();
+        _lastRescanTime = time;
+        _mustRescan = false;
     }
-    return layer->GetIdentifier();
+    for (const auto &layer : _dirtinessChangedLayers) {
+        if (LayerEntry *entry = FindEntry(layer)) {
+            entry->isDirty = layer->IsDirty();
+            _viewChanged = true;
+        }
+    }
+    _dirtinessChangedLayers.clear();
+    for (const auto &layer : _identifierChangedLayers) {
+        if (LayerEntry *entry = FindEntry(layer)) {
+            UpdateNames(*entry);
+            _viewChanged = true;
+        }
+    }
+    _identifierChangedLayers.clear();
+    const size_t textFilterHash = filter.GetHash();
+    const size_t optionsHash = std::hash<ContentBrowserOptions>()(options);
+    if (_viewChanged || textFilterHash != _textFilterHash || optionsHash != _optionsHash) {
+        _view.clear();
+        for (const auto &entry : _entries) {
+            if (entry.second->layer && PassOptionsFilter(*entry.second, options) &&
+                filter.PassFilter(entry.second->GetName(options).c_str())) {
+                _view.push_back(entry.second.get());
+            }
+        }
+        std::sort(_view.begin(), _view.end(), [&](const LayerEntry *e1, const LayerEntry *e2) {
+            return e1->GetName(options) < e2->GetName(options);
+        });
+        _viewChanged = false;
+        _textFilterHash = textFilterHash;
+        _optionsHash = optionsHash;
+    }
+    return _view;
 }
 
-static inline void DrawSaveButton(SdfLayerHandle layer) {
+static inline void DrawSaveButton(SdfLayerHandle layer, bool isAnonymous, bool isDirty) {
     ScopedStyleColor style(ImGuiCol_Button, ImVec4(ColorTransparent), ImGuiCol_Text,
-                           layer->IsAnonymous() ? ImVec4(ColorTransparent)
-                                                : (layer->IsDirty() ? ImVec4(1.0, 1.0, 1.0, 1.0) : ImVec4(ColorTransparent)));
+                           isAnonymous ? ImVec4(ColorTransparent)
+                                       : (isDirty ? ImVec4(1.0, 1.0, 1.0, 1.0) : ImVec4(ColorTransparent)));
     if (ImGui::Button(ICON_FA_SAVE "###Save")) {
         ExecuteAfterDraw(&SdfLayer::Save, layer, true);
     }
@@ -144,64 +305,37 @@ static inline void DrawLayerDescriptionRow(SdfLayerHandle layer, bool isStage, c
     }
 }
 
-inline size_t ComputeLayerSetHash(SdfLayerHandleSet &layerSet) {
-    return boost::hash_range(layerSet.begin(), layerSet.end());
-}
-
-
-void DrawLayerSet(UsdStageCache &cache, SdfLayerHandleSet &layerSet, SdfLayerHandle *selectedLayer, SdfLayerHandle *selectedStage,
+void DrawLayerSet(UsdStageCache &cache, SdfLayerHandle *selectedLayer, SdfLayerHandle *selectedStage,
                   const ContentBrowserOptions &options, const ImVec2 &listSize = ImVec2(0, -10)) {
 
-    static std::vector<SdfLayerHandle> sortedLayerList;
-    static std::vector<SdfLayerHandle>::iterator endOfPartition = sortedLayerList.end();
-    static size_t pastLayerSetHash = 0;
+    static LayerRegistry registry;
     static TextFilter filter;
-    static size_t pastTextFilterHash;
-    static size_t pastOptionFilterHash;
     filter.Draw();
 
     ImGui::PushItemWidth(-1);
     if (ImGui::BeginListBox("##DrawLayerSet", listSize)) {
-        // Filter and sort the layer set. This is done only when the layer set or the filter have changed, otherwise it can be
-        // really costly to do it at every frame, mainly because of the string creation and deletion.
-        // We check if anything has changed using a hash which should be relatively quick to compute.
-        size_t currentLayerSetHash = ComputeLayerSetHash(layerSet);
-        size_t currentTextFilterHash = filter.GetHash();
-        size_t currentOptionFilterHash = std::hash<ContentBrowserOptions>()(options);
-        if (currentLayerSetHash != pastLayerSetHash || currentTextFilterHash != pastTextFilterHash ||
-            currentOptionFilterHash != pastOptionFilterHash) {
-            sortedLayerList.assign(layerSet.begin(), layerSet.end());
-            endOfPartition = partition(sortedLayerList.begin(), sortedLayerList.end(), [&](const auto &layer) {
-                const bool isStage = cache.FindOneMatching(layer);
-                return filter.PassFilter(LayerNameFromOptions(layer, options).c_str()) &&
-                       PassOptionsFilter(layer, options, isStage);
-            });
-
-            std::sort(sortedLayerList.begin(), endOfPartition, [&](const auto &t1, const auto &t2) {
-                return LayerNameFromOptions(t1, options) < LayerNameFromOptions(t2, options);
-            });
-            pastLayerSetHash = currentLayerSetHash;
-            pastTextFilterHash = currentTextFilterHash;
-            pastOptionFilterHash = currentOptionFilterHash;
-        }
+        const auto &layers = registry.Update(cache, filter, options);
         //
         // Actual drawing of the listed layers using a clipper, we only draw the visible lines
         //
         ImGuiListClipper clipper;
-        clipper.Begin(static_cast<int>(std::distance(sortedLayerList.begin(), endOfPartition)));
+        clipper.Begin(static_cast<int>(layers.size()));
         while (clipper.Step()) {
             for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
-                const auto &layer = sortedLayerList[row];
-                const std::string &layerName = LayerNameFromOptions(layer, options);
-                const bool isStage = cache.FindOneMatching(layer);
+                const auto &entry = *layers[row];
+                const auto &layer = entry.layer;
+                if (!layer) {
+                    registry.InvalidateLayers();
+                    continue;
+                }
                 ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, ImGui::GetStyle().ItemSpacing.y));
                 ImGui::PushID(layer->GetUniqueIdentifier());
-                DrawSelectStageButton(layer, isStage, selectedStage);
+                DrawSelectStageButton(layer, entry.isStage, selectedStage);
                 ImGui::SameLine();
-                DrawSaveButton(layer);
+                DrawSaveButton(layer, entry.isAnonymous, entry.isDirty);
                 ImGui::PopStyleVar();
                 ImGui::SameLine();
-                DrawLayerDescriptionRow(layer, isStage, layerName, selectedLayer, selectedStage);
+                DrawLayerDescriptionRow(layer, entry.isStage, entry.GetName(options), selectedLayer, selectedStage);
 
                 if (ImGui::IsItemHovered() && GImGui->HoveredIdTimer > 2) {
                     DrawLayerTooltip(layer);
@@ -261,8 +395,7 @@ void DrawContentBrowser(Editor &editor) {
     // TODO: we might want to remove completely the editor here, just pass as selected layer and a selected stage
     SdfLayerHandle selectedLayer(editor.GetCurrentLayer());
     SdfLayerHandle selectedStage(editor.GetCurrentStage() ? editor.GetCurrentStage()->GetRootLayer() : SdfLayerHandle());
-    auto layers = SdfLayer::GetLoadedLayers();
-    DrawLayerSet(editor.GetStageCache(), layers, &selectedLayer, &selectedStage, options);
+    DrawLayerSet(editor.GetStageCache(), &selectedLayer, &selectedStage, options);
     if (selectedLayer != editor.GetCurrentLayer()) {
         ExecuteAfterDraw<EditorSetSelection>(selectedLayer, SdfPath::AbsoluteRootPath());
     }
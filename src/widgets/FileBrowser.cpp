@@ -1,12 +1,19 @@
 /// File browser
 /// This is a first quick and dirty implementation,
-/// it should be improved to avoid using globals,
-/// split the ui and filesystem code, remove the polling timer, etc.
+/// it should be improved to avoid using globals.
+/// The directories are listed by a background thread, see DirectoryScanner.
 
 #include <iostream>
 #include <functional>
 #include <ctime>
 #include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 
 #if defined(__cplusplus) && __cplusplus >= 201703L && defined(__has_include) && __has_include(<filesystem>)
@@ -23,6 +30,16 @@ namespace fs = ghc::filesystem;
 #include "ImGuiHelpers.h"
 #include "Gui.h"
 
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifndef _WIN64
+#include <sys/stat.h>
+#endif
+
 namespace clk = std::chrono;
 using DrivesListT = std::vector<std::pair<std::string, std::string>>;
 
@@ -182,36 +199,337 @@ static bool DrawRefreshButton() {
     return false;
 }
 
-static inline bool FileNameStartsWithDot(const fs::path &path) {
-    const std::string &filename = path.filename().string();
-    return filename.size() > 0 && filename[0] == '.';
+/// Directory entry, the file system is queried once when the directory is scanned
+struct FileEntry {
+    fs::path path;
+    std::string fileName;
+    std::string extension;
+    std::string lastModified; // Formatted date, empty if it couldn't be read
+    uintmax_t size;
+    bool isDirectory;
+};
+
+// Directories first, then files, sorted by name
+static bool CompareDirectoryThenFile(const FileEntry &a, const FileEntry &b) {
+    if (a.isDirectory == b.isDirectory) {
+        return a.fileName < b.fileName;
+    }
+    return a.isDirectory > b.isDirectory;
+}
+
+// Number of entries sent at once to the ui while streaming the content of a directory
+static constexpr size_t ScanBatchSize = 256;
+
+// Number of directory listings kept to display the directories visited again without waiting for their scan
+static constexpr size_t MaxCachedDirectories = 64;
+
+// Refresh delay of the displayed directory when it can't be watched, in seconds
+static constexpr int ScanPollingDelay = 5;
+
+///
+/// Lists the directories on a background thread, so the ui doesn't stall on slow network file systems.
+/// Each entry is queried once, the listings are cached by directory and the displayed directory is refreshed when it
+/// changes. On linux the changes are notified by inotify, the other platforms poll the directory on the background thread.
+/// The entries of a directory which isn't cached are streamed to the ui by batches.
+///
+class DirectoryScanner {
+  public:
+    DirectoryScanner();
+    ~DirectoryScanner();
+
+    /// Displays a new directory, the cached listing is returned in entries if there is one, it is then refreshed
+    /// in the background. forceRescan discards the cached listing.
+    void SetDirectory(const fs::path &directory, bool forceRescan, std::vector<FileEntry> &entries);
+
+    /// Moves the entries scanned since the last call into entries. Returns true if entries was modified
+    bool Update(std::vector<FileEntry> &entries);
+
+    bool IsScanning() const { return _isScanning; }
+
+  private:
+    void Run();
+    // Returns false if the scan was interrupted by a new request
+    bool Scan(const fs::path &directory, size_t generation, bool streamed);
+    static bool ReadEntry(const fs::directory_entry &item, FileEntry &entry);
+    void WatchDirectory(const fs::path &directory);
+    bool WaitForChanges(std::unique_lock<std::mutex> &lock);
+    bool ReadWatchEvents();
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _requested;
+    bool _stopping = false;
+    std::atomic<bool> _isScanning{false};
+
+    // Request of the ui
+    fs::path _directory;
+    size_t _generation = 0; // Incremented at each request, the outdated scans are interrupted
+    bool _mustScan = false;
+    bool _streamed = false;
+
+    // Results waiting for the ui
+    size_t _outputGeneration = 0;
+    bool _outputReset = false; // The ui must clear its entries before appending the output ones
+    std::vector<FileEntry> _outputEntries;
+
+    // Complete listings, by directory
+    std::unordered_map<std::string, std::vector<FileEntry>> _cache;
+    std::deque<std::string> _cacheOrder; // Least recently scanned first
+
+#ifdef __linux__
+    int _inotifyFd = -1;
+    int _watchDescriptor = -1;
+    fs::path _watchedDirectory;
+#endif
+};
+
+DirectoryScanner::DirectoryScanner() {
+#ifdef __linux__
+    _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+    _thread = std::thread(&DirectoryScanner::Run, this);
+}
+
+DirectoryScanner::~DirectoryScanner() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+        _generation++;
+    }
+    _requested.notify_one();
+    _thread.join();
+#ifdef __linux__
+    if (_inotifyFd >= 0) {
+        close(_inotifyFd);
+    }
+#endif
 }
 
-static bool ShouldBeDisplayed(const fs::directory_entry &p) {
-    const auto &filename = p.path().filename();
-    const auto startsWithDot = FileNameStartsWithDot(p.path());
-    bool endsWithValidExt = true;
-    if (!validExts.empty()) {
-        endsWithValidExt = false;
-        for (auto ext : validExts) { // we could stop the loop when the extension is found
-            endsWithValidExt |= filename.extension() == ext;
+void DirectoryScanner::SetDirectory(const fs::path &directory, bool forceRescan, std::vector<FileEntry> &entries) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (directory == _directory && !forceRescan) {
+            return;
+        }
+        _directory = directory;
+        _generation++;
+        _mustScan = true;
+        auto cached = _cache.find(directory.string());
+        if (cached != _cache.end() && !forceRescan) {
+            entries = cached->second;
+            _streamed = false; // The listing is replaced once the refresh is complete
+        } else {
+            entries.clear();
+            _streamed = true;
         }
+        _outputReset = false;
+        _outputEntries.clear();
     }
+    _requested.notify_one();
+}
 
-    try {
-        const bool isDirectory = fs::is_directory(p);
-        return !startsWithDot && (isDirectory || endsWithValidExt) && !fs::is_symlink(p);
-    } catch (fs::filesystem_error &) {
+bool DirectoryScanner::Update(std::vector<FileEntry> &entries) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_outputGeneration != _generation || (!_outputReset && _outputEntries.empty())) {
         return false;
     }
+    if (_outputReset) {
+        entries.clear();
+        _outputReset = false;
+    }
+    // Merge the sorted batch with the sorted entries
+    const size_t previousSize = entries.size();
+    entries.insert(entries.end(), std::make_move_iterator(_outputEntries.begin()), std::make_move_iterator(_outputEntries.end()));
+    std::inplace_merge(entries.begin(), entries.begin() + previousSize, entries.end(), CompareDirectoryThenFile);
+    _outputEntries.clear();
+    return true;
 }
 
-// Compare function for sorting directories before files
-static bool compareDirectoryThenFile(const fs::directory_entry &a, const fs::directory_entry &b) {
-    if (fs::is_directory(a) == fs::is_directory(b)) {
-        return a < b;
-    } else {
-        return fs::is_directory(a) > fs::is_directory(b);
+bool DirectoryScanner::ReadEntry(const fs::directory_entry &item, FileEntry &entry) {
+    std::error_code error;
+    entry.path = item.path();
+    entry.fileName = entry.path.filename().string();
+    // Hidden files and symlinks are not displayed
+    if (entry.fileName.empty() || entry.fileName[0] == '.') {
+        return false;
+    }
+    time_t cftime = 0;
+#ifdef _WIN64
+    // The directory iterator caches the attributes of the entries
+    const fs::file_status linkStatus = item.symlink_status(error);
+    if (error || fs::is_symlink(linkStatus)) {
+        return false;
+    }
+    entry.isDirectory = fs::is_directory(linkStatus);
+    entry.size = entry.isDirectory ? 0 : item.file_size(error);
+    if (error) {
+        entry.size = 0;
+    }
+    const auto lastModified = item.last_write_time(error);
+    if (!error) {
+        cftime = decltype(lastModified)::clock::to_time_t(lastModified);
+    }
+#else
+    // A single lstat gives the type, the size and the modification time, the filesystem functions would stat
+    // the file for each of them
+    struct stat status;
+    if (lstat(entry.path.c_str(), &status) != 0 || S_ISLNK(status.st_mode)) {
+        return false;
+    }
+    entry.isDirectory = S_ISDIR(status.st_mode);
+    entry.size = entry.isDirectory ? 0 : static_cast<uintmax_t>(status.st_size);
+    cftime = status.st_mtime;
+#endif
+    entry.extension = entry.path.extension().string();
+    if (cftime) {
+        struct tm lt; // Convert to local time
+        localtime_(&lt, &cftime);
+        char date[32];
+        snprintf(date, sizeof(date), "%04d/%02d/%02d %02d:%02d", 1900 + lt.tm_year, lt.tm_mon + 1, lt.tm_mday, lt.tm_hour,
+                 lt.tm_min);
+        entry.lastModified = date;
+    }
+    return true;
+}
+
+// Runs on the background thread
+bool DirectoryScanner::Scan(const fs::path &directory, size_t generation, bool streamed) {
+    std::vector<FileEntry> entries;
+    std::vector<FileEntry> batch;
+    // Returns false if the ui has requested another directory
+    const auto publish = [&](bool reset) {
+        std::sort(batch.begin(), batch.end(), CompareDirectoryThenFile);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (generation != _generation) {
+            return false;
+        }
+        _outputGeneration = generation;
+        _outputReset |= reset;
+        _outputEntries.insert(_outputEntries.end(), batch.begin(), batch.end());
+        batch.clear();
+        return true;
+    };
+    std::error_code error;
+    bool isFirstBatch = true;
+    for (fs::directory_iterator it(directory, fs::directory_options::skip_permission_denied, error), end; !error && it != end;
+         it.increment(error)) {
+        FileEntry entry;
+        if (ReadEntry(*it, entry)) {
+            entries.push_back(entry);
+            if (streamed) {
+                batch.push_back(std::move(entry));
+                if (batch.size() == ScanBatchSize) {
+                    if (!publish(isFirstBatch)) {
+                        return false;
+                    }
+                    isFirstBatch = false;
+                }
+            }
+        }
+    }
+    if (!streamed) {
+        batch = entries; // The whole listing replaces the displayed one
+    }
+    if (!publish(isFirstBatch || !streamed)) {
+        return false;
+    }
+    std::sort(entries.begin(), entries.end(), CompareDirectoryThenFile);
+    std::lock_guard<std::mutex> lock(_mutex);
+    const std::string cacheKey = directory.string();
+    const auto cacheOrderIt = std::find(_cacheOrder.begin(), _cacheOrder.end(), cacheKey);
+    if (cacheOrderIt != _cacheOrder.end()) {
+        _cacheOrder.erase(cacheOrderIt);
+    }
+    _cacheOrder.push_back(cacheKey);
+    _cache[cacheKey] = std::move(entries);
+    while (_cacheOrder.size() > MaxCachedDirectories) {
+        _cache.erase(_cacheOrder.front());
+        _cacheOrder.pop_front();
+    }
+    return true;
+}
+
+void DirectoryScanner::WatchDirectory(const fs::path &directory) {
+#ifdef __linux__
+    // Removing a watch queues an IN_IGNORED event, so the directory is watched again only when it has changed
+    if (_inotifyFd < 0 || (directory == _watchedDirectory && _watchDescriptor >= 0)) {
+        return;
+    }
+    if (_watchDescriptor >= 0) {
+        inotify_rm_watch(_inotifyFd, _watchDescriptor);
+    }
+    _watchedDirectory = directory;
+    _watchDescriptor = inotify_add_watch(_inotifyFd, directory.string().c_str(),
+                                         IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE | IN_ATTRIB);
+#endif
+}
+
+// Reads the pending inotify events, returns true if one of them is a change in the watched directory
+bool DirectoryScanner::ReadWatchEvents() {
+    bool hasChanged = false;
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    ssize_t length = 0;
+    while ((length = read(_inotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < length;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+            // The events of the previously watched directories and the removal of their watch are ignored
+            if (event->wd == _watchDescriptor && !(event->mask & IN_IGNORED)) {
+                hasChanged = true;
+            }
+            offset += sizeof(inotify_event) + event->len;
+        }
+    }
+#endif
+    return hasChanged;
+}
+
+// Waits for a request or a change in the watched directory, returns true if the directory has changed
+bool DirectoryScanner::WaitForChanges(std::unique_lock<std::mutex> &lock) {
+#ifdef __linux__
+    if (_inotifyFd >= 0 && _watchDescriptor >= 0) {
+        while (!_stopping && !_mustScan) {
+            lock.unlock();
+            pollfd pollFd{_inotifyFd, POLLIN, 0};
+            const bool hasChanged = poll(&pollFd, 1, 100) > 0 && ReadWatchEvents();
+            if (hasChanged) {
+                // The events are only used as a signal, a batch of changes is merged in a single scan
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                ReadWatchEvents();
+            }
+            lock.lock();
+            if (hasChanged) {
+                return true;
+            }
+        }
+        return false;
+    }
+#endif
+    // Polling, the directory is scanned again after a delay
+    return !_requested.wait_for(lock, std::chrono::seconds(ScanPollingDelay), [this]() { return _stopping || _mustScan; });
+}
+
+void DirectoryScanner::Run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _requested.wait(lock, [this]() { return _stopping || _mustScan; });
+    while (!_stopping) {
+        const fs::path directory = _directory;
+        const size_t generation = _generation;
+        const bool streamed = _streamed;
+        _mustScan = false;
+        lock.unlock();
+        WatchDirectory(directory);
+        _isScanning = true;
+        Scan(directory, generation, streamed);
+        _isScanning = false;
+        lock.lock();
+        // The displayed directory is scanned again when it changes, the changes are not streamed
+        while (!_stopping && !_mustScan) {
+            if (WaitForChanges(lock) && !_mustScan && !_stopping) {
+                _mustScan = true;
+                _streamed = false;
+            }
+        }
     }
 }
 
@@ -228,14 +546,21 @@ static void DrawFileSize(uintmax_t fileSize) {
 
 void DrawFileBrowser() {
 
-
+    static DirectoryScanner scanner;
     static fs::path displayedFileName;
-    static std::vector<fs::directory_entry> directoryContent;
+    static std::vector<FileEntry> directoryContent;
     static bool mustUpdateDirectoryContent = true;
+    static bool mustRescanDirectory = false;
     static bool mustUpdateChosenFileName = false;
+    static std::string parsedLineEditBuffer;
 
     // Parse the line buffer containing the user input and try to make sense of it
     auto ParseLineBufferEdit = [&]() {
+        // The file system is only queried when the buffer has changed
+        if (lineEditBuffer == parsedLineEditBuffer) {
+            return;
+        }
+        parsedLineEditBuffer = lineEditBuffer;
         auto path = fs::path(lineEditBuffer);
         if (path != path.root_name() && fs::is_directory(path)) {
             displayedDirectory = path;
@@ -261,18 +586,6 @@ void DrawFileBrowser() {
         }
     };
 
-    // Update the list of entries for the chosen directory
-    auto UpdateDirectoryContent = [&]() {
-        directoryContent.clear();
-        for (auto &item : fs::directory_iterator(displayedDirectory, fs::directory_options::skip_permission_denied)) {
-            if (ShouldBeDisplayed(item)) {
-                directoryContent.push_back(item);
-            };
-        }
-        std::sort(directoryContent.begin(), directoryContent.end(), compareDirectoryThenFile);
-        mustUpdateDirectoryContent = false;
-    };
-
     if (mustUpdateChosenFileName) {
         if (!displayedDirectory.empty() && !displayedFileName.empty() && fs::exists(displayedDirectory) &&
             fs::is_directory(displayedDirectory)) {
@@ -288,12 +601,28 @@ void DrawFileBrowser() {
     // We scan the line buffer edit every second, no need to do it at every frame
     EverySecond(ParseLineBufferEdit);
 
-    mustUpdateDirectoryContent |= DrawRefreshButton();
+    mustRescanDirectory |= DrawRefreshButton();
     ImGui::SameLine();
     mustUpdateDirectoryContent |= DrawNavigationBar(displayedDirectory);
 
-    if (mustUpdateDirectoryContent) {
-        UpdateDirectoryContent();
+    if (mustUpdateDirectoryContent || mustRescanDirectory) {
+        scanner.SetDirectory(displayedDirectory, mustRescanDirectory, directoryContent);
+        mustUpdateDirectoryContent = false;
+        mustRescanDirectory = false;
+    }
+    scanner.Update(directoryContent);
+
+    // The extensions are filtered on the displayed entries, the cached listings are shared by all the file dialogs
+    const auto isDisplayed = [](const FileEntry &entry) {
+        return entry.isDirectory || validExts.empty() ||
+               std::find(validExts.begin(), validExts.end(), entry.extension) != validExts.end();
+    };
+    static std::vector<const FileEntry *> displayedEntries;
+    displayedEntries.clear();
+    for (const auto &entry : directoryContent) {
+        if (isDisplayed(entry)) {
+            displayedEntries.push_back(&entry);
+        }
     }
 
     // Get window size
@@ -309,52 +638,53 @@ void DrawFileBrowser() {
             ImGui::TableSetupColumn("Date modified", ImGuiTableColumnFlags_WidthStretch);
             ImGui::TableSetupColumn("Size", ImGuiTableColumnFlags_WidthStretch);
             ImGui::TableHeadersRow();
-            int i = 0;
             ImGui::PushID("direntries");
-            for (auto dirEntry : directoryContent) {
-                const bool isDirectory = dirEntry.is_directory();
-                ImGui::TableNextRow();
-                ImGui::TableSetColumnIndex(0);
-                ImGui::PushID(i++);
-                // makes the line selectable, and when selected copy the path
-                // to the line edit buffer
-                if (ImGui::Selectable("", false, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap)) {
-                    if (isDirectory) {
-                        displayedDirectory = dirEntry.path();
-                        mustUpdateDirectoryContent = true;
+            // Only the visible rows are drawn
+            ImGuiListClipper clipper;
+            clipper.Begin(static_cast<int>(displayedEntries.size()));
+            while (clipper.Step()) {
+                for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+                    const FileEntry &dirEntry = *displayedEntries[row];
+                    ImGui::TableNextRow();
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::PushID(row);
+                    // makes the line selectable, and when selected copy the path
+                    // to the line edit buffer
+                    if (ImGui::Selectable("", false, ImGuiSelectableFlags_SpanAllColumns | ImGuiSelectableFlags_AllowItemOverlap)) {
+                        if (dirEntry.isDirectory) {
+                            displayedDirectory = dirEntry.path;
+                            mustUpdateDirectoryContent = true;
+                        } else {
+                            displayedFileName = dirEntry.path;
+                            lineEditBuffer = dirEntry.path.string();
+                            mustUpdateChosenFileName = true;
+                        }
+                    }
+                    ImGui::PopID();
+                    ImGui::SameLine();
+                    if (dirEntry.isDirectory) {
+                        ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "%s ", ICON_FA_FOLDER);
+                        ImGui::TableSetColumnIndex(1);
+                        ImGui::TextColored(ImVec4(1.0, 1.0, 1.0, 1.0), "%s", dirEntry.fileName.c_str());
                     } else {
-                        displayedFileName = dirEntry.path();
-                        lineEditBuffer = dirEntry.path().string();
-                        mustUpdateChosenFileName = true;
+                        ImGui::TextColored(ImVec4(0.9, 0.9, 0.9, 1.0), "%s ", ICON_FA_FILE);
+                        ImGui::TableSetColumnIndex(1);
+                        ImGui::TextColored(ImVec4(0.5, 1.0, 0.5, 1.0), "%s", dirEntry.fileName.c_str());
+                    }
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::Text("%s", dirEntry.lastModified.empty() ? "Error reading file" : dirEntry.lastModified.c_str());
+                    ImGui::TableSetColumnIndex(3);
+                    if (!dirEntry.isDirectory) {
+                        DrawFileSize(dirEntry.size);
                     }
                 }
-                ImGui::PopID();
-                ImGui::SameLine();
-                if (isDirectory) {
-                    ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "%s ", ICON_FA_FOLDER);
-                    ImGui::TableSetColumnIndex(1); // the following line is allocating string for each directory/files, this is BAD
-                    ImGui::TextColored(ImVec4(1.0, 1.0, 1.0, 1.0), "%s", dirEntry.path().filename().string().c_str());
-                } else {
-                    ImGui::TextColored(ImVec4(0.9, 0.9, 0.9, 1.0), "%s ", ICON_FA_FILE);
-                    ImGui::TableSetColumnIndex(1);
-                    ImGui::TextColored(ImVec4(0.5, 1.0, 0.5, 1.0), "%s", dirEntry.path().filename().string().c_str());
-                }
-                ImGui::TableSetColumnIndex(2);
-                try {
-                    const auto lastModified = last_write_time(dirEntry.path());
-                    const time_t cftime = decltype(lastModified)::clock::to_time_t(lastModified);
-                    struct tm lt; // Convert to local time
-                    localtime_(&lt, &cftime);
-                    ImGui::Text("%04d/%02d/%02d %02d:%02d", 1900 + lt.tm_year, lt.tm_mon + 1, lt.tm_mday, lt.tm_hour, lt.tm_min);
-                } catch (const std::exception &) {
-                    ImGui::Text("Error reading file");
-                }
-                ImGui::TableSetColumnIndex(3);
-                DrawFileSize(dirEntry.file_size());
             }
             ImGui::PopID(); // direntries
             ImGui::EndTable();
         }
+        if (scanner.IsScanning()) {
+            ImGui::TextDisabled("Scanning %s ...", displayedDirectory.string().c_str());
+        }
         ImGui::EndListBox();
     }
 
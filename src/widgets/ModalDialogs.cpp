@@ -35,6 +35,8 @@ void CheckCloseModal() {
     }
 }
 
+bool IsModalDialogOpened() { return !modalDialogStack.empty(); }
+
 void ForceCloseCurrentModal() {
     if (!modalDialogStack.empty()) {
         modalDialogStack.back()->CloseModal();
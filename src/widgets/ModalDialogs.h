@@ -29,3 +29,6 @@ void DrawOkCancelModal(const std::function<void()> &onOk);
 
 /// Force closing the current modal dialog
 void ForceCloseCurrentModal();
+
+/// True while a modal dialog is opened
+bool IsModalDialogOpened();
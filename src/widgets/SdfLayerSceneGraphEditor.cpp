@@ -7,9 +7,12 @@
 
 #include <boost/range/adaptor/reversed.hpp>
 
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
 #include <pxr/usd/sdf/fileFormat.h>
 #include <pxr/usd/sdf/layer.h>
 #include <pxr/usd/sdf/layerUtils.h>
+#include <pxr/usd/sdf/notice.h>
 #include <pxr/usd/sdf/primSpec.h>
 #include <pxr/usd/sdf/schema.h>
 #include <pxr/usd/sdf/types.h>
@@ -223,25 +226,188 @@ static void HandleDragAndDrop(SdfLayerHandle layer, const Selection &selection)
     }
 }
 
-// Returns unfolded
-static bool DrawTreeNodePrimName(const bool &primIsVariant, SdfPrimSpecHandle &primSpec, const Selection &selection, bool hasChildren) {
-    // Format text differently when the prim is a variant
-    std::string primSpecName;
-    if (primIsVariant) {
-        auto variantSelection = primSpec->GetPath().GetVariantSelection();
-        primSpecName = std::string("{") + variantSelection.first.c_str() + ":" + variantSelection.second.c_str() + "}";
+// Each subtree rebuild searches and moves the rows, above this number of dirty subtrees all the rows are rebuilt
+static constexpr size_t MaxRebuiltSubtrees = 16;
+
+/// Flattened list of the specs displayed in the layer hierarchy.
+/// The specs of a big layer can't be traversed every frame, so the rows are kept between frames with the fields needed
+/// to draw them, and only the subtrees which were expanded, collapsed or edited are traversed again.
+class LayerSceneGraphRows : public TfWeakBase {
+  public:
+    struct Row {
+        SdfPath path;
+        std::string name;    // Prim name, or {variantSet:variant} for the variants
+        bool isVariant;
+        bool isLeaf;         // No prim children and no variant sets
+        bool hasComposition; // Has references, payloads, inherits or specializes
+    };
+
+    ~LayerSceneGraphRows() { TfNotice::Revoke(_layerChangedKey); }
+
+    /// Returns the rows, up to date with the layer and the opened tree nodes.
+    /// This must be called inside the table scope to read the correct tree node states
+    const std::vector<Row> &Update(const SdfLayerRefPtr &layer);
+
+    /// The subtree starting at path will be traversed again at the next update
+    void Invalidate(const SdfPath &path) { _dirtyPaths.push_back(path); }
+    void InvalidateAll() { _mustRebuildAll = true; }
+
+  private:
+    void OnLayerDidChange(const SdfNotice::LayersDidChangeSentPerLayer &notice);
+    void RebuildSubtree(const SdfPath &path);
+    void TraverseOpenedPaths(const SdfPath &root, std::vector<Row> &rows) const;
+
+    std::vector<Row> _rows;
+    SdfPathVector _dirtyPaths;
+    bool _mustRebuildAll = true;
+    SdfLayerHandle _layer;
+    TfNotice::Key _layerChangedKey;
+};
+
+const std::vector<LayerSceneGraphRows::Row> &LayerSceneGraphRows::Update(const SdfLayerRefPtr &layer) {
+    if (_layer != SdfLayerHandle(layer)) {
+        TfNotice::Revoke(_layerChangedKey);
+        _layer = layer;
+        if (_layer) {
+            _layerChangedKey = TfNotice::Register(TfCreateWeakPtr(this), &LayerSceneGraphRows::OnLayerDidChange, _layer);
+        }
+        _mustRebuildAll = true;
+    }
+    if (!_mustRebuildAll && !_dirtyPaths.empty()) {
+        // Rebuilding a subtree also rebuilds its descendants, so we only keep the topmost paths
+        SdfPath::RemoveDescendentPaths(&_dirtyPaths);
+        _mustRebuildAll = _dirtyPaths.size() > MaxRebuiltSubtrees;
+    }
+    if (_mustRebuildAll) {
+        _rows.clear();
+        if (_layer) {
+            TraverseOpenedPaths(SdfPath::AbsoluteRootPath(), _rows);
+        }
     } else {
-        primSpecName = primSpec->GetPath().GetName();
+        for (const auto &path : _dirtyPaths) {
+            RebuildSubtree(path);
+        }
+    }
+    _mustRebuildAll = false;
+    _dirtyPaths.clear();
+    return _rows;
+}
+
+void LayerSceneGraphRows::OnLayerDidChange(const SdfNotice::LayersDidChangeSentPerLayer &notice) {
+    for (const auto &layerChanges : notice.GetChangeListVec()) {
+        if (layerChanges.first != _layer) {
+            continue;
+        }
+        for (const auto &entry : layerChanges.second.GetEntryList()) {
+            const SdfPath &path = entry.first;
+            const SdfChangeList::Entry &change = entry.second;
+            // The properties are not displayed in the hierarchy
+            if (!path.IsPrimPath() && !path.IsPrimVariantSelectionPath()) {
+                if (path.IsAbsoluteRootPath()) {
+                    _mustRebuildAll = true;
+                }
+                continue;
+            }
+            // Adding, removing or renaming a spec modifies the children of its parent, the other edits only modify
+            // the fields of its row
+            const bool childrenChanged = change.flags.didAddInertPrim || change.flags.didAddNonInertPrim ||
+                                         change.flags.didRemoveInertPrim || change.flags.didRemoveNonInertPrim ||
+                                         change.flags.didRename;
+            _dirtyPaths.push_back(childrenChanged ? path.GetParentPath() : path);
+        }
+    }
+}
+
+// Replace the rows of the closest displayed ancestor of path, and its descendants, with a new traversal
+void LayerSceneGraphRows::RebuildSubtree(const SdfPath &path) {
+    // The rows are stored in depth first order, so the last row prefixing path is its closest displayed ancestor
+    size_t first = _rows.size();
+    for (size_t i = 0; i < _rows.size(); ++i) {
+        if (path.HasPrefix(_rows[i].path)) {
+            first = i;
+        }
+    }
+    if (first == _rows.size()) {
+        return;
+    }
+    const SdfPath subtreeRoot = _rows[first].path;
+    size_t last = first + 1;
+    while (last < _rows.size() && _rows[last].path.HasPrefix(subtreeRoot)) {
+        ++last;
+    }
+    std::vector<Row> subtreeRows;
+    TraverseOpenedPaths(subtreeRoot, subtreeRows);
+    _rows.erase(_rows.begin() + first, _rows.begin() + last);
+    _rows.insert(_rows.begin() + first, subtreeRows.begin(), subtreeRows.end());
+}
+
+/// Traverse the specs under root and store them in depth first order. Only the children of the paths opened in the
+/// tree view are traversed
+void LayerSceneGraphRows::TraverseOpenedPaths(const SdfPath &root, std::vector<Row> &rows) const {
+    std::stack<SdfPath> st;
+    st.push(root);
+    ImGuiContext &g = *GImGui;
+    ImGuiWindow *window = g.CurrentWindow;
+    ImGuiStorage *storage = window->DC.StateStorage;
+    std::vector<TfToken> children;
+    std::vector<TfToken> variantSetChildren;
+    std::vector<TfToken> variantChildren;
+    while (!st.empty()) {
+        const SdfPath path = st.top();
+        st.pop();
+        children.clear();
+        variantSetChildren.clear();
+        _layer->HasField(path, SdfChildrenKeys->PrimChildren, &children);
+        _layer->HasField(path, SdfChildrenKeys->VariantSetChildren, &variantSetChildren);
+        const ImGuiID pathHash = IdOf(path.GetHash());
+        const bool isOpen = storage->GetInt(pathHash, 0) != 0;
+        if (isOpen) {
+            for (const auto &tok : boost::adaptors::reverse(children)) {
+                st.push(path.AppendChild(tok));
+            }
+            // Skip the variantSet paths and show only the variantSetChildren
+            for (const auto &variantSet : boost::adaptors::reverse(variantSetChildren)) {
+                variantChildren.clear();
+                if (_layer->HasField(path.AppendVariantSelection(variantSet, ""), SdfChildrenKeys->VariantChildren,
+                                     &variantChildren)) {
+                    for (const auto &tok : boost::adaptors::reverse(variantChildren)) {
+                        st.push(path.AppendVariantSelection(variantSet, tok));
+                    }
+                }
+            }
+        }
+        Row row;
+        row.path = path;
+        row.isVariant = path.IsPrimVariantSelectionPath();
+        if (row.isVariant) {
+            const auto variantSelection = path.GetVariantSelection();
+            row.name = "{" + variantSelection.first + ":" + variantSelection.second + "}";
+        } else {
+            row.name = path.GetName();
+        }
+        row.isLeaf = children.empty() && variantSetChildren.empty();
+        row.hasComposition = _layer->HasField(path, SdfFieldKeys->References) || _layer->HasField(path, SdfFieldKeys->Payload) ||
+                             _layer->HasField(path, SdfFieldKeys->InheritPaths) ||
+                             _layer->HasField(path, SdfFieldKeys->Specializes);
+        rows.push_back(std::move(row));
     }
+}
+
+// Returns unfolded
+static bool DrawTreeNodePrimName(const LayerSceneGraphRows::Row &row, SdfPrimSpecHandle &primSpec, LayerSceneGraphRows &rows) {
+    const bool primIsVariant = row.isVariant;
+    // Format text differently when the prim is a variant
     ScopedStyleColor textColor(ImGuiCol_Text,
                                primIsVariant ? ImU32(ImColor::HSV(0.2 / 7.0f, 0.5f, 0.8f)) : ImGui::GetColorU32(ImGuiCol_Text),
                                ImGuiCol_HeaderHovered, 0, ImGuiCol_HeaderActive, 0);
 
     ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap;
-    nodeFlags |= hasChildren && !primSpec->HasVariantSetNames() ? ImGuiTreeNodeFlags_Leaf
-                                                                : ImGuiTreeNodeFlags_None; // ImGuiTreeNodeFlags_DefaultOpen;
+    nodeFlags |= row.isLeaf ? ImGuiTreeNodeFlags_Leaf : ImGuiTreeNodeFlags_None; // ImGuiTreeNodeFlags_DefaultOpen;
     auto cursor = ImGui::GetCursorPos(); // Store position for the InputText to edit the prim name
-    auto unfolded = ImGui::TreeNodeBehavior(IdOf(primSpec->GetPath().GetHash()), nodeFlags, primSpecName.c_str());
+    auto unfolded = ImGui::TreeNodeBehavior(IdOf(row.path.GetHash()), nodeFlags, row.name.c_str());
+    if (ImGui::IsItemToggledOpen()) {
+        rows.Invalidate(row.path);
+    }
 
     // Edition of the prim name
     static SdfPrimSpecHandle editNamePrim;
@@ -268,17 +434,15 @@ static bool DrawTreeNodePrimName(const bool &primIsVariant, SdfPrimSpecHandle &p
 }
 
 /// Draw a node in the primspec tree
-static void DrawSdfPrimRow(const SdfLayerRefPtr &layer, const SdfPath &primPath, const Selection &selection, int nodeId,
-                           float &selectedPosY) {
+static void DrawSdfPrimRow(const SdfLayerRefPtr &layer, const LayerSceneGraphRows::Row &row, const SdfPath &selectedPath,
+                           const Selection &selection, int nodeId, float &selectedPosY, LayerSceneGraphRows &rows) {
+    const SdfPath &primPath = row.path;
     SdfPrimSpecHandle primSpec = layer->GetPrimAtPath(primPath);
 
     if (!primSpec)
         return;
 
-    SdfPrimSpecHandle previousSelectedPrim;
-
-    auto selectedPrim = layer->GetPrimAtPath(selection.GetAnchorPrimPath(layer)); // TODO should we have a function for that ?
-    bool primIsVariant = primPath.IsPrimVariantSelectionPath();
+    const bool isSelected = selectedPath == primPath;
 
     ImGui::TableNextRow();
     ImGui::TableSetColumnIndex(0);
@@ -287,21 +451,19 @@ static void DrawSdfPrimRow(const SdfLayerRefPtr &layer, const SdfPath &primPath,
 
     nodeId = 0; // reset the counter
     // Edit buttons
-    if (selectedPrim == primSpec) {
+    if (isSelected) {
         selectedPosY = ImGui::GetCursorPosY();
     }
 
-    DrawBackgroundSelection(primSpec, selection, selectedPrim == primSpec);
+    DrawBackgroundSelection(primSpec, selection, isSelected);
 
     // Drag and drop on Selectable
     HandleDragAndDrop(primSpec, selection);
 
     // Draw the tree column
-    auto childrenNames = primSpec->GetNameChildren();
-
     ImGui::SameLine();
     TreeIndenter<LayerHierarchyEditorSeed, SdfPath> indenter(primPath);
-    bool unfolded = DrawTreeNodePrimName(primIsVariant, primSpec, selection, childrenNames.empty());
+    bool unfolded = DrawTreeNodePrimName(row, primSpec, rows);
 
     // Right click will open the quick edit popup menu
     if (ImGui::BeginPopupContextItem()) {
@@ -328,8 +490,10 @@ static void DrawSdfPrimRow(const SdfLayerRefPtr &layer, const SdfPath &primPath,
 
     // Draw composition summary
     ImGui::TableSetColumnIndex(3);
-    DrawPrimCompositionSummary(primSpec);
-    ImGui::SetItemAllowOverlap();
+    if (row.hasComposition) {
+        DrawPrimCompositionSummary(primSpec);
+        ImGui::SetItemAllowOverlap();
+    }
 
     // Draw children
     if (unfolded) {
@@ -339,10 +503,10 @@ static void DrawSdfPrimRow(const SdfLayerRefPtr &layer, const SdfPath &primPath,
     ImGui::PopID();
 }
 
-static void DrawTopNodeLayerRow(const SdfLayerRefPtr &layer, const Selection &selection, float &selectedPosY) {
+static void DrawTopNodeLayerRow(const SdfLayerRefPtr &layer, const LayerSceneGraphRows::Row &row, const SdfPath &selectedPath,
+                                const Selection &selection, float &selectedPosY, LayerSceneGraphRows &rows) {
     ImGuiTreeNodeFlags treeNodeFlags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_AllowItemOverlap;
-    int nodeId = 0;
-    if (layer->GetRootPrims().empty()) {
+    if (row.isLeaf) {
         treeNodeFlags |= ImGuiTreeNodeFlags_Leaf;
     }
     ImGui::TableNextRow();
@@ -357,7 +521,10 @@ static void DrawTopNodeLayerRow(const SdfLayerRefPtr &layer, const Selection &se
     ImGui::PushStyleColor(ImGuiCol_HeaderActive, 0);
     bool unfolded = ImGui::TreeNodeBehavior(IdOf(SdfPath::AbsoluteRootPath().GetHash()), treeNodeFlags, label.c_str());
     ImGui::PopStyleColor(2);
-    
+    if (ImGui::IsItemToggledOpen()) {
+        rows.InvalidateAll();
+    }
+
     if (!ImGui::IsItemToggledOpen() && ImGui::IsItemClicked()) {
         ExecuteAfterDraw<EditorSetSelection>(layer, SdfPath::AbsoluteRootPath());;
     }
@@ -408,50 +575,7 @@ static void DrawTopNodeLayerRow(const SdfLayerRefPtr &layer, const Selection &se
         ScopedStyleColor highlightButton(ImGuiCol_Button, ImVec4(ColorButtonHighlight));
         ImGui::SetCursorPosX(ImGui::GetWindowContentRegionMax().x - 160);
         ImGui::SetCursorPosY(selectedPosY);
-        DrawMiniToolbar(layer, layer->GetPrimAtPath(selection.GetAnchorPrimPath(layer)));
-    }
-}
-
-/// Traverse all the path of the layer and store them in a vector. Apply a filter to only traverse the path
-/// that should be displayed, the ones inside the collapsed part of the tree view
-void TraverseOpenedPaths(const SdfLayerRefPtr &layer, std::vector<SdfPath> &paths) {
-    paths.clear();
-    std::stack<SdfPath> st;
-    st.push(SdfPath::AbsoluteRootPath());
-    ImGuiContext &g = *GImGui;
-    ImGuiWindow *window = g.CurrentWindow;
-    ImGuiStorage *storage = window->DC.StateStorage;
-    while (!st.empty()) {
-        const SdfPath path = st.top();
-        st.pop();
-        const ImGuiID pathHash = IdOf(path.GetHash());
-        const bool isOpen = storage->GetInt(pathHash, 0) != 0;
-        if (isOpen) {
-            if (layer->HasField(path, SdfChildrenKeys->PrimChildren)) {
-                const std::vector<TfToken> &children =
-                    layer->GetFieldAs<std::vector<TfToken>>(path, SdfChildrenKeys->PrimChildren);
-                for (const auto &tok : boost::adaptors::reverse(children)) {
-                    st.push(path.AppendChild(tok));
-                }
-            }
-            if (layer->HasField(path, SdfChildrenKeys->VariantSetChildren)) {
-                const std::vector<TfToken> &variantSetchildren =
-                    layer->GetFieldAs<std::vector<TfToken>>(path, SdfChildrenKeys->VariantSetChildren);
-                // Skip the variantSet paths and show only the variantSetChildren
-                for (const auto &tok : boost::adaptors::reverse(variantSetchildren)) {
-                    auto variantSetPath = path.AppendVariantSelection(tok, "");
-                    if (layer->HasField(variantSetPath, SdfChildrenKeys->VariantChildren)) {
-                        const std::vector<TfToken> &variantChildren =
-                            layer->GetFieldAs<std::vector<TfToken>>(variantSetPath, SdfChildrenKeys->VariantChildren);
-                        for (const auto &tok : boost::adaptors::reverse(variantChildren)) {
-                            const std::string &variantSet = variantSetPath.GetVariantSelection().first;
-                            st.push(path.AppendVariantSelection(TfToken(variantSet), tok));
-                        }
-                    }
-                }
-            }
-        }
-        paths.push_back(path);
+        DrawMiniToolbar(layer, layer->GetPrimAtPath(selectedPath));
     }
 }
 
@@ -460,7 +584,8 @@ void DrawLayerPrimHierarchy(SdfLayerRefPtr layer, const Selection &selection) {
     if (!layer)
         return;
 
-    SdfPrimSpecHandle selectedPrim = layer->GetPrimAtPath(selection.GetAnchorPrimPath(layer));
+    const SdfPath selectedPath = selection.GetAnchorPrimPath(layer);
+    SdfPrimSpecHandle selectedPrim = layer->GetPrimAtPath(selectedPath);
     DrawLayerNavigation(layer);
     auto flags = ImGuiTableFlags_SizingFixedFit | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY;
 
@@ -473,26 +598,21 @@ void DrawLayerPrimHierarchy(SdfLayerRefPtr layer, const Selection &selection) {
 
         ImGui::TableHeadersRow();
 
-        std::vector<SdfPath> paths;
+        // Get the opened paths, only the subtrees modified since the last frame are traversed
+        static LayerSceneGraphRows rows;
+        const auto &openedRows = rows.Update(layer); // This must be inside the table scope to get the correct treenode hash table
 
-        // Find all the opened paths
-        paths.reserve(1024);
-        TraverseOpenedPaths(layer, paths);
-
-        int nodeId = 0;
         float selectedPosY = -1;
-        const size_t arraySize = paths.size();
-        SdfPathVector pathPrefixes;
         ImGuiListClipper clipper;
-        clipper.Begin(static_cast<int>(arraySize));
+        clipper.Begin(static_cast<int>(openedRows.size()));
         while (clipper.Step()) {
             for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
                 ImGui::PushID(row);
-                const SdfPath &path = paths[row];
-                if (path.IsAbsoluteRootPath()) {
-                    DrawTopNodeLayerRow(layer, selection, selectedPosY);
+                const LayerSceneGraphRows::Row &openedRow = openedRows[row];
+                if (openedRow.path.IsAbsoluteRootPath()) {
+                    DrawTopNodeLayerRow(layer, openedRow, selectedPath, selection, selectedPosY, rows);
                 } else {
-                    DrawSdfPrimRow(layer, path, selection, row, selectedPosY);
+                    DrawSdfPrimRow(layer, openedRow, selectedPath, selection, row, selectedPosY, rows);
                 }
                 ImGui::PopID();
             }
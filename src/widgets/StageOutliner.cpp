@@ -2,7 +2,11 @@
 
 #include <vector>
 
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/kind/registry.h>
 #include <pxr/usd/pcp/layerStack.h>
+#include <pxr/usd/usd/notice.h>
 #include <pxr/usd/usd/primRange.h>
 #include <pxr/usd/usdGeom/gprim.h>
 
@@ -10,6 +14,7 @@
 #include "Constants.h"
 #include "Gui.h"
 #include "ImGuiHelpers.h"
+#include "PrimSearchIndex.h"
 #include "UsdPrimEditor.h" // for DrawUsdPrimEditTarget
 #include "StageOutliner.h"
 #include "VtValueEditor.h"
@@ -77,6 +82,166 @@ class StageOutlinerDisplayOptions {
     bool _showPrototypes = true;
 };
 
+/// Flattened list of the rows displayed in the outliner.
+/// Traversing the whole stage every frame is too slow on big stages, so the rows are kept between frames and only the
+/// subtrees which were expanded, collapsed or resynced are traversed again.
+class StageOutlinerRows : public TfWeakBase {
+  public:
+    struct Row {
+        SdfPath path;
+        bool isLeaf; // No children passing the display predicate
+    };
+
+    ~StageOutlinerRows() { TfNotice::Revoke(_objectsChangedKey); }
+
+    /// Returns the rows, up to date with the stage and the opened tree nodes.
+    /// This must be called inside the table scope to read the correct tree node states
+    const std::vector<Row> &Update(const UsdStageRefPtr &stage, const StageOutlinerDisplayOptions &displayOptions);
+
+    /// The subtree starting at path will be traversed again at the next update
+    void Invalidate(const SdfPath &path) { _dirtyPaths.push_back(path); }
+    void InvalidateAll() { _mustRebuildAll = true; }
+
+  private:
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice);
+    void RebuildAll(const UsdStageRefPtr &stage, const StageOutlinerDisplayOptions &displayOptions);
+    void RebuildSubtree(const UsdStageRefPtr &stage, const SdfPath &path, const StageOutlinerDisplayOptions &displayOptions);
+    void TraverseRange(UsdPrimRange &range, std::vector<Row> &rows, const StageOutlinerDisplayOptions &displayOptions);
+
+    std::vector<Row> _rows;
+    SdfPathVector _dirtyPaths;
+    bool _mustRebuildAll = true;
+    UsdStageWeakPtr _stage;
+    TfNotice::Key _objectsChangedKey;
+    // This is to fix a bug with instanced prims which recreate their paths at every traversal and give a different hash
+    std::set<SdfPath> _retainedPaths;
+};
+
+const std::vector<StageOutlinerRows::Row> &StageOutlinerRows::Update(const UsdStageRefPtr &stage,
+                                                                     const StageOutlinerDisplayOptions &displayOptions) {
+    if (_stage != UsdStageWeakPtr(stage)) {
+        TfNotice::Revoke(_objectsChangedKey);
+        _stage = stage;
+        if (stage) {
+            _objectsChangedKey = TfNotice::Register(TfCreateWeakPtr(this), &StageOutlinerRows::OnObjectsChanged, _stage);
+        }
+        _mustRebuildAll = true;
+    }
+    if (_mustRebuildAll) {
+        RebuildAll(stage, displayOptions);
+    } else if (!_dirtyPaths.empty()) {
+        // Rebuilding a subtree also rebuilds its descendants, so we only keep the topmost paths
+        SdfPath::RemoveDescendentPaths(&_dirtyPaths);
+        for (const auto &path : _dirtyPaths) {
+            if (path.IsAbsoluteRootPath()) {
+                RebuildAll(stage, displayOptions);
+                break;
+            }
+            RebuildSubtree(stage, path, displayOptions);
+        }
+    }
+    _mustRebuildAll = false;
+    _dirtyPaths.clear();
+    return _rows;
+}
+
+void StageOutlinerRows::OnObjectsChanged(const UsdNotice::ObjectsChanged &notice) {
+    // A resync can add or remove children, so the parent row is traversed again to update its leaf flag as well.
+    // Info only changes don't modify the hierarchy, they are read when drawing the visible rows
+    for (const auto &path : notice.GetResyncedPaths()) {
+        const SdfPath primPath = path.GetPrimPath();
+        if (primPath.IsEmpty() || primPath.IsAbsoluteRootPath()) {
+            _mustRebuildAll = true;
+        } else {
+            _dirtyPaths.push_back(primPath.GetParentPath());
+        }
+    }
+}
+
+void StageOutlinerRows::TraverseRange(UsdPrimRange &range, std::vector<Row> &rows,
+                                      const StageOutlinerDisplayOptions &displayOptions) {
+    ImGuiContext &g = *GImGui;
+    ImGuiWindow *window = g.CurrentWindow;
+    ImGuiStorage *storage = window->DC.StateStorage;
+    for (auto iter = range.begin(); iter != range.end(); ++iter) {
+        const auto &path = iter->GetPath();
+        const ImGuiID pathHash = IdOf(GetHash(path));
+        const bool isOpen = storage->GetInt(pathHash, 0) != 0;
+        if (!isOpen) {
+            iter.PruneChildren();
+        }
+        // This bit of code is to avoid a bug. It appears that the SdfPath of instance proxies are not kept and the underlying memory
+        // is deleted and recreated between each frame, invalidating the hash value. So for the same path we have different hash every frame :s not cool.
+        // This problems appears on versions > 21.11
+        // a look at the changelog shows that they were lots of changes on the SdfPath side:
+        // https://github.com/PixarAnimationStudios/USD/commit/46c26f63d2a6e9c6c5dbfbcefa0235c3265457bb
+        //
+        // In the end we workaround this issue by keeping the instance proxy paths alive:
+        if (iter->IsInstanceProxy()) {
+            _retainedPaths.insert(path);
+        }
+        const auto &children = iter->GetFilteredChildren(displayOptions.GetPrimFlagsPredicate());
+        rows.push_back({path, children.empty()});
+    }
+}
+
+// Traverse the stage skipping the paths closed by the tree ui.
+void StageOutlinerRows::RebuildAll(const UsdStageRefPtr &stage, const StageOutlinerDisplayOptions &displayOptions) {
+    _rows.clear();
+    if (!stage)
+        return;
+    ImGuiContext &g = *GImGui;
+    ImGuiWindow *window = g.CurrentWindow;
+    ImGuiStorage *storage = window->DC.StateStorage;
+    const SdfPath &rootPath = SdfPath::AbsoluteRootPath();
+    const bool rootPathIsOpen = storage->GetInt(IdOf(GetHash(rootPath)), 0) != 0;
+
+    if (rootPathIsOpen) {
+        // Stage
+        auto range = UsdPrimRange::Stage(stage, displayOptions.GetPrimFlagsPredicate());
+        TraverseRange(range, _rows, displayOptions);
+        // Prototypes
+        if (displayOptions.GetShowPrototypes()) {
+            for (const auto &proto : stage->GetPrototypes()) {
+                auto range = UsdPrimRange(proto, displayOptions.GetPrimFlagsPredicate());
+                TraverseRange(range, _rows, displayOptions);
+            }
+        }
+    }
+}
+
+// Replace the rows of the closest displayed ancestor of path, and its descendants, with a new traversal
+void StageOutlinerRows::RebuildSubtree(const UsdStageRefPtr &stage, const SdfPath &path,
+                                       const StageOutlinerDisplayOptions &displayOptions) {
+    if (!stage)
+        return;
+    // The rows are stored in depth first order, so the last row prefixing path is its closest displayed ancestor
+    size_t first = _rows.size();
+    for (size_t i = 0; i < _rows.size(); ++i) {
+        if (path.HasPrefix(_rows[i].path)) {
+            first = i;
+        }
+    }
+    if (first == _rows.size()) {
+        // Top level prims are not in a subtree we can rebuild
+        RebuildAll(stage, displayOptions);
+        return;
+    }
+    const SdfPath subtreeRoot = _rows[first].path;
+    size_t last = first + 1;
+    while (last < _rows.size() && _rows[last].path.HasPrefix(subtreeRoot)) {
+        ++last;
+    }
+    std::vector<Row> subtreeRows;
+    const UsdPrim prim = stage->GetPrimAtPath(subtreeRoot);
+    if (prim) {
+        auto range = UsdPrimRange(prim, displayOptions.GetPrimFlagsPredicate());
+        TraverseRange(range, subtreeRows, displayOptions);
+    }
+    _rows.erase(_rows.begin() + first, _rows.begin() + last);
+    _rows.insert(_rows.begin() + first, subtreeRows.begin(), subtreeRows.end());
+}
+
 static void ExploreLayerTree(SdfLayerTreeHandle tree, PcpNodeRef node) {
     if (!tree)
         return;
@@ -213,14 +378,13 @@ static void DrawBackgroundSelection(const UsdPrim &prim, bool selected) {
 
 
 
-static void DrawPrimTreeRow(const UsdPrim &prim, Selection &selectedPaths, StageOutlinerDisplayOptions &displayOptions) {
+static void DrawPrimTreeRow(const UsdPrim &prim, const StageOutlinerRows::Row &row, Selection &selectedPaths,
+                            StageOutlinerRows &rows) {
     ImGuiTreeNodeFlags flags =
         ImGuiTreeNodeFlags_OpenOnArrow |
         ImGuiTreeNodeFlags_AllowItemOverlap; // for testing worse case scenario add | ImGuiTreeNodeFlags_DefaultOpen;
 
-    // Another way ???
-    const auto &children = prim.GetFilteredChildren(displayOptions.GetPrimFlagsPredicate());
-    if (children.empty()) {
+    if (row.isLeaf) {
         flags |= ImGuiTreeNodeFlags_Leaf;
     }
 
@@ -235,6 +399,9 @@ static void DrawPrimTreeRow(const UsdPrim &prim, Selection &selectedPaths, Stage
             const ImGuiID pathHash = IdOf(GetHash(prim.GetPath()));
 
             unfolded = ImGui::TreeNodeBehavior(pathHash, flags, prim.GetName().GetText());
+            if (ImGui::IsItemToggledOpen()) {
+                rows.Invalidate(prim.GetPath());
+            }
             // TreeSelectionBehavior(selectedPaths, &prim);
             if (ImGui::IsItemClicked() && !ImGui::IsItemToggledOpen()) {
                 // TODO selection, should go in commands, ultimately the selection is passed
@@ -270,13 +437,16 @@ static void DrawPrimTreeRow(const UsdPrim &prim, Selection &selectedPaths, Stage
     }
 }
 
-static void DrawStageTreeRow(const UsdStageRefPtr &stage, Selection &selectedPaths) {
+static void DrawStageTreeRow(const UsdStageRefPtr &stage, Selection &selectedPaths, StageOutlinerRows &rows) {
     ImGui::TableNextRow();
     ImGui::TableSetColumnIndex(0);
 
     ImGuiTreeNodeFlags nodeflags = ImGuiTreeNodeFlags_OpenOnArrow;
     std::string stageDisplayName(stage->GetRootLayer()->GetDisplayName());
     auto unfolded = ImGui::TreeNodeBehavior(IdOf(GetHash(SdfPath::AbsoluteRootPath())), nodeflags, stageDisplayName.c_str());
+    if (ImGui::IsItemToggledOpen()) {
+        rows.InvalidateAll();
+    }
 
     ImGui::TableSetColumnIndex(2);
     ImGui::SmallButton(ICON_FA_PEN);
@@ -295,75 +465,27 @@ static void DrawStageTreeRow(const UsdStageRefPtr &stage, Selection &selectedPat
 
 /// This function should be called only when the Selection has changed
 /// It modifies the internal imgui tree graph state.
-static void OpenSelectedPaths(const UsdStageRefPtr &stage, Selection &selectedPaths) {
+static void OpenSelectedPaths(const UsdStageRefPtr &stage, Selection &selectedPaths, StageOutlinerRows &rows) {
     ImGuiContext &g = *GImGui;
     ImGuiWindow *window = g.CurrentWindow;
     ImGuiStorage *storage = window->DC.StateStorage;
     for (const auto &path : selectedPaths.GetSelectedPaths(stage)) {
         for (const auto &element : path.GetParentPath().GetPrefixes()) {
             ImGuiID id = IdOf(GetHash(element)); // This has changed with the optim one
-            storage->SetInt(id, true);
-        }
-    }
-}
-
-static void TraverseRange(UsdPrimRange &range, std::vector<SdfPath> &paths) {
-    static std::set<SdfPath> retainedPath; // to fix a bug with instanced prim which recreates the path at every call and give a different hash
-    ImGuiContext &g = *GImGui;
-    ImGuiWindow *window = g.CurrentWindow;
-    ImGuiStorage *storage = window->DC.StateStorage;
-    for (auto iter = range.begin(); iter != range.end(); ++iter) {
-        const auto &path = iter->GetPath();
-        const ImGuiID pathHash = IdOf(GetHash(path));
-        const bool isOpen = storage->GetInt(pathHash, 0) != 0;
-        if (!isOpen) {
-            iter.PruneChildren();
-        }
-        // This bit of code is to avoid a bug. It appears that the SdfPath of instance proxies are not kept and the underlying memory
-        // is deleted and recreated between each frame, invalidating the hash value. So for the same path we have different hash every frame :s not cool.
-        // This problems appears on versions > 21.11
-        // a look at the changelog shows that they were lots of changes on the SdfPath side:
-        // https://github.com/PixarAnimationStudios/USD/commit/46c26f63d2a6e9c6c5dbfbcefa0235c3265457bb
-        //
-        // In the end we workaround this issue by keeping the instance proxy paths alive:
-        if (iter->IsInstanceProxy()) {
-            retainedPath.insert(path);
-        }
-        paths.push_back(path);
-    }
-}
-
-// Traverse the stage skipping the paths closed by the tree ui.
-static void TraverseOpenedPaths(UsdStageRefPtr stage, std::vector<SdfPath> &paths, StageOutlinerDisplayOptions &displayOptions) {
-    if (!stage)
-        return;
-    ImGuiContext &g = *GImGui;
-    ImGuiWindow *window = g.CurrentWindow;
-    ImGuiStorage *storage = window->DC.StateStorage;
-    paths.clear();
-    const SdfPath &rootPath = SdfPath::AbsoluteRootPath();
-    const bool rootPathIsOpen = storage->GetInt(IdOf(GetHash(rootPath)), 0) != 0;
-
-    if (rootPathIsOpen) {
-        // Stage
-        auto range = UsdPrimRange::Stage(stage, displayOptions.GetPrimFlagsPredicate());
-        TraverseRange(range, paths);
-        // Prototypes
-        if (displayOptions.GetShowPrototypes()) {
-            for(const auto &proto: stage->GetPrototypes()) {
-                auto range = UsdPrimRange(proto, displayOptions.GetPrimFlagsPredicate());
-                TraverseRange(range, paths);
+            if (storage->GetInt(id, 0) == 0) {
+                storage->SetInt(id, true);
+                rows.Invalidate(element);
             }
         }
     }
 }
 
-static void FocusedOnFirstSelectedPath(const SdfPath &selectedPath, const std::vector<SdfPath> &paths,
+static void FocusedOnFirstSelectedPath(const SdfPath &selectedPath, const std::vector<StageOutlinerRows::Row> &rows,
                                        ImGuiListClipper &clipper) {
     // linear search! it happens only when the selection has changed. We might want to maintain a map instead
     // if the hierarchies are big.
-    for (int i = 0; i < paths.size(); ++i) {
-        if (paths[i] == selectedPath) {
+    for (int i = 0; i < rows.size(); ++i) {
+        if (rows[i].path == selectedPath) {
             // scroll only if the item is not visible
             if (i < clipper.DisplayStart || i > clipper.DisplayEnd) {
                 ImGui::SetScrollY(clipper.ItemsHeight * i + 1);
@@ -373,29 +495,36 @@ static void FocusedOnFirstSelectedPath(const SdfPath &selectedPath, const std::v
     }
 }
 
-void DrawStageOutlinerMenuBar(StageOutlinerDisplayOptions &displayOptions) {
-
+/// Returns true if the display options were modified
+bool DrawStageOutlinerMenuBar(StageOutlinerDisplayOptions &displayOptions) {
+    bool optionsChanged = false;
     if (ImGui::BeginMenuBar()) {
         if (ImGui::BeginMenu("Show")) {
             if (ImGui::MenuItem("Inactive", nullptr, displayOptions.GetShowInactive())) {
                 displayOptions.ToggleShowInactive();
+                optionsChanged = true;
             }
             if (ImGui::MenuItem("Undefined", nullptr, displayOptions.GetShowUndefined())) {
                 displayOptions.ToggleShowUndefined();
+                optionsChanged = true;
             }
             if (ImGui::MenuItem("Unloaded", nullptr, displayOptions.GetShowUnloaded())) {
                 displayOptions.ToggleShowUnloaded();
+                optionsChanged = true;
             }
             if (ImGui::MenuItem("Abstract", nullptr, displayOptions.GetShowAbstract())) {
                 displayOptions.ToggleShowAbstract();
+                optionsChanged = true;
             }
             if (ImGui::MenuItem("Prototypes", nullptr, displayOptions.GetShowPrototypes())) {
                 displayOptions.ToggleShowPrototypes();
+                optionsChanged = true;
             }
             ImGui::EndMenu();
         }
         ImGui::EndMenuBar();
     }
+    return optionsChanged;
 }
 
 /// Draw the hierarchy of the stage
@@ -404,7 +533,10 @@ void DrawStageOutliner(UsdStageRefPtr stage, Selection &selectedPaths) {
         return;
     
     static StageOutlinerDisplayOptions displayOptions;
-    DrawStageOutlinerMenuBar(displayOptions);
+    static StageOutlinerRows rows;
+    if (DrawStageOutlinerMenuBar(displayOptions)) {
+        rows.InvalidateAll();
+    }
     
     //ImGui::PushID("StageOutliner");
     constexpr unsigned int textBufferSize = 512;
@@ -427,33 +559,33 @@ void DrawStageOutliner(UsdStageRefPtr stage, Selection &selectedPaths) {
         // Unfold the selected path
         const bool selectionHasChanged = selectedPaths.UpdateSelectionHash(stage, lastSelectionHash);
         if (selectionHasChanged) {            // We could use the imgui id as well instead of a static ??
-            OpenSelectedPaths(stage, selectedPaths); // Also we could have a UsdTweakFrame which contains all the changes that happened
+            OpenSelectedPaths(stage, selectedPaths, rows); // Also we could have a UsdTweakFrame which contains all the changes that happened
                                               // between the last frame and the new one
         }
 
-        // Find all the opened paths
-        std::vector<SdfPath> paths;
-        paths.reserve(1024);
-        TraverseOpenedPaths(stage, paths, displayOptions); // This must be inside the table scope to get the correct treenode hash table
+        // Get the opened paths, only the subtrees modified since the last frame are traversed
+        const auto &openedRows = rows.Update(stage, displayOptions); // This must be inside the table scope to get the correct treenode hash table
 
         // Draw the tree root node, the layer
-        DrawStageTreeRow(stage, selectedPaths);
+        DrawStageTreeRow(stage, selectedPaths, rows);
 
         // Display only the visible paths with a clipper
         ImGuiListClipper clipper;
-        clipper.Begin(static_cast<int>(paths.size()));
+        clipper.Begin(static_cast<int>(openedRows.size()));
         while (clipper.Step()) {
             for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
                 ImGui::PushID(row);
-                const SdfPath &path = paths[row];
+                const SdfPath &path = openedRows[row].path;
                 const auto &prim = stage->GetPrimAtPath(path);
-                DrawPrimTreeRow(prim, selectedPaths, displayOptions);
+                if (prim) {
+                    DrawPrimTreeRow(prim, openedRows[row], selectedPaths, rows);
+                }
                 ImGui::PopID();
             }
         }
         if (selectionHasChanged) {
             // This function can only be called in this context and after the clipper.Step()
-            FocusedOnFirstSelectedPath(selectedPaths.GetAnchorPrimPath(stage), paths, clipper);
+            FocusedOnFirstSelectedPath(selectedPaths.GetAnchorPrimPath(stage), openedRows, clipper);
         }
         ImGui::EndTable();
         
@@ -461,13 +593,37 @@ void DrawStageOutliner(UsdStageRefPtr stage, Selection &selectedPaths) {
 
     // Search prim bar
     static char patternBuffer[256];
-    static bool useRegex = false;
+    static char typeNameBuffer[128];
+    static PrimSearchQuery query;
     auto enterPressed = ImGui::InputTextWithHint("##SearchPrims", "Find prim", patternBuffer, 256, ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::SameLine();
-    ImGui::Checkbox("use regex", &useRegex);
+    ImGui::Checkbox("wildcards", &query.useWildcards);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(100);
+    if (ImGui::InputTextWithHint("##SearchType", "Any type", typeNameBuffer, 128)) {
+        query.typeName = TfToken(typeNameBuffer);
+    }
+    ImGui::SameLine();
+    if (ImGui::BeginCombo("##SearchKind", query.kind.IsEmpty() ? "Any kind" : query.kind.GetText())) {
+        if (ImGui::Selectable("Any kind", query.kind.IsEmpty())) {
+            query.kind = TfToken();
+        }
+        for (const auto &kind : KindRegistry::GetAllKinds()) {
+            if (ImGui::Selectable(kind.GetText(), kind == query.kind)) {
+                query.kind = kind;
+            }
+        }
+        ImGui::EndCombo();
+    }
+    ImGui::PopItemWidth();
+    query.pattern = patternBuffer;
     ImGui::SameLine();
     if (ImGui::Button("Select next") || enterPressed) {
-        ExecuteAfterDraw<EditorFindPrim>(std::string(patternBuffer), useRegex);
+        ExecuteAfterDraw<EditorFindPrim>(query, false);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Select all")) {
+        ExecuteAfterDraw<EditorFindPrim>(query, true);
     }
 
 }
@@ -1,3 +1,8 @@
+#include <chrono>
+#include <future>
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/sdf/notice.h>
 #include "TextEditor.h"
 #include "Commands.h"
 #include "Gui.h"
@@ -7,32 +12,166 @@
 // distributed with the api
 //#include <pxr/usd/sdf/fileIO_Common.h>
 
+// The layer is copied for the export only when it hasn't been edited for this delay, so an interactive edition doesn't
+// copy the whole layer at each frame
+static constexpr std::chrono::milliseconds ExportDelay(300);
+
+///
+/// Text of a layer, exported in a background thread only when the layer has changed.
+/// The lines are indexed so the widget only draws the visible ones.
+///
+class LayerTextCache : public TfWeakBase {
+  public:
+    struct LayerText {
+        SdfLayerHandle layer;
+        std::string text;
+        std::vector<size_t> lineOffsets; // Offset of the first character of each line
+    };
+
+    ~LayerTextCache() {
+        TfNotice::Revoke(_layerChangedKey);
+        if (_export.valid()) {
+            _export.wait();
+        }
+    }
+
+    /// Returns true if the layer has changed
+    bool SetLayer(const SdfLayerRefPtr &layer) {
+        if (_layer != SdfLayerHandle(layer)) {
+            TfNotice::Revoke(_layerChangedKey);
+            _layer = layer;
+            if (_layer) {
+                _layerChangedKey = TfNotice::Register(TfCreateWeakPtr(this), &LayerTextCache::OnLayerDidChange, _layer);
+            }
+            _current = LayerText();
+            _isDirty = true;
+            _lastChange = std::chrono::steady_clock::time_point();
+            return true;
+        }
+        return false;
+    }
+
+    /// Collects the finished export and starts a new one if the layer has changed.
+    void Update() {
+        if (_export.valid() && _export.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            LayerText exported = _export.get();
+            if (exported.layer == _layer) {
+                _current = std::move(exported);
+            }
+        }
+        if (_isDirty && !_export.valid() && _layer && std::chrono::steady_clock::now() - _lastChange >= ExportDelay) {
+            // Sdf layers can't be read while they are modified, so the content is copied in an anonymous layer
+            // on the ui thread, which is a lot faster than writing it as text, and the copy is exported in the background
+            SdfLayerRefPtr snapshot = SdfLayer::CreateAnonymous(".usda");
+            snapshot->TransferContent(_layer);
+            SdfLayerHandle layer = _layer;
+            _export = std::async(std::launch::async, [snapshot, layer]() {
+                LayerText exported;
+                exported.layer = layer;
+                snapshot->ExportToString(&exported.text);
+                exported.lineOffsets.push_back(0);
+                for (size_t i = 0; i < exported.text.size(); ++i) {
+                    if (exported.text[i] == '\n') {
+                        exported.lineOffsets.push_back(i + 1);
+                    }
+                }
+                return exported;
+            });
+            _isDirty = false;
+        }
+    }
+
+    bool IsExporting() const { return _export.valid(); }
+    bool HasText() const { return _current.layer == _layer && !_current.lineOffsets.empty(); }
+    const std::string &GetText() const { return _current.text; }
+    size_t GetLineCount() const { return _current.lineOffsets.size(); }
+    const char *GetLineBegin(size_t line) const { return _current.text.data() + _current.lineOffsets[line]; }
+    const char *GetLineEnd(size_t line) const {
+        // The next line offset is just after the carriage return
+        return line + 1 < _current.lineOffsets.size() ? _current.text.data() + _current.lineOffsets[line + 1] - 1
+                                                       : _current.text.data() + _current.text.size();
+    }
+
+  private:
+    void OnLayerDidChange(const SdfNotice::LayersDidChangeSentPerLayer &) {
+        _isDirty = true;
+        _lastChange = std::chrono::steady_clock::now();
+    }
+
+    SdfLayerHandle _layer;
+    TfNotice::Key _layerChangedKey;
+    bool _isDirty = true;
+    std::chrono::steady_clock::time_point _lastChange;
+    std::future<LayerText> _export;
+    LayerText _current;
+};
+
+// Only the visible lines are drawn
+static void DrawLayerTextLines(const LayerTextCache &textCache, const ImVec2 &size) {
+    ScopedStyleColor color(ImGuiCol_ChildBg, ImVec4{0.0, 0.0, 0.0, 1.0});
+    if (ImGui::BeginChild("##LayerTextLines", size, false, ImGuiWindowFlags_HorizontalScrollbar)) {
+        ImGuiListClipper clipper;
+        clipper.Begin(static_cast<int>(textCache.GetLineCount()));
+        while (clipper.Step()) {
+            for (int line = clipper.DisplayStart; line < clipper.DisplayEnd; ++line) {
+                ImGui::TextDisabled("%6d", line + 1);
+                ImGui::SameLine();
+                ImGui::TextUnformatted(textCache.GetLineBegin(line), textCache.GetLineEnd(line));
+            }
+        }
+    }
+    ImGui::EndChild();
+}
+
 void DrawTextEditor(SdfLayerRefPtr layer) {
-    static std::string layerText;
+    static LayerTextCache textCache;
+    static std::string editedText;
+    static bool isEditing = false;
     ImGuiIO &io = ImGui::GetIO();
     ImGuiWindow *window = ImGui::GetCurrentWindow();
     if (window->SkipItems) {
         return;
     }
-    ImGui::Text("WARNING: this will slow down the application if the layer is big");
-    ImGui::Text("        and will consume lots of memory. Use with care for now");
+    if (textCache.SetLayer(layer)) {
+        // The edited text belongs to the previous layer
+        isEditing = false;
+        editedText.clear();
+    }
+    if (!isEditing) { // Don't update the text while the user is modifying it
+        textCache.Update();
+    }
     if (layer) {
-        layer->ExportToString(&layerText);
         ImGui::Text("%s", layer->GetDisplayName().c_str());
+        ImGui::SameLine();
+        if (!isEditing && ImGui::SmallButton("Edit") && textCache.HasText()) {
+            editedText = textCache.GetText();
+            isEditing = true;
+        } else if (isEditing && ImGui::SmallButton("Stop editing")) {
+            isEditing = false;
+        }
+        if (textCache.IsExporting()) {
+            ImGui::SameLine();
+            ImGui::Text("Updating text...");
+        }
     }
     ImGui::PushItemWidth(-FLT_MIN);
     ImGuiWindow *currentWindow = ImGui::GetCurrentWindow();
     ImVec2 sizeArg(0, currentWindow->Size[1] - 120);
     ImGui::PushFont(io.Fonts->Fonts[1]);
-    {
+    if (isEditing) {
         ScopedStyleColor color(ImGuiCol_FrameBg, ImVec4{0.0, 0.0, 0.0, 1.0});
-        ImGui::InputTextMultiline("###TextEditor", &layerText, sizeArg,
+        ImGui::InputTextMultiline("###TextEditor", &editedText, sizeArg,
                                   ImGuiInputTextFlags_None | ImGuiInputTextFlags_NoUndoRedo);
         if (layer && ImGui::IsItemDeactivatedAfterEdit()) {
-            ExecuteAfterDraw<LayerTextEdit>(layer, layerText);
+            ExecuteAfterDraw<LayerTextEdit>(layer, editedText);
+            isEditing = false;
         }
+    } else if (textCache.HasText()) {
+        DrawLayerTextLines(textCache, sizeArg);
     }
     ImGui::PopFont();
     ImGui::PopItemWidth();
-    ImGui::Text("Ctrl+Enter to apply your change");
+    if (isEditing) {
+        ImGui::Text("WARNING: editing a big layer will consume lots of memory. Ctrl+Enter to apply your change");
+    }
 }
@@ -1,4 +1,9 @@
 #include <iostream>
+#include <unordered_map>
+#include <pxr/base/tf/notice.h>
+#include <pxr/base/tf/weakBase.h>
+#include <pxr/usd/usd/attributeQuery.h>
+#include <pxr/usd/usd/notice.h>
 #include <pxr/usd/usd/prim.h>
 #include <pxr/usd/usd/variantSets.h>
 #include <pxr/usd/usd/primCompositionQuery.h>
@@ -80,26 +85,18 @@ void DrawAttributeDisplayName(const UsdAttribute &attribute) {
     ImGui::Text("%s", displayName.c_str());
 }
 
-void DrawAttributeValueAtTime(UsdAttribute &attribute, UsdTimeCode currentTime) {
-    const std::string attributeLabel = GetDisplayName(attribute);
-    VtValue value;
-    // TODO: On the lower spec mac, this call appears to be really slow with some attributes
-    //       AttributeQuery could be a solution but doesn't update with external data updates
-    const bool HasValue = attribute.Get(&value, currentTime);
-
+/// Draws the value editor, or "no value", and the connections of an attribute. Returns the modified value or an empty VtValue
+static VtValue DrawAttributeValueAndConnections(const std::string &attributeLabel, UsdAttribute &attribute, const VtValue *value,
+                                                const SdfPathVector &connections) {
+    const bool HasValue = value != nullptr;
+    VtValue modified;
     if (HasValue) {
-        VtValue modified = DrawAttributeValue(attributeLabel, attribute, value);
-        if (!modified.IsEmpty()) {
-            ExecuteAfterDraw<AttributeSet>(attribute, modified,
-                                           attribute.GetNumTimeSamples() ? currentTime : UsdTimeCode::Default());
-        }
+        modified = DrawAttributeValue(attributeLabel, attribute, *value);
     }
 
-    const bool HasConnections = attribute.HasAuthoredConnections();
+    const bool HasConnections = !connections.empty();
     if (HasConnections) {
-        SdfPathVector sources;
-        attribute.GetConnections(&sources);
-        for (auto &connection : sources) {
+        for (auto &connection : connections) {
             ImGui::PushID(connection.GetString().c_str());
             if (ImGui::Button(ICON_FA_TRASH)) {
                 ExecuteAfterDraw(&UsdAttribute::RemoveConnection, attribute, connection);
@@ -113,6 +110,22 @@ void DrawAttributeValueAtTime(UsdAttribute &attribute, UsdTimeCode currentTime)
     if (!HasValue && !HasConnections) {
         ImGui::TextColored(ImVec4({0.5, 0.5, 0.5, 0.5}), "no value");
     }
+    return modified;
+}
+
+void DrawAttributeValueAtTime(UsdAttribute &attribute, UsdTimeCode currentTime) {
+    VtValue value;
+    // TODO: On the lower spec mac, this call appears to be really slow with some attributes,
+    //       the property editor uses the attribute queries of UsdPrimPropertiesCache instead
+    const bool HasValue = attribute.Get(&value, currentTime);
+    SdfPathVector connections;
+    if (attribute.HasAuthoredConnections()) {
+        attribute.GetConnections(&connections);
+    }
+    VtValue modified = DrawAttributeValueAndConnections(GetDisplayName(attribute), attribute, HasValue ? &value : nullptr, connections);
+    if (!modified.IsEmpty()) {
+        ExecuteAfterDraw<AttributeSet>(attribute, modified, attribute.GetNumTimeSamples() ? currentTime : UsdTimeCode::Default());
+    }
 }
 
 void DrawUsdRelationshipDisplayName(const UsdRelationship &relationship) {
@@ -530,6 +543,145 @@ void DrawUsdPrimHeader(UsdPrim &prim) {
     }
 }
 
+/// Attributes and relationships of the prim displayed in the property editor.
+/// Resolving the values with UsdAttribute::Get every frame is too slow on prims with thousands of primvars, so the
+/// attributes are kept with a UsdAttributeQuery and their last resolved value. The values are resolved again only for the
+/// visible rows, when the time changes and the value might be time varying, or when the attribute is edited.
+class UsdPrimPropertiesCache : public TfWeakBase {
+  public:
+    struct AttributeRow {
+        UsdAttribute attribute;
+        UsdAttributeQuery query;
+        std::string displayName;
+        bool hasTimeSamples = false; // The edits are keyed at the current time
+        bool mightBeTimeVarying = false;
+        SdfPathVector connections;
+        // Last resolved value
+        bool isResolved = false;
+        bool hasValue = false;
+        VtValue value;
+        UsdTimeCode valueTime;
+    };
+
+    ~UsdPrimPropertiesCache() { TfNotice::Revoke(_objectsChangedKey); }
+
+    /// Updates the cache if the prim has changed or was edited since the last frame
+    void Update(const UsdPrim &prim);
+
+    /// Resolves the value of an attribute at the given time if the cached one is not valid anymore
+    void ResolveValue(AttributeRow &row, UsdTimeCode time);
+
+    std::vector<AttributeRow> &GetAttributes() { return _attributes; }
+    const std::vector<UsdRelationship> &GetRelationships() const { return _relationships; }
+
+  private:
+    void OnObjectsChanged(const UsdNotice::ObjectsChanged &notice);
+    void Rebuild(const UsdPrim &prim);
+    void UpdateAttributeRow(AttributeRow &row);
+
+    std::vector<AttributeRow> _attributes;
+    std::vector<UsdRelationship> _relationships;
+    std::unordered_map<TfToken, size_t, TfToken::HashFunctor> _attributeIndices; // Index in _attributes by name
+    std::vector<TfToken> _dirtyAttributes;
+    bool _mustRebuild = true;
+    SdfPath _primPath;
+    UsdStageWeakPtr _stage;
+    TfNotice::Key _objectsChangedKey;
+};
+
+void UsdPrimPropertiesCache::Update(const UsdPrim &prim) {
+    if (_stage != prim.GetStage()) {
+        TfNotice::Revoke(_objectsChangedKey);
+        _stage = prim.GetStage();
+        if (_stage) {
+            _objectsChangedKey = TfNotice::Register(TfCreateWeakPtr(this), &UsdPrimPropertiesCache::OnObjectsChanged, _stage);
+        }
+        _mustRebuild = true;
+    }
+    if (_primPath != prim.GetPath()) {
+        _primPath = prim.GetPath();
+        _mustRebuild = true;
+    }
+    if (_mustRebuild) {
+        Rebuild(prim);
+    } else {
+        for (const auto &name : _dirtyAttributes) {
+            const auto it = _attributeIndices.find(name);
+            if (it != _attributeIndices.end()) {
+                UpdateAttributeRow(_attributes[it->second]);
+            }
+        }
+    }
+    _mustRebuild = false;
+    _dirtyAttributes.clear();
+}
+
+void UsdPrimPropertiesCache::OnObjectsChanged(const UsdNotice::ObjectsChanged &notice) {
+    // A resync of the prim or its ancestors can change all the properties, a resync of a property means it was added or removed
+    for (const auto &path : notice.GetResyncedPaths()) {
+        if (_primPath.HasPrefix(path.GetPrimPath()) || path.GetPrimPath() == _primPath) {
+            _mustRebuild = true;
+            return;
+        }
+    }
+    // The value, the time samples or the connections of an attribute were edited
+    for (const auto &path : notice.GetChangedInfoOnlyPaths()) {
+        if (path.IsPropertyPath() && path.GetPrimPath() == _primPath) {
+            _dirtyAttributes.push_back(path.GetNameToken());
+        }
+    }
+}
+
+void UsdPrimPropertiesCache::Rebuild(const UsdPrim &prim) {
+    _attributes.clear();
+    _relationships.clear();
+    _attributeIndices.clear();
+    if (!prim) {
+        return;
+    }
+    for (const auto &attribute : prim.GetAttributes()) {
+        _attributeIndices[attribute.GetName()] = _attributes.size();
+        _attributes.emplace_back();
+        AttributeRow &row = _attributes.back();
+        row.attribute = attribute;
+        UpdateAttributeRow(row);
+    }
+    _relationships = prim.GetRelationships();
+}
+
+// The query is created again as it doesn't see the edits made after its creation. The display name is a metadata
+// of the attribute, its edits are notified as the value edits
+void UsdPrimPropertiesCache::UpdateAttributeRow(AttributeRow &row) {
+    row.displayName = GetDisplayName(row.attribute);
+    row.query = UsdAttributeQuery(row.attribute);
+    row.hasTimeSamples = row.query.GetNumTimeSamples() > 0;
+    row.mightBeTimeVarying = row.query.ValueMightBeTimeVarying();
+    row.connections.clear();
+    if (row.attribute.HasAuthoredConnections()) {
+        row.attribute.GetConnections(&row.connections);
+    }
+    row.isResolved = false;
+}
+
+void UsdPrimPropertiesCache::ResolveValue(AttributeRow &row, UsdTimeCode time) {
+    if (row.isResolved && (row.valueTime == time || !row.mightBeTimeVarying)) {
+        return;
+    }
+    row.hasValue = row.query.Get(&row.value, time);
+    row.valueTime = time;
+    row.isResolved = true;
+}
+
+static void DrawAttributeRowValue(UsdPrimPropertiesCache &cache, UsdPrimPropertiesCache::AttributeRow &row,
+                                  UsdTimeCode currentTime) {
+    cache.ResolveValue(row, currentTime);
+    VtValue modified =
+        DrawAttributeValueAndConnections(row.displayName, row.attribute, row.hasValue ? &row.value : nullptr, row.connections);
+    if (!modified.IsEmpty()) {
+        ExecuteAfterDraw<AttributeSet>(row.attribute, modified, row.hasTimeSamples ? currentTime : UsdTimeCode::Default());
+    }
+}
+
 void DrawUsdPrimProperties(UsdPrim &prim, UsdTimeCode currentTime) {
 
     DrawPropertyEditorMenuBar(prim, 0);
@@ -567,32 +719,40 @@ void DrawUsdPrimProperties(UsdPrim &prim, UsdTimeCode currentTime) {
             ImGui::TableSetupColumn("Value");
             ImGui::TableHeadersRow();
 
-            int miniButtonId = 0;
+            static UsdPrimPropertiesCache cache;
+            cache.Update(prim);
+            auto &attributes = cache.GetAttributes();
             const auto &editTarget = prim.GetStage()->GetEditTarget();
 
-            // Draw attributes
-            for (auto &attribute : prim.GetAttributes()) {
-                ImGui::TableNextRow(ImGuiTableRowFlags_None, TableRowDefaultHeight);
-                ImGui::TableSetColumnIndex(0);
-                ImGui::PushID(miniButtonId++);
-                DrawPropertyMiniButton(attribute, editTarget, currentTime);
-                ImGui::PopID();
-
-                ImGui::TableSetColumnIndex(1);
-                DrawAttributeDisplayName(attribute);
-
-                ImGui::TableSetColumnIndex(2);
-                ImGui::PushItemWidth(-FLT_MIN); // Right align and get rid of widget label
-                ImGui::PushID(attribute.GetPath().GetHash());
-                DrawAttributeValueAtTime(attribute, currentTime);
-                ImGui::PopID();
-                ImGui::PopItemWidth();
-                // TODO: in the hint ???
-                // DrawAttributeTypeInfo(attribute);
+            // Draw attributes, only the visible rows are resolved
+            ImGuiListClipper clipper;
+            clipper.Begin(static_cast<int>(attributes.size()));
+            while (clipper.Step()) {
+                for (int rowId = clipper.DisplayStart; rowId < clipper.DisplayEnd; rowId++) {
+                    auto &row = attributes[rowId];
+                    ImGui::TableNextRow(ImGuiTableRowFlags_None, TableRowDefaultHeight);
+                    ImGui::TableSetColumnIndex(0);
+                    ImGui::PushID(rowId);
+                    DrawPropertyMiniButton(row.attribute, editTarget, currentTime);
+                    ImGui::PopID();
+
+                    ImGui::TableSetColumnIndex(1);
+                    ImGui::Text("%s", row.displayName.c_str());
+
+                    ImGui::TableSetColumnIndex(2);
+                    ImGui::PushItemWidth(-FLT_MIN); // Right align and get rid of widget label
+                    ImGui::PushID(row.attribute.GetPath().GetHash());
+                    DrawAttributeRowValue(cache, row, currentTime);
+                    ImGui::PopID();
+                    ImGui::PopItemWidth();
+                    // TODO: in the hint ???
+                    // DrawAttributeTypeInfo(attribute);
+                }
             }
 
             // Draw relations
-            for (auto &relationship : prim.GetRelationships()) {
+            int miniButtonId = static_cast<int>(attributes.size());
+            for (auto relationship : cache.GetRelationships()) {
                 ImGui::TableNextRow();
 
                 ImGui::TableSetColumnIndex(0);